@@ -45,17 +45,10 @@ struct _FpDeviceEgis0570
 G_DECLARE_FINAL_TYPE (FpDeviceEgis0570, fpi_device_egis0570, FPI, DEVICE_EGIS0570, FpImageDevice);
 G_DEFINE_TYPE (FpDeviceEgis0570, fpi_device_egis0570, FP_TYPE_IMAGE_DEVICE);
 
-static unsigned char
-egis_get_pixel (struct fpi_frame_asmbl_ctx *ctx, struct fpi_frame *frame, unsigned int x, unsigned int y)
-{
-  return frame->data[x + y * ctx->frame_width];
-}
-
 static struct fpi_frame_asmbl_ctx assembling_ctx = {
   .frame_width = EGIS0570_IMGWIDTH,
   .frame_height = EGIS0570_RFMGHEIGHT,
   .image_width = EGIS0570_IMGWIDTH * 4 / 3,
-  .get_pixel = egis_get_pixel,
 };
 
 /*
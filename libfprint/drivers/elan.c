@@ -41,21 +41,6 @@
 #include "drivers_api.h"
 #include "elan.h"
 
-static unsigned char
-elan_get_pixel (struct fpi_frame_asmbl_ctx *ctx,
-                struct fpi_frame *frame, unsigned int x,
-                unsigned int y)
-{
-  return frame->data[x + y * ctx->frame_width];
-}
-
-static struct fpi_frame_asmbl_ctx assembling_ctx = {
-  .frame_width = 0,
-  .frame_height = 0,
-  .image_width = 0,
-  .get_pixel = elan_get_pixel,
-};
-
 struct _FpiDeviceElan
 {
   FpImageDevice parent;
@@ -63,8 +48,9 @@ struct _FpiDeviceElan
   /* device config */
   unsigned short dev_type;
   unsigned short fw_ver;
-  void           (*process_frame) (unsigned short *raw_frame,
-                                   GSList       ** frames);
+  void           (*process_frame) (unsigned short   *raw_frame,
+                                   struct fpi_frame *frame,
+                                   unsigned int      frame_size);
   /* end device config */
 
   /* commands */
@@ -73,17 +59,19 @@ struct _FpiDeviceElan
   /* end commands */
 
   /* state */
-  gboolean        active;
-  gboolean        deactivating;
-  unsigned char  *last_read;
-  unsigned char   calib_atts_left;
-  unsigned char   calib_status;
-  unsigned short *background;
-  unsigned char   frame_width;
-  unsigned char   frame_height;
-  unsigned char   raw_frame_height;
-  int             num_frames;
-  GSList         *frames;
+  gboolean                   active;
+  gboolean                   deactivating;
+  unsigned char             *last_read;
+  unsigned char              calib_atts_left;
+  unsigned char              calib_status;
+  unsigned short            *background;
+  unsigned char              frame_width;
+  unsigned char              frame_height;
+  unsigned char              raw_frame_height;
+  int                        num_frames;
+  FpiFrameStore             *raw_frames;
+  struct fpi_frame_asmbl_ctx assembling_ctx;
+  FpiFrameAssembler         *assembler;
   /* end state */
 };
 G_DEFINE_TYPE (FpiDeviceElan, fpi_device_elan, FP_TYPE_IMAGE_DEVICE);
@@ -107,9 +95,11 @@ elan_dev_reset_state (FpiDeviceElan *elandev)
   g_free (elandev->last_read);
   elandev->last_read = NULL;
 
-  g_slist_free_full (elandev->frames, g_free);
-  elandev->frames = NULL;
   elandev->num_frames = 0;
+  if (elandev->raw_frames)
+    fpi_frame_store_clear (elandev->raw_frames);
+  if (elandev->assembler)
+    fpi_frame_assembler_reset (elandev->assembler);
 }
 
 static void
@@ -162,6 +152,30 @@ elan_save_background (FpiDeviceElan *elandev)
   elan_save_frame (elandev, elandev->background);
 }
 
+/* movement is estimated while the finger is still swiping, so that the
+ * image can be submitted right after the finger is removed */
+static void
+elan_assemble_frame (FpiDeviceElan *self, unsigned short *raw_frame)
+{
+  struct fpi_frame *frame;
+
+  G_DEBUG_HERE ();
+
+  if (!self->assembler)
+    {
+      self->assembling_ctx.frame_width = self->frame_width;
+      self->assembling_ctx.frame_height = self->frame_height;
+      self->assembling_ctx.image_width = self->frame_width * 3 / 2;
+      self->assembler = fpi_frame_assembler_new (&self->assembling_ctx, FALSE,
+                                                 ELAN_MAX_FRAMES);
+    }
+
+  frame = fpi_frame_assembler_get_next_frame (self->assembler);
+  self->process_frame (raw_frame, frame,
+                       self->frame_width * self->frame_height);
+  fpi_frame_assembler_add_frame (self->assembler, frame);
+}
+
 /* save a frame as part of the fingerprint image
  * background needs to have been captured for this routine to work
  * Elantech recommends 2-step non-linear normalization in order to reduce
@@ -203,8 +217,15 @@ elan_save_img_frame (FpiDeviceElan *elandev)
   G_DEBUG_HERE ();
 
   unsigned int frame_size = elandev->frame_width * elandev->frame_height;
-  unsigned short *frame = g_malloc (frame_size * sizeof (short));
+  unsigned short *frame;
 
+  /* only the frames which are not assembled yet are kept */
+  if (!elandev->raw_frames)
+    elandev->raw_frames = fpi_frame_store_new (frame_size * sizeof (short),
+                                               ELAN_SKIP_LAST_FRAMES + 1);
+
+  /* Indirect cast to avoid alignment warning, frames are aligned. */
+  frame = (void *) fpi_frame_store_get_next (elandev->raw_frames)->data;
   elan_save_frame (elandev, frame);
   unsigned int sum = 0;
 
@@ -221,24 +242,26 @@ elan_save_img_frame (FpiDeviceElan *elandev)
     {
       fp_dbg
         ("frame darker than background; finger present during calibration?");
-      g_free (frame);
       return -1;
     }
 
-  elandev->frames = g_slist_prepend (elandev->frames, frame);
+  fpi_frame_store_append (elandev->raw_frames);
   elandev->num_frames += 1;
+
+  /* the last frames are not used, so only assemble a frame once enough
+   * frames have been captured after it */
+  if (elandev->num_frames > ELAN_SKIP_LAST_FRAMES)
+    elan_assemble_frame (elandev, (void *)
+                         fpi_frame_store_get_frame (elandev->raw_frames, 0)->data);
+
   return 0;
 }
 
 static void
-elan_process_frame_linear (unsigned short *raw_frame,
-                           GSList       ** frames)
+elan_process_frame_linear (unsigned short   *raw_frame,
+                           struct fpi_frame *frame,
+                           unsigned int      frame_size)
 {
-  unsigned int frame_size =
-    assembling_ctx.frame_width * assembling_ctx.frame_height;
-  struct fpi_frame *frame =
-    g_malloc (frame_size + sizeof (struct fpi_frame));
-
   G_DEBUG_HERE ();
 
   unsigned short min = 0xffff, max = 0;
@@ -261,21 +284,15 @@ elan_process_frame_linear (unsigned short *raw_frame,
       px = (px - min) * 0xff / (max - min);
       frame->data[i] = (unsigned char) px;
     }
-
-  *frames = g_slist_prepend (*frames, frame);
 }
 
 static void
-elan_process_frame_thirds (unsigned short *raw_frame,
-                           GSList       ** frames)
+elan_process_frame_thirds (unsigned short   *raw_frame,
+                           struct fpi_frame *frame,
+                           unsigned int      frame_size)
 {
   G_DEBUG_HERE ();
 
-  unsigned int frame_size =
-    assembling_ctx.frame_width * assembling_ctx.frame_height;
-  struct fpi_frame *frame =
-    g_malloc (frame_size + sizeof (struct fpi_frame));
-
   unsigned short lvl0, lvl1, lvl2, lvl3;
   unsigned short *sorted = g_malloc (frame_size * sizeof (short));
 
@@ -300,32 +317,19 @@ elan_process_frame_thirds (unsigned short *raw_frame,
         px = 155 + ((px - lvl2) * 100 / (lvl3 - lvl2));
       frame->data[i] = (unsigned char) px;
     }
-
-  *frames = g_slist_prepend (*frames, frame);
 }
 
 static void
 elan_submit_image (FpImageDevice *dev)
 {
   FpiDeviceElan *self = FPI_DEVICE_ELAN (dev);
-  GSList *raw_frames;
-  GSList *frames = NULL;
   FpImage *img;
 
   G_DEBUG_HERE ();
 
-  raw_frames = g_slist_nth (self->frames, ELAN_SKIP_LAST_FRAMES);
-
-  assembling_ctx.frame_width = self->frame_width;
-  assembling_ctx.frame_height = self->frame_height;
-  assembling_ctx.image_width = self->frame_width * 3 / 2;
-  g_slist_foreach (raw_frames, (GFunc) self->process_frame, &frames);
-  fpi_do_movement_estimation (&assembling_ctx, frames);
-  img = fpi_assemble_frames (&assembling_ctx, frames);
+  img = fpi_frame_assembler_finish (self->assembler);
   img->flags |= FPI_IMAGE_PARTIAL;
 
-  g_slist_free_full (frames, g_free);
-
   fpi_image_device_image_captured (dev, img);
 }
 
@@ -939,6 +943,8 @@ dev_deinit (FpImageDevice *dev)
   G_DEBUG_HERE ();
 
   elan_dev_reset_state (self);
+  g_clear_pointer (&self->raw_frames, fpi_frame_store_free);
+  g_clear_pointer (&self->assembler, fpi_frame_assembler_free);
   g_free (self->background);
   g_usb_device_release_interface (fpi_device_get_usb_device (FP_DEVICE (dev)),
                                   0, 0, &error);
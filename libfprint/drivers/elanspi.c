@@ -75,8 +75,11 @@ struct _FpiDeviceElanSpi
   guint16 *last_image;
   guint16 *prev_frame_image;
 
-  gint     fp_empty_counter;
-  GSList  *fp_frame_list;
+  gint                       fp_empty_counter;
+  gint                       fp_frame_count;
+  FpiFrameStore             *fp_frames;
+  struct fpi_frame_asmbl_ctx assembling_ctx;
+  FpiFrameAssembler         *assembler;
 
   /* wait ctx */
   gint     finger_wait_debounce;
@@ -1323,10 +1326,29 @@ elanspi_process_frame (FpiDeviceElanSpi *self, const guint16 *data_in, guint8 *d
     }
 }
 
-static unsigned char
-elanspi_fp_assembling_get_pixel (struct fpi_frame_asmbl_ctx *ctx, struct fpi_frame *frame, unsigned int x, unsigned int y)
+static void
+elanspi_fp_frames_clear (FpiDeviceElanSpi *self)
+{
+  self->fp_frame_count = 0;
+  if (self->fp_frames)
+    fpi_frame_store_clear (self->fp_frames);
+  if (self->assembler)
+    fpi_frame_assembler_reset (self->assembler);
+}
+
+/*
+ * Frames are assembled newest first, without the last ones which are
+ * discarded. So only these are kept, and a frame is added to the assembler
+ * once enough newer frames have been captured. This lets it estimate the
+ * movement while the finger is still swiping.
+ */
+static void
+elanspi_fp_frame_assemble (FpiDeviceElanSpi *self)
 {
-  return frame->data[y * ctx->frame_width + x];
+  if (self->fp_frame_count <= ELANSPI_SWIPE_FRAMES_DISCARD)
+    return;
+
+  fpi_frame_assembler_add_frame (self->assembler, fpi_frame_store_get_frame (self->fp_frames, 0));
 }
 
 static void
@@ -1334,20 +1356,9 @@ elanspi_fp_frame_stitch_and_submit (FpiDeviceElanSpi *self)
 {
   g_autoptr(FpImage) img = NULL;
   g_autoptr(FpImage) scaled = NULL;
-  struct fpi_frame_asmbl_ctx assembling_ctx = {
-    .image_width = (self->frame_width * 3) / 2,
-
-    .frame_width = self->frame_width,
-    .frame_height = self->frame_height,
-
-    .get_pixel = elanspi_fp_assembling_get_pixel,
-  };
 
   /* stitch image */
-  GSList *frame_start = g_slist_nth (self->fp_frame_list, ELANSPI_SWIPE_FRAMES_DISCARD);
-
-  fpi_do_movement_estimation (&assembling_ctx, frame_start);
-  img = fpi_assemble_frames (&assembling_ctx, frame_start);
+  img = fpi_frame_assembler_finish (self->assembler);
   scaled = fpi_image_resize (img, 2, 2);
 
   scaled->flags |= FPI_IMAGE_PARTIAL | FPI_IMAGE_COLORS_INVERTED;
@@ -1356,7 +1367,7 @@ elanspi_fp_frame_stitch_and_submit (FpiDeviceElanSpi *self)
   fpi_image_device_image_captured (FP_IMAGE_DEVICE (self), g_steal_pointer (&scaled));
 
   /* clean out frame data */
-  g_slist_free_full (g_steal_pointer (&self->fp_frame_list), g_free);
+  elanspi_fp_frames_clear (self);
 }
 
 static gint64
@@ -1385,7 +1396,7 @@ elanspi_get_frame_diff_stddev_sq (FpiDeviceElanSpi *self, guint16 *frame1, guint
 static void
 elanspi_fp_frame_handler (FpiSsm *ssm, FpiDeviceElanSpi *self)
 {
-  g_autofree struct fpi_frame *this_frame = NULL;
+  struct fpi_frame *this_frame;
 
   switch (elanspi_guess_image (self, self->last_image))
     {
@@ -1399,7 +1410,7 @@ elanspi_fp_frame_handler (FpiSsm *ssm, FpiDeviceElanSpi *self)
       if (self->fp_empty_counter > 1)
         {
           fp_dbg ("<fp_frame> have enough debounce");
-          if (g_slist_length (self->fp_frame_list) >= ELANSPI_MIN_FRAMES_SWIPE)
+          if (self->fp_frame_count >= ELANSPI_MIN_FRAMES_SWIPE)
             {
               fp_dbg ("<fp_frame> have enough frames, submitting");
               elanspi_fp_frame_stitch_and_submit (self);
@@ -1414,7 +1425,7 @@ elanspi_fp_frame_handler (FpiSsm *ssm, FpiDeviceElanSpi *self)
       break;
 
     case ELANSPI_GUESS_FINGERPRINT:
-      if (self->fp_empty_counter && self->fp_frame_list)
+      if (self->fp_empty_counter && self->fp_frame_count)
         {
           if (self->fp_empty_counter < 1)
             {
@@ -1424,12 +1435,12 @@ elanspi_fp_frame_handler (FpiSsm *ssm, FpiDeviceElanSpi *self)
           else
             {
               fp_dbg ("<fp_frame> too many empties, clearing list");
-              g_slist_free_full (g_steal_pointer (&self->fp_frame_list), g_free);
+              elanspi_fp_frames_clear (self);
               self->fp_empty_counter = 0;
             }
         }
 
-      if (g_slist_length (self->fp_frame_list) > ELANSPI_MAX_FRAMES_SWIPE)
+      if (self->fp_frame_count > ELANSPI_MAX_FRAMES_SWIPE)
         {
           fp_dbg ("<fp_frame> have enough frames, exiting now");
           elanspi_fp_frame_stitch_and_submit (self);
@@ -1437,11 +1448,25 @@ elanspi_fp_frame_handler (FpiSsm *ssm, FpiDeviceElanSpi *self)
         }
 
       /* append image */
-      this_frame = g_malloc0 (self->sensor_height * self->sensor_width + sizeof (struct fpi_frame));
+      if (!self->fp_frames)
+        {
+          self->assembling_ctx = (struct fpi_frame_asmbl_ctx) {
+            .image_width = (self->frame_width * 3) / 2,
+
+            .frame_width = self->frame_width,
+            .frame_height = self->frame_height,
+          };
+          self->fp_frames = fpi_frame_store_new (self->frame_width * self->frame_height,
+                                                 ELANSPI_SWIPE_FRAMES_DISCARD + 1);
+          self->assembler = fpi_frame_assembler_new (&self->assembling_ctx, TRUE,
+                                                     ELANSPI_MAX_FRAMES_SWIPE);
+        }
+
+      this_frame = fpi_frame_store_get_next (self->fp_frames);
       elanspi_correct_with_bg (self, self->last_image);
       elanspi_process_frame (self, self->last_image, this_frame->data);
 
-      if (self->fp_frame_list)
+      if (self->fp_frame_count)
         {
           gint difference = elanspi_get_frame_diff_stddev_sq (self, self->last_image, self->prev_frame_image);
           fp_dbg ("<fp_frame> diff = %d", difference);
@@ -1451,7 +1476,9 @@ elanspi_fp_frame_handler (FpiSsm *ssm, FpiDeviceElanSpi *self)
               break;
             }
         }
-      self->fp_frame_list = g_slist_prepend (self->fp_frame_list, g_steal_pointer (&this_frame));
+      fpi_frame_store_append (self->fp_frames);
+      self->fp_frame_count += 1;
+      elanspi_fp_frame_assemble (self);
       memcpy (self->prev_frame_image, self->last_image, self->sensor_height * self->sensor_width * 2);
       break;
     }
@@ -1520,7 +1547,7 @@ elanspi_fp_capture_ssm_handler (FpiSsm *ssm, FpDevice *dev)
 
       /* prepare to take actual image */
       self->finger_wait_debounce = 0;
-      g_slist_free_full (g_steal_pointer (&self->fp_frame_list), g_free);
+      elanspi_fp_frames_clear (self);
       self->fp_empty_counter = 0;
 
       /* report finger status */
@@ -1683,7 +1710,8 @@ fpi_device_elanspi_finalize (GObject *this)
   g_clear_pointer (&self->bg_image, g_free);
   g_clear_pointer (&self->last_image, g_free);
   g_clear_pointer (&self->prev_frame_image, g_free);
-  g_slist_free_full (g_steal_pointer (&self->fp_frame_list), g_free);
+  g_clear_pointer (&self->fp_frames, fpi_frame_store_free);
+  g_clear_pointer (&self->assembler, fpi_frame_assembler_free);
 
   G_OBJECT_CLASS (fpi_device_elanspi_parent_class)->finalize (this);
 }
@@ -37,6 +37,8 @@ typedef struct
   FpImage            *capture_image;
 
   gint                bz3_threshold;
+  gboolean            bz3_prefilter_enabled;
+  FpiPrintPrefilter   bz3_prefilter;
 } FpImageDevicePrivate;
 
 
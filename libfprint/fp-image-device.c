@@ -22,8 +22,6 @@
 
 #include "fp-image-device-private.h"
 
-#define BOZORTH3_DEFAULT_THRESHOLD 40
-
 /**
  * SECTION: fp-image-device
  * @title: FpImageDevice
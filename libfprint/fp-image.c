@@ -284,6 +284,7 @@ fp_image_detect_minutiae_thread_func (GTask        *task,
   gint bw, bh, bd;
   gint r;
   g_autofree LFSPARMS *lfsparms = NULL;
+  LFS_TIMINGS timings;
 
   /* Normalize the image first */
   if (data->flags & FPI_IMAGE_H_FLIPPED)
@@ -309,6 +310,14 @@ fp_image_detect_minutiae_thread_func (GTask        *task,
   g_timer_stop (timer);
   fp_dbg ("Minutiae scan completed in %f secs", g_timer_elapsed (timer, NULL));
 
+  /* One line per scan, to compare the stages across sensors and image sizes */
+  get_minutiae_timings (&timings);
+  fp_dbg ("Minutiae scan stages: width=%d height=%d maps=%f binarization=%f "
+          "detection=%f removal=%f ridge_counts=%f quality=%f total=%f",
+          data->width, data->height, timings.maps, timings.binarization,
+          timings.detection, timings.removal, timings.ridge_counts,
+          timings.quality, timings.total);
+
   data->binarized = g_steal_pointer (&bdata);
   data->minutiae = minutiae;
 
@@ -23,6 +23,30 @@
 
 #include <nbis.h>
 
+/* Minutiae of a single NBIS print. Only the used rows are stored, as one
+ * 16 bit array each for the x and y coordinates and theta. They are only
+ * expanded into a struct xyt_struct where the matcher needs it. */
+typedef struct
+{
+  guint  n_minutiae;
+  gint16 values[];
+} FpiPrintMinutiae;
+
+#define FPI_PRINT_MINUTIAE_X(m) (&(m)->values[0])
+#define FPI_PRINT_MINUTIAE_Y(m) (&(m)->values[(m)->n_minutiae])
+#define FPI_PRINT_MINUTIAE_THETA(m) (&(m)->values[2 * (m)->n_minutiae])
+
+/* Pruned and sorted bozorth3 comparison table of an enrolled print, with
+ * COLS_SIZE_2 values for each of the len rows. The table is followed by the
+ * sorted len histogram bins of its rows, used to pre-filter galleries. */
+typedef struct
+{
+  gint len;
+  gint edges[];
+} FpiPrintBz3Edges;
+
+#define FPI_PRINT_BZ3_SIGNATURE(e) ((guint16 *) &(e)->edges[(e)->len * COLS_SIZE_2])
+
 struct _FpPrint
 {
   GInitiallyUnowned parent_instance;
@@ -42,5 +66,23 @@ struct _FpPrint
   GDate     *enroll_date;
 
   GVariant  *data;
+  /* FpiPrintMinutiae for type NBIS */
   GPtrArray *prints;
+
+  /* Lazily filled FpiPrintBz3Edges for each of prints */
+  GPtrArray *bz3_edges;
 };
+
+FpiPrintBz3Edges *fpi_print_get_bz3_edges (FpPrint *template,
+                                           guint    index);
+FpiPrintBz3Edges *fpi_print_bz3_edges_new (gint len);
+void              fpi_print_bz3_edges_update_signature (FpiPrintBz3Edges *edges);
+GArray           *fpi_print_bz3_prefilter (GPtrArray               *templates,
+                                           gint                     n_templates,
+                                           FpPrint                 *print,
+                                           const FpiPrintPrefilter *prefilter);
+
+FpiPrintMinutiae *fpi_print_minutiae_new (guint n_minutiae);
+gsize             fpi_print_minutiae_size (const FpiPrintMinutiae *minutiae);
+void              fpi_print_minutiae_to_xyt (const FpiPrintMinutiae *minutiae,
+                                             struct xyt_struct      *xyt);
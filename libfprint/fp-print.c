@@ -80,6 +80,7 @@ fp_print_finalize (GObject *object)
   g_clear_pointer (&self->enroll_date, g_date_free);
   g_clear_pointer (&self->data, g_variant_unref);
   g_clear_pointer (&self->prints, g_ptr_array_unref);
+  g_clear_pointer (&self->bz3_edges, g_ptr_array_unref);
 
   G_OBJECT_CLASS (fp_print_parent_class)->finalize (object);
 }
@@ -194,6 +195,7 @@ fp_print_set_property (GObject      *object,
       break;
 
     case PROP_FPI_PRINTS:
+      g_clear_pointer (&self->bz3_edges, g_ptr_array_unref);
       g_clear_pointer (&self->prints, g_ptr_array_unref);
       self->prints = g_value_get_pointer (value);
       break;
@@ -618,10 +620,13 @@ fp_print_equal (FpPrint *self, FpPrint *other)
 
       for (i = 0; i < self->prints->len; i++)
         {
-          struct xyt_struct *a = g_ptr_array_index (self->prints, i);
-          struct xyt_struct *b = g_ptr_array_index (other->prints, i);
+          FpiPrintMinutiae *a = g_ptr_array_index (self->prints, i);
+          FpiPrintMinutiae *b = g_ptr_array_index (other->prints, i);
 
-          if (memcmp (a, b, sizeof (struct xyt_struct)) != 0)
+          if (a->n_minutiae != b->n_minutiae)
+            return FALSE;
+
+          if (memcmp (a, b, fpi_print_minutiae_size (a)) != 0)
             return FALSE;
         }
 
@@ -633,9 +638,146 @@ fp_print_equal (FpPrint *self, FpPrint *other)
     }
 }
 
+/**
+ * fp_print_match:
+ * @self: The enrolled #FpPrint
+ * @probe: A newly scanned #FpPrint containing a single print
+ * @threshold: The match threshold, or 0 for the default
+ * @match: (out) (optional): Whether the prints match
+ * @error: Return location for errors, or %NULL to ignore
+ *
+ * Matches @probe against @self without the device that captured them, for
+ * example to verify deserialized prints on a server. This is only possible
+ * for prints that the library matches itself, i.e. prints from image based
+ * devices. The prints do not need to originate from the same device.
+ *
+ * This function is thread safe and may be called for the same prints from
+ * several threads at once. The comparison tables of @self are computed on
+ * first use and kept with the print, so matching against the same print
+ * again is cheaper.
+ *
+ * Returns: (type void): %FALSE on error, %TRUE otherwise
+ */
+gboolean
+fp_print_match (FpPrint  *self,
+                FpPrint  *probe,
+                gint      threshold,
+                gboolean *match,
+                GError  **error)
+{
+  g_autoptr(GError) err = NULL;
+  FpiMatchResult result;
+
+  g_return_val_if_fail (FP_IS_PRINT (self), FALSE);
+  g_return_val_if_fail (FP_IS_PRINT (probe), FALSE);
+  g_return_val_if_fail (threshold >= 0, FALSE);
+
+  if (threshold == 0)
+    threshold = BOZORTH3_DEFAULT_THRESHOLD;
+
+  result = fpi_print_bz3_match (self, probe, threshold, &err);
+  if (result == FPI_MATCH_ERROR)
+    {
+      g_propagate_error (error, g_steal_pointer (&err));
+      return FALSE;
+    }
+
+  if (match)
+    *match = result == FPI_MATCH_SUCCESS;
+
+  return TRUE;
+}
+
+/**
+ * fp_print_match_gallery:
+ * @probe: A newly scanned #FpPrint containing a single print
+ * @gallery: (element-type FpPrint) (transfer none): The enrolled prints
+ * @threshold: The match threshold, or 0 for the default
+ * @match: (out) (optional) (transfer full) (nullable): Return location for
+ *   the matching print of @gallery, or %NULL if none matched
+ * @error: Return location for errors, or %NULL to ignore
+ *
+ * Identifies @probe within @gallery without the device that captured the
+ * prints. The whole gallery is matched and the print with the highest score
+ * is returned. See fp_print_match() for the requirements on the prints.
+ *
+ * Matching is split between a pool of worker threads, one for each
+ * available CPU core. This function is thread safe.
+ *
+ * Returns: (type void): %FALSE on error, %TRUE otherwise
+ */
+gboolean
+fp_print_match_gallery (FpPrint   *probe,
+                        GPtrArray *gallery,
+                        gint       threshold,
+                        FpPrint  **match,
+                        GError   **error)
+{
+  g_autoptr(GError) err = NULL;
+  FpPrint *result = NULL;
+
+  g_return_val_if_fail (FP_IS_PRINT (probe), FALSE);
+  g_return_val_if_fail (gallery != NULL, FALSE);
+  g_return_val_if_fail (threshold >= 0, FALSE);
+
+  if (threshold == 0)
+    threshold = BOZORTH3_DEFAULT_THRESHOLD;
+
+  if (fpi_print_bz3_identify (gallery, probe, threshold,
+                              FPI_PRINT_IDENTIFY_BEST_MATCH, NULL,
+                              &result, &err) == FPI_MATCH_ERROR)
+    {
+      g_propagate_error (error, g_steal_pointer (&err));
+      return FALSE;
+    }
+
+  if (match)
+    *match = result ? g_object_ref (result) : NULL;
+
+  return TRUE;
+}
+
 #define FPI_PRINT_VARIANT_TYPE G_VARIANT_TYPE ("(issbymsmsia{sv}v)")
 
-G_STATIC_ASSERT (sizeof (((struct xyt_struct *) NULL)->xcol[0]) == 4);
+/* Key in the a{sv} of the serialized print for the bozorth3 comparison
+ * tables, each stored with the digest of the minutiae it was computed from.
+ * The version needs to be bumped if the NBIS matcher starts generating
+ * different tables. */
+#define FPI_PRINT_BZ3_EDGES_KEY "bz3-edges-2"
+
+G_STATIC_ASSERT (sizeof (((FpiPrintBz3Edges *) NULL)->edges[0]) == 4);
+
+/* Minutiae are stored as 32 bit values for compatibility */
+static GVariant *
+minutiae_column_to_variant (const gint16 *values,
+                            guint         n_values)
+{
+  g_autofree gint32 *column = g_new (gint32, n_values);
+  guint i;
+
+  for (i = 0; i < n_values; i++)
+    column[i] = values[i];
+
+  return g_variant_new_fixed_array (G_VARIANT_TYPE_INT32, column, n_values,
+                                    sizeof (column[0]));
+}
+
+/* Returns the SHA-256 digest of the minutiae, independent of the byte order */
+static gchar *
+minutiae_digest (const FpiPrintMinutiae *minutiae)
+{
+  g_autoptr(GChecksum) checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  guint n_values = 3 * minutiae->n_minutiae;
+  g_autofree gint16 *values = g_new (gint16, n_values);
+  guint i;
+
+  for (i = 0; i < n_values; i++)
+    values[i] = GINT16_TO_LE (minutiae->values[i]);
+
+  g_checksum_update (checksum, (const guchar *) values, n_values * sizeof (gint16));
+
+  return g_strdup (g_checksum_get_string (checksum));
+}
 
 /**
  * fp_print_serialize:
@@ -647,6 +789,9 @@ G_STATIC_ASSERT (sizeof (((struct xyt_struct *) NULL)->xcol[0]) == 4);
  * Serialize a print definition for permanent storage. Note that this is
  * lossy in the sense that e.g. the image data is discarded.
  *
+ * This is the same as calling fp_print_serialize_full() with
+ * %FP_PRINT_SERIALIZE_NONE.
+ *
  * Returns: (type void): %TRUE on success
  */
 gboolean
@@ -654,6 +799,36 @@ fp_print_serialize (FpPrint *print,
                     guchar **data,
                     gsize   *length,
                     GError **error)
+{
+  return fp_print_serialize_full (print, FP_PRINT_SERIALIZE_NONE,
+                                  data, length, error);
+}
+
+/**
+ * fp_print_serialize_full:
+ * @print: A #FpPrint
+ * @flags: #FpPrintSerializeFlags to control what is stored
+ * @data: (array length=length) (transfer full) (out): Return location for data pointer
+ * @length: (transfer full) (out): Length of @data
+ * @error: Return location for error
+ *
+ * Serialize a print definition for permanent storage. Note that this is
+ * lossy in the sense that e.g. the image data is discarded.
+ *
+ * With %FP_PRINT_SERIALIZE_MATCH_DATA, the comparison tables that the
+ * NBIS matcher computes for enrolled prints are stored as well. They are
+ * restored by fp_print_deserialize(), so that the first match after loading
+ * the print does not need to compute them again. Older versions of libfprint
+ * ignore the additional data.
+ *
+ * Returns: (type void): %TRUE on success
+ */
+gboolean
+fp_print_serialize_full (FpPrint              *print,
+                         FpPrintSerializeFlags flags,
+                         guchar              **data,
+                         gsize                *length,
+                         GError              **error)
 {
   g_autoptr(GVariant) result = NULL;
   GVariantBuilder builder = G_VARIANT_BUILDER_INIT (FPI_PRINT_VARIANT_TYPE);
@@ -676,8 +851,28 @@ fp_print_serialize (FpPrint *print,
   else
     g_variant_builder_add (&builder, "i", G_MININT32);
 
-  /* Unused a{sv} for expansion */
+  /* a{sv} for expansion, only used for optional data */
   g_variant_builder_open (&builder, G_VARIANT_TYPE_VARDICT);
+  if (print->type == FPI_PRINT_NBIS && (flags & FP_PRINT_SERIALIZE_MATCH_DATA))
+    {
+      GVariantBuilder edges_builder = G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE ("a(sai)"));
+      guint i;
+
+      for (i = 0; i < print->prints->len; i++)
+        {
+          FpiPrintBz3Edges *edges = fpi_print_get_bz3_edges (print, i);
+          g_autofree gchar *digest = minutiae_digest (g_ptr_array_index (print->prints, i));
+
+          g_variant_builder_add (&edges_builder, "(s@ai)", digest,
+                                 g_variant_new_fixed_array (G_VARIANT_TYPE_INT32,
+                                                            edges->edges,
+                                                            edges->len * COLS_SIZE_2,
+                                                            sizeof (edges->edges[0])));
+        }
+
+      g_variant_builder_add (&builder, "{sv}", FPI_PRINT_BZ3_EDGES_KEY,
+                             g_variant_builder_end (&edges_builder));
+    }
   g_variant_builder_close (&builder);
 
   /* Insert NBIS print data for type NBIS, otherwise the GVariant directly */
@@ -689,25 +884,19 @@ fp_print_serialize (FpPrint *print,
       g_variant_builder_open (&nested, G_VARIANT_TYPE ("a(aiaiai)"));
       for (i = 0; i < print->prints->len; i++)
         {
-          struct xyt_struct *xyt = g_ptr_array_index (print->prints, i);
+          FpiPrintMinutiae *minutiae = g_ptr_array_index (print->prints, i);
 
           g_variant_builder_open (&nested, G_VARIANT_TYPE ("(aiaiai)"));
 
           g_variant_builder_add_value (&nested,
-                                       g_variant_new_fixed_array (G_VARIANT_TYPE_INT32,
-                                                                  xyt->xcol,
-                                                                  xyt->nrows,
-                                                                  sizeof (xyt->xcol[0])));
+                                       minutiae_column_to_variant (FPI_PRINT_MINUTIAE_X (minutiae),
+                                                                   minutiae->n_minutiae));
           g_variant_builder_add_value (&nested,
-                                       g_variant_new_fixed_array (G_VARIANT_TYPE_INT32,
-                                                                  xyt->ycol,
-                                                                  xyt->nrows,
-                                                                  sizeof (xyt->ycol[0])));
+                                       minutiae_column_to_variant (FPI_PRINT_MINUTIAE_Y (minutiae),
+                                                                   minutiae->n_minutiae));
           g_variant_builder_add_value (&nested,
-                                       g_variant_new_fixed_array (G_VARIANT_TYPE_INT32,
-                                                                  xyt->thetacol,
-                                                                  xyt->nrows,
-                                                                  sizeof (xyt->thetacol[0])));
+                                       minutiae_column_to_variant (FPI_PRINT_MINUTIAE_THETA (minutiae),
+                                                                   minutiae->n_minutiae));
           g_variant_builder_close (&nested);
         }
 
@@ -746,6 +935,116 @@ fp_print_serialize (FpPrint *print,
   return TRUE;
 }
 
+/* The tables are only a cache, so anything that could make the matcher
+ * misbehave is rejected and the tables get computed again on first use. */
+static gboolean
+bz3_edges_valid (const gint32     *edges,
+                 gsize             n_values,
+                 FpiPrintMinutiae *minutiae)
+{
+  gsize i;
+
+  if (n_values % COLS_SIZE_2 != 0 || n_values / COLS_SIZE_2 > FCOLPT_SIZE)
+    return FALSE;
+
+  for (i = 0; i < n_values; i += COLS_SIZE_2)
+    {
+      /* Rows are sorted by distance */
+      if (edges[i] < 0 || (i > 0 && edges[i] < edges[i - COLS_SIZE_2]))
+        return FALSE;
+
+      /* The smaller beta comes first, both are in (-180, 180] */
+      if (edges[i + 1] <= -180 || edges[i + 1] > edges[i + 2] || edges[i + 2] > 180)
+        return FALSE;
+
+      /* Both minutiae indices are 1-based */
+      if (edges[i + 3] < 1 || edges[i + 3] > minutiae->n_minutiae ||
+          edges[i + 4] < 1 || edges[i + 4] > minutiae->n_minutiae)
+        return FALSE;
+
+      /* The edge angle is in [-90, 90], offset by 400 if the betas
+       * were swapped */
+      if (!((edges[i + 5] >= -90 && edges[i + 5] <= 90) ||
+            (edges[i + 5] >= 400 - 90 && edges[i + 5] <= 400 + 90)))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+load_bz3_edges (FpPrint  *print,
+                GVariant *edges_data)
+{
+  g_autoptr(GPtrArray) cache = NULL;
+  guint i;
+
+  if (g_variant_n_children (edges_data) != print->prints->len)
+    goto invalid;
+
+  cache = g_ptr_array_new_full (print->prints->len, g_free);
+  for (i = 0; i < print->prints->len; i++)
+    {
+      FpiPrintMinutiae *minutiae = g_ptr_array_index (print->prints, i);
+      g_autoptr(GVariant) table = NULL;
+      g_autofree gchar *digest = NULL;
+      g_autofree gchar *stored_digest = NULL;
+      FpiPrintBz3Edges *edges;
+      const gint32 *values;
+      gsize n_values;
+
+      /* Tables of other minutiae are dropped and computed again */
+      g_variant_get_child (edges_data, i, "(s@ai)", &stored_digest, &table);
+      digest = minutiae_digest (minutiae);
+      if (!g_str_equal (digest, stored_digest))
+        {
+          fp_dbg ("Ignoring precomputed match data of different minutiae");
+          return;
+        }
+
+      values = g_variant_get_fixed_array (table, &n_values, sizeof (gint32));
+      if (!bz3_edges_valid (values, n_values, minutiae))
+        goto invalid;
+
+      edges = fpi_print_bz3_edges_new (n_values / COLS_SIZE_2);
+      memcpy (edges->edges, values, n_values * sizeof (gint32));
+      fpi_print_bz3_edges_update_signature (edges);
+      g_ptr_array_add (cache, edges);
+    }
+
+  g_clear_pointer (&print->bz3_edges, g_ptr_array_unref);
+  print->bz3_edges = g_steal_pointer (&cache);
+  return;
+
+invalid:
+  g_warning ("Ignoring invalid precomputed match data");
+}
+
+static gboolean
+minutiae_column_from_variant (GVariant *xyt_data,
+                              gsize     index,
+                              gsize     n_values,
+                              gint16   *values)
+{
+  g_autoptr(GVariant) child = g_variant_get_child_value (xyt_data, index);
+  const gint32 *column;
+  gsize len;
+  gsize i;
+
+  column = g_variant_get_fixed_array (child, &len, sizeof (gint32));
+  if (len != n_values)
+    return FALSE;
+
+  for (i = 0; i < n_values; i++)
+    {
+      if (column[i] < G_MININT16 || column[i] > G_MAXINT16)
+        return FALSE;
+      values[i] = column[i];
+    }
+
+  return TRUE;
+}
+
 /**
  * fp_print_deserialize:
  * @data: (array length=length): The binary data
@@ -765,6 +1064,7 @@ fp_print_deserialize (const guchar *data,
   g_autoptr(GVariant) raw_value = NULL;
   g_autoptr(GVariant) value = NULL;
   g_autoptr(GVariant) print_data = NULL;
+  g_autoptr(GVariant) extra = NULL;
   g_autoptr(GDate) date = NULL;
   guchar *aligned_data = NULL;
   guint8 finger_int8;
@@ -815,7 +1115,7 @@ fp_print_deserialize (const guchar *data,
                  &username,
                  &description,
                  &julian_date,
-                 NULL,
+                 &extra,
                  &print_data);
 
   finger = finger_int8;
@@ -824,6 +1124,7 @@ fp_print_deserialize (const guchar *data,
   if (type == FPI_PRINT_NBIS)
     {
       g_autoptr(GVariant) prints = g_variant_get_child_value (print_data, 0);
+      g_autoptr(GVariant) edges_data = NULL;
       guint i;
 
       result = g_object_new (FP_TYPE_PRINT,
@@ -835,40 +1136,32 @@ fp_print_deserialize (const guchar *data,
       fpi_print_set_type (result, FPI_PRINT_NBIS);
       for (i = 0; i < g_variant_n_children (prints); i++)
         {
-          g_autofree struct xyt_struct *xyt = NULL;
-          const gint32 *xcol, *ycol, *thetacol;
-          gsize xlen, ylen, thetalen;
+          g_autofree FpiPrintMinutiae *minutiae = NULL;
           g_autoptr(GVariant) xyt_data = NULL;
-          GVariant *child;
+          g_autoptr(GVariant) child = NULL;
+          gsize len;
 
           xyt_data = g_variant_get_child_value (prints, i);
 
           child = g_variant_get_child_value (xyt_data, 0);
-          xcol = g_variant_get_fixed_array (child, &xlen, sizeof (gint32));
-          g_variant_unref (child);
-
-          child = g_variant_get_child_value (xyt_data, 1);
-          ycol = g_variant_get_fixed_array (child, &ylen, sizeof (gint32));
-          g_variant_unref (child);
+          len = g_variant_n_children (child);
 
-          child = g_variant_get_child_value (xyt_data, 2);
-          thetacol = g_variant_get_fixed_array (child, &thetalen, sizeof (gint32));
-          g_variant_unref (child);
-
-          if (xlen != ylen || xlen != thetalen)
+          if (len > MAX_BOZORTH_MINUTIAE)
             goto invalid_format;
 
-          if (xlen > G_N_ELEMENTS (xyt->xcol))
+          minutiae = fpi_print_minutiae_new (len);
+          if (!minutiae_column_from_variant (xyt_data, 0, len, FPI_PRINT_MINUTIAE_X (minutiae)) ||
+              !minutiae_column_from_variant (xyt_data, 1, len, FPI_PRINT_MINUTIAE_Y (minutiae)) ||
+              !minutiae_column_from_variant (xyt_data, 2, len, FPI_PRINT_MINUTIAE_THETA (minutiae)))
             goto invalid_format;
 
-          xyt = g_new0 (struct xyt_struct, 1);
-          xyt->nrows = xlen;
-          memcpy (xyt->xcol, xcol, sizeof (xcol[0]) * xlen);
-          memcpy (xyt->ycol, ycol, sizeof (xcol[0]) * xlen);
-          memcpy (xyt->thetacol, thetacol, sizeof (xcol[0]) * xlen);
-
-          g_ptr_array_add (result->prints, g_steal_pointer (&xyt));
+          g_ptr_array_add (result->prints, g_steal_pointer (&minutiae));
         }
+
+      edges_data = g_variant_lookup_value (extra, FPI_PRINT_BZ3_EDGES_KEY,
+                                           G_VARIANT_TYPE ("a(sai)"));
+      if (edges_data)
+        load_bz3_edges (result, edges_data);
     }
   else if (type == FPI_PRINT_RAW)
     {
@@ -78,6 +78,18 @@ typedef enum {
   FP_FINGER_STATUS_PRESENT = 1 << 1,
 } FpFingerStatusFlags;
 
+/**
+ * FpPrintSerializeFlags:
+ * @FP_PRINT_SERIALIZE_NONE: Only store the print itself
+ * @FP_PRINT_SERIALIZE_MATCH_DATA: Also store data that was precomputed for
+ *   matching, trading a larger serialized print for faster matching after
+ *   loading it
+ */
+typedef enum {
+  FP_PRINT_SERIALIZE_NONE       = 0,
+  FP_PRINT_SERIALIZE_MATCH_DATA = 1 << 0,
+} FpPrintSerializeFlags;
+
 FpPrint *fp_print_new (FpDevice *device);
 
 const gchar *fp_print_get_driver (FpPrint *print);
@@ -104,11 +116,28 @@ gboolean fp_print_compatible (FpPrint  *self,
 gboolean fp_print_equal (FpPrint *self,
                          FpPrint *other);
 
+gboolean fp_print_match (FpPrint  *self,
+                         FpPrint  *probe,
+                         gint      threshold,
+                         gboolean *match,
+                         GError  **error);
+gboolean fp_print_match_gallery (FpPrint   *probe,
+                                 GPtrArray *gallery,
+                                 gint       threshold,
+                                 FpPrint  **match,
+                                 GError   **error);
+
 gboolean fp_print_serialize (FpPrint *print,
                              guchar **data,
                              gsize   *length,
                              GError **error);
 
+gboolean fp_print_serialize_full (FpPrint              *print,
+                                  FpPrintSerializeFlags flags,
+                                  guchar              **data,
+                                  gsize                *length,
+                                  GError              **error);
+
 FpPrint *fp_print_deserialize (const guchar *data,
                                gsize         length,
                                GError      **error);
@@ -26,6 +26,12 @@
 
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include "fpi-assembling.h"
 
 /**
@@ -39,15 +45,60 @@
  * data in small stripes.
  */
 
+/* Sum of absolute differences between two rows of pixels */
+static inline unsigned int
+calc_row_error (const guint8 *row1,
+                const guint8 *row2,
+                unsigned int  width)
+{
+  unsigned int err = 0;
+  unsigned int i = 0;
+
+#if defined(__SSE2__)
+  __m128i acc = _mm_setzero_si128 ();
+
+  for (; i + 16 <= width; i += 16)
+    acc = _mm_add_epi64 (acc,
+                         _mm_sad_epu8 (_mm_loadu_si128 ((const __m128i *) (row1 + i)),
+                                       _mm_loadu_si128 ((const __m128i *) (row2 + i))));
+  err = _mm_cvtsi128_si32 (acc) + _mm_cvtsi128_si32 (_mm_unpackhi_epi64 (acc, acc));
+#elif defined(__ARM_NEON)
+  uint32x4_t acc = vdupq_n_u32 (0);
+  uint64x2_t sum;
+
+  for (; i + 16 <= width; i += 16)
+    {
+      uint16x8_t diff;
+
+      diff = vabdl_u8 (vld1_u8 (row1 + i), vld1_u8 (row2 + i));
+      diff = vabal_u8 (diff, vld1_u8 (row1 + i + 8), vld1_u8 (row2 + i + 8));
+      acc = vpadalq_u16 (acc, diff);
+    }
+  sum = vpaddlq_u32 (acc);
+  err = vgetq_lane_u64 (sum, 0) + vgetq_lane_u64 (sum, 1);
+#endif
+
+  for (; i < width; i++)
+    err += row1[i] > row2[i] ? row1[i] - row2[i] : row2[i] - row1[i];
+
+  return err;
+}
+
+/* Returns the normalized error of the overlapping area of two frames, or
+ * max_error if it is known to be at least max_error. */
 static unsigned int
 calc_error (struct fpi_frame_asmbl_ctx *ctx,
-            struct fpi_frame           *first_frame,
-            struct fpi_frame           *second_frame,
+            const guint8               *first_frame,
+            const guint8               *second_frame,
+            unsigned int                stride,
             int                         dx,
-            int                         dy)
+            int                         dy,
+            unsigned int                max_error)
 {
   unsigned int width, height;
-  unsigned int x1, y1, x2, y2, err, i, j;
+  unsigned int area, err, i;
+  const guint8 *row1, *row2;
+  gboolean can_stop;
 
   width = ctx->frame_width - (dx > 0 ? dx : -dx);
   height = ctx->frame_height - dy;
@@ -55,38 +106,24 @@ calc_error (struct fpi_frame_asmbl_ctx *ctx,
   if (height == 0 || width == 0)
     return INT_MAX;
 
-  y1 = 0;
-  y2 = dy;
-  i = 0;
-  err = 0;
-  do
-    {
-      x1 = dx < 0 ? 0 : dx;
-      x2 = dx < 0 ? -dx : 0;
-      j = 0;
-
-      do
-        {
-          unsigned char v1, v2;
+  area = ctx->frame_height * ctx->frame_width;
 
+  /* Stopping early is only possible if normalizing cannot overflow */
+  can_stop = (guint64) 255 * width * height * area <= G_MAXUINT;
 
-          v1 = ctx->get_pixel (ctx, first_frame, x1, y1);
-          v2 = ctx->get_pixel (ctx, second_frame, x2, y2);
-          err += v1 > v2 ? v1 - v2 : v2 - v1;
-          j++;
-          x1++;
-          x2++;
+  row1 = first_frame + (dx < 0 ? 0 : dx);
+  row2 = second_frame + dy * stride + (dx < 0 ? -dx : 0);
+  err = 0;
+  for (i = 0; i < height; i++, row1 += stride, row2 += stride)
+    {
+      err += calc_row_error (row1, row2, width);
 
-        }
-      while (j < width);
-      i++;
-      y1++;
-      y2++;
+      if (can_stop && err * area / (height * width) >= max_error)
+        return max_error;
     }
-  while (i < height);
 
   /* Normalize error */
-  err *= (ctx->frame_height * ctx->frame_width);
+  err *= area;
   err /= (height * width);
 
   return err;
@@ -97,8 +134,9 @@ calc_error (struct fpi_frame_asmbl_ctx *ctx,
  */
 static void
 find_overlap (struct fpi_frame_asmbl_ctx *ctx,
-              struct fpi_frame           *first_frame,
-              struct fpi_frame           *second_frame,
+              const guint8               *first_frame,
+              const guint8               *second_frame,
+              unsigned int                stride,
               int                        *dx_out,
               int                        *dy_out,
               unsigned int               *min_error)
@@ -117,8 +155,8 @@ find_overlap (struct fpi_frame_asmbl_ctx *ctx,
     {
       for (dx = -8; dx < 8; dx++)
         {
-          err = calc_error (ctx, first_frame, second_frame,
-                            dx, dy);
+          err = calc_error (ctx, first_frame, second_frame, stride,
+                            dx, dy, *min_error);
           if (err < *min_error)
             {
               *min_error = err;
@@ -129,54 +167,303 @@ find_overlap (struct fpi_frame_asmbl_ctx *ctx,
     }
 }
 
-static unsigned int
+/* Offsets found in the coarse search which are refined, and how far
+ * around them the refinement searches at full resolution. */
+#define PYRAMID_CANDIDATES 3
+#define PYRAMID_MARGIN 2
+
+/* Same as find_overlap(), but searches all offsets on frames downscaled by
+ * half, and then only refines the best matches at full resolution. */
+static void
+find_overlap_pyramid (struct fpi_frame_asmbl_ctx *ctx,
+                      const guint8               *first_frame,
+                      const guint8               *second_frame,
+                      unsigned int                stride,
+                      const guint8               *first_coarse,
+                      const guint8               *second_coarse,
+                      int                        *dx_out,
+                      int                        *dy_out,
+                      unsigned int               *min_error)
+{
+  struct fpi_frame_asmbl_ctx coarse_ctx = { 0, };
+  unsigned int best_err[PYRAMID_CANDIDATES];
+  int best_dx[PYRAMID_CANDIDATES];
+  int best_dy[PYRAMID_CANDIDATES];
+  int dx, dy, i;
+  unsigned int err;
+
+  coarse_ctx.frame_width = ctx->frame_width / 2;
+  coarse_ctx.frame_height = ctx->frame_height / 2;
+
+  for (i = 0; i < PYRAMID_CANDIDATES; i++)
+    best_err[i] = G_MAXUINT;
+
+  /* Keep the best offsets of the coarse search, sorted by error */
+  for (dy = 1; dy < coarse_ctx.frame_height; dy++)
+    {
+      for (dx = -4; dx < 4; dx++)
+        {
+          err = calc_error (&coarse_ctx, first_coarse, second_coarse,
+                            coarse_ctx.frame_width, dx, dy,
+                            best_err[PYRAMID_CANDIDATES - 1]);
+          if (err >= best_err[PYRAMID_CANDIDATES - 1])
+            continue;
+
+          for (i = PYRAMID_CANDIDATES - 1; i > 0 && best_err[i - 1] > err; i--)
+            {
+              best_err[i] = best_err[i - 1];
+              best_dx[i] = best_dx[i - 1];
+              best_dy[i] = best_dy[i - 1];
+            }
+          best_err[i] = err;
+          best_dx[i] = dx;
+          best_dy[i] = dy;
+        }
+    }
+
+  *min_error = 255 * ctx->frame_height * ctx->frame_width;
+
+  for (i = 0; i < PYRAMID_CANDIDATES && best_err[i] != G_MAXUINT; i++)
+    {
+      int dy_start = MAX (2, best_dy[i] * 2 - PYRAMID_MARGIN);
+      int dy_end = MIN ((int) ctx->frame_height - 1, best_dy[i] * 2 + PYRAMID_MARGIN);
+      int dx_start = MAX (-8, best_dx[i] * 2 - PYRAMID_MARGIN);
+      int dx_end = MIN (7, best_dx[i] * 2 + PYRAMID_MARGIN);
+
+      for (dy = dy_start; dy <= dy_end; dy++)
+        {
+          for (dx = dx_start; dx <= dx_end; dx++)
+            {
+              err = calc_error (ctx, first_frame, second_frame, stride,
+                                dx, dy, *min_error);
+              if (err < *min_error)
+                {
+                  *min_error = err;
+                  *dx_out = -dx;
+                  *dy_out = dy;
+                }
+            }
+        }
+    }
+}
+
+/* Copies the pixels of a frame as frame_height rows of frame_width pixels */
+static void
+copy_frame_pixels (struct fpi_frame_asmbl_ctx *ctx,
+                   struct fpi_frame           *frame,
+                   guint8                     *data)
+{
+  unsigned int x, y;
+
+  if (!ctx->get_pixel)
+    {
+      unsigned int stride = ctx->frame_stride ? ctx->frame_stride : ctx->frame_width;
+
+      for (y = 0; y < ctx->frame_height; y++)
+        memcpy (data + y * ctx->frame_width, frame->data + y * stride, ctx->frame_width);
+      return;
+    }
+
+  for (y = 0; y < ctx->frame_height; y++)
+    for (x = 0; x < ctx->frame_width; x++)
+      data[x + y * ctx->frame_width] = ctx->get_pixel (ctx, frame, x, y);
+}
+
+/* Returns the 8 bit pixels of every frame. If the driver provides a
+ * get_pixel function, the frames are converted into @buffer. */
+static const guint8 **
+get_frame_pixels (struct fpi_frame_asmbl_ctx *ctx,
+                  GSList                     *stripes,
+                  guint8                    **buffer,
+                  unsigned int               *stride)
+{
+  const guint8 **pixels;
+  GSList *l;
+  guint i;
+
+  pixels = g_new (const guint8 *, g_slist_length (stripes));
+  *buffer = NULL;
+
+  if (!ctx->get_pixel)
+    {
+      *stride = ctx->frame_stride ? ctx->frame_stride : ctx->frame_width;
+      for (l = stripes, i = 0; l != NULL; l = l->next, i++)
+        pixels[i] = ((struct fpi_frame *) l->data)->data;
+
+      return pixels;
+    }
+
+  *stride = ctx->frame_width;
+  *buffer = g_malloc (g_slist_length (stripes) * ctx->frame_height * ctx->frame_width);
+  for (l = stripes, i = 0; l != NULL; l = l->next, i++)
+    {
+      guint8 *data = *buffer + i * ctx->frame_height * ctx->frame_width;
+
+      copy_frame_pixels (ctx, l->data, data);
+      pixels[i] = data;
+    }
+
+  return pixels;
+}
+
+/* Frames need to be tall and wide enough to search them downscaled */
+static gboolean
+use_pyramid_search (struct fpi_frame_asmbl_ctx *ctx)
+{
+  return ctx->search == FPI_FRAME_ASMBL_SEARCH_PYRAMID &&
+         ctx->frame_height >= 8 && ctx->frame_width >= 16;
+}
+
+/* Downscales a frame by half, averaging blocks of 2x2 pixels */
+static void
+downscale_frame (struct fpi_frame_asmbl_ctx *ctx,
+                 const guint8               *pixels,
+                 unsigned int                stride,
+                 guint8                     *data)
+{
+  unsigned int width = ctx->frame_width / 2;
+  unsigned int height = ctx->frame_height / 2;
+  unsigned int x, y;
+
+  for (y = 0; y < height; y++)
+    {
+      const guint8 *row1 = pixels + 2 * y * stride;
+      const guint8 *row2 = row1 + stride;
+
+      for (x = 0; x < width; x++)
+        data[x + y * width] = (row1[2 * x] + row1[2 * x + 1] +
+                               row2[2 * x] + row2[2 * x + 1] + 2) / 4;
+    }
+}
+
+/* Returns every frame downscaled by half */
+static guint8 *
+get_coarse_pixels (struct fpi_frame_asmbl_ctx *ctx,
+                   const guint8              **pixels,
+                   unsigned int                stride,
+                   guint                       num_frames)
+{
+  unsigned int coarse_size = (ctx->frame_width / 2) * (ctx->frame_height / 2);
+  guint8 *buffer;
+  guint i;
+
+  buffer = g_malloc (num_frames * coarse_size);
+  for (i = 0; i < num_frames; i++)
+    downscale_frame (ctx, pixels[i], stride, buffer + i * coarse_size);
+
+  return buffer;
+}
+
+/* Estimates the movement from one frame to the next, both assuming the
+ * finger moves forward and backward. The coarse frames are only needed
+ * for the pyramid search. */
+static void
+estimate_movement (struct fpi_frame_asmbl_ctx *ctx,
+                   const guint8               *prev_pixels,
+                   const guint8               *cur_pixels,
+                   unsigned int                stride,
+                   const guint8               *prev_coarse,
+                   const guint8               *cur_coarse,
+                   int                        *delta,
+                   int                        *rev_delta,
+                   unsigned long long         *total_error,
+                   unsigned long long         *total_rev_error)
+{
+  unsigned int min_error;
+
+  if (prev_coarse)
+    {
+      find_overlap_pyramid (ctx, cur_pixels, prev_pixels, stride,
+                            cur_coarse, prev_coarse,
+                            &delta[0], &delta[1], &min_error);
+      *total_error += min_error;
+
+      find_overlap_pyramid (ctx, prev_pixels, cur_pixels, stride,
+                            prev_coarse, cur_coarse,
+                            &rev_delta[0], &rev_delta[1], &min_error);
+      *total_rev_error += min_error;
+    }
+  else
+    {
+      find_overlap (ctx, cur_pixels, prev_pixels, stride,
+                    &delta[0], &delta[1], &min_error);
+      *total_error += min_error;
+
+      find_overlap (ctx, prev_pixels, cur_pixels, stride,
+                    &rev_delta[0], &rev_delta[1], &min_error);
+      *total_rev_error += min_error;
+    }
+}
+
+/* Whether the finger moved backward, i.e. the deltas estimated for that
+ * direction have the lower average error. */
+static gboolean
+use_reverse_deltas (unsigned long long total_error,
+                    unsigned long long total_rev_error,
+                    guint              num_frames)
+{
+  int err, rev_err;
+
+  err = total_error / num_frames;
+  rev_err = total_rev_error / num_frames;
+  fp_dbg ("errors: %d rev: %d", err, rev_err);
+
+  return err >= rev_err;
+}
+
+/* Estimates the movement between adjacent frames in both directions at
+ * once, and keeps the deltas of the direction with the lower error. */
+static void
 do_movement_estimation (struct fpi_frame_asmbl_ctx *ctx,
-                        GSList *stripes, gboolean reverse)
+                        GSList *stripes, const guint8 **pixels,
+                        unsigned int stride, const guint8 *coarse)
 {
+  unsigned int coarse_size = (ctx->frame_width / 2) * (ctx->frame_height / 2);
+  g_autofree int *deltas = NULL;
   GSList *l;
   GTimer *timer;
   guint num_frames = 1;
-  struct fpi_frame *prev_stripe;
-  unsigned int min_error;
+  gboolean reverse;
   /* Max error is width * height * 255, for AES2501 which has the largest
    * sensor its 192*16*255 = 783360. So for 32bit value it's ~5482 frame before
    * we might get int overflow. Use 64bit value here to prevent integer overflow
    */
   unsigned long long total_error = 0;
+  unsigned long long total_rev_error = 0;
 
   timer = g_timer_new ();
 
-  /* Skip the first frame */
-  prev_stripe = stripes->data;
+  deltas = g_new0 (int, 4 * g_slist_length (stripes));
 
+  /* Skip the first frame */
   for (l = stripes->next; l != NULL; l = l->next, num_frames++)
     {
       struct fpi_frame *cur_stripe = l->data;
+      int *delta = &deltas[4 * num_frames];
 
-      if (reverse)
-        {
-          find_overlap (ctx, prev_stripe, cur_stripe,
-                        &cur_stripe->delta_x, &cur_stripe->delta_y,
-                        &min_error);
-          cur_stripe->delta_y = -cur_stripe->delta_y;
-          cur_stripe->delta_x = -cur_stripe->delta_x;
-        }
-      else
-        {
-          find_overlap (ctx, cur_stripe, prev_stripe,
-                        &cur_stripe->delta_x, &cur_stripe->delta_y,
-                        &min_error);
-        }
-      total_error += min_error;
+      delta[0] = cur_stripe->delta_x;
+      delta[1] = cur_stripe->delta_y;
+      estimate_movement (ctx, pixels[num_frames - 1], pixels[num_frames], stride,
+                         coarse ? coarse + (num_frames - 1) * coarse_size : NULL,
+                         coarse ? coarse + num_frames * coarse_size : NULL,
+                         &delta[0], &delta[2], &total_error, &total_rev_error);
+    }
+
+  reverse = use_reverse_deltas (total_error, total_rev_error, num_frames);
+
+  num_frames = 1;
+  for (l = stripes->next; l != NULL; l = l->next, num_frames++)
+    {
+      struct fpi_frame *cur_stripe = l->data;
+      int *delta = &deltas[4 * num_frames];
 
-      prev_stripe = cur_stripe;
+      cur_stripe->delta_x = reverse ? -delta[2] : delta[0];
+      cur_stripe->delta_y = reverse ? -delta[3] : delta[1];
     }
 
   g_timer_stop (timer);
   fp_dbg ("calc delta completed in %f secs", g_timer_elapsed (timer, NULL));
   g_timer_destroy (timer);
-
-  return total_error / num_frames;
 }
 
 /**
@@ -190,18 +477,25 @@ do_movement_estimation (struct fpi_frame_asmbl_ctx *ctx,
  * This function is used for devices that don't do movement estimation
  * in hardware. If hardware movement estimation is supported, the driver
  * should populate @delta_x and @delta_y instead.
+ *
+ * The offsets between frames are searched using the @search strategy of
+ * @ctx.
  */
 void
 fpi_do_movement_estimation (struct fpi_frame_asmbl_ctx *ctx,
                             GSList                     *stripes)
 {
-  int err, rev_err;
+  g_autofree guint8 *buffer = NULL;
+  g_autofree guint8 *coarse = NULL;
+  g_autofree const guint8 **pixels = NULL;
+  unsigned int stride;
 
-  err = do_movement_estimation (ctx, stripes, FALSE);
-  rev_err = do_movement_estimation (ctx, stripes, TRUE);
-  fp_dbg ("errors: %d rev: %d", err, rev_err);
-  if (err < rev_err)
-    do_movement_estimation (ctx, stripes, FALSE);
+  pixels = get_frame_pixels (ctx, stripes, &buffer, &stride);
+
+  if (use_pyramid_search (ctx))
+    coarse = get_coarse_pixels (ctx, pixels, stride, g_slist_length (stripes));
+
+  do_movement_estimation (ctx, stripes, pixels, stride, coarse);
 }
 
 static inline void
@@ -237,42 +531,43 @@ aes_blit_stripe (struct fpi_frame_asmbl_ctx *ctx,
       fy1 = 0;
     }
 
+  if (!ctx->get_pixel)
+    {
+      unsigned int stride = ctx->frame_stride ? ctx->frame_stride : ctx->frame_width;
+
+      if (fx1 >= ctx->frame_width || ix1 >= img->width)
+        return;
+
+      for (fy = fy1, iy = iy1; fy < ctx->frame_height && iy < img->height; fy++, iy++)
+        memcpy (img->data + ix1 + (iy * img->width), stripe->data + fx1 + (fy * stride),
+                MIN (ctx->frame_width - fx1, img->width - ix1));
+      return;
+    }
+
   for (fy = fy1, iy = iy1; fy < ctx->frame_height && iy < img->height; fy++, iy++)
     for (fx = fx1, ix = ix1; fx < ctx->frame_width && ix < img->width; fx++, ix++)
       img->data[ix + (iy * img->width)] = ctx->get_pixel (ctx, stripe, fx, fy);
 }
 
-/**
- * fpi_assemble_frames:
- * @ctx: #fpi_frame_asmbl_ctx - frame assembling context
- * @stripes: linked list of #fpi_frame
- *
- * fpi_assemble_frames() assembles individual frames into a single image.
- * It expects @delta_x and @delta_y of #fpi_frame to be populated.
- *
- * Returns: a newly allocated #fp_img.
- */
-FpImage *
-fpi_assemble_frames (struct fpi_frame_asmbl_ctx *ctx,
-                     GSList                     *stripes)
+static FpImage *
+assemble_frames (struct fpi_frame_asmbl_ctx *ctx,
+                 struct fpi_frame          **frames,
+                 guint                       num_frames)
 {
-  GSList *l;
   FpImage *img;
   int height = 0;
   int y, x;
   gboolean reverse = FALSE;
   struct fpi_frame *fpi_frame;
-
-  //FIXME g_return_if_fail
-  g_return_val_if_fail (stripes != NULL, NULL);
+  guint i;
 
   /* No offset for 1st image */
-  fpi_frame = stripes->data;
+  fpi_frame = frames[0];
   fpi_frame->delta_x = 0;
   fpi_frame->delta_y = 0;
-  for (l = stripes; l != NULL; l = l->next)
+  for (i = 0; i < num_frames; i++)
     {
-      fpi_frame = l->data;
+      fpi_frame = frames[i];
 
       height += fpi_frame->delta_y;
     }
@@ -299,9 +594,9 @@ fpi_assemble_frames (struct fpi_frame_asmbl_ctx *ctx,
   y = reverse ? (height - ctx->frame_height) : 0;
   x = ((int) ctx->image_width - (int) ctx->frame_width) / 2;
 
-  for (l = stripes; l != NULL; l = l->next)
+  for (i = 0; i < num_frames; i++)
     {
-      fpi_frame = l->data;
+      fpi_frame = frames[i];
 
       y += fpi_frame->delta_y;
       x += fpi_frame->delta_x;
@@ -312,6 +607,426 @@ fpi_assemble_frames (struct fpi_frame_asmbl_ctx *ctx,
   return img;
 }
 
+/**
+ * fpi_assemble_frames:
+ * @ctx: #fpi_frame_asmbl_ctx - frame assembling context
+ * @stripes: linked list of #fpi_frame
+ *
+ * fpi_assemble_frames() assembles individual frames into a single image.
+ * It expects @delta_x and @delta_y of #fpi_frame to be populated.
+ *
+ * Returns: a newly allocated #fp_img.
+ */
+FpImage *
+fpi_assemble_frames (struct fpi_frame_asmbl_ctx *ctx,
+                     GSList                     *stripes)
+{
+  g_autofree struct fpi_frame **frames = NULL;
+  GSList *l;
+  guint i;
+
+  //FIXME g_return_if_fail
+  g_return_val_if_fail (stripes != NULL, NULL);
+
+  frames = g_new (struct fpi_frame *, g_slist_length (stripes));
+  for (l = stripes, i = 0; l != NULL; l = l->next, i++)
+    frames[i] = l->data;
+
+  return assemble_frames (ctx, frames, i);
+}
+
+/* Size of a frame in a #FpiFrameStore, keeping every frame aligned */
+#define FRAME_STORE_SLOT_SIZE(frame_size) \
+  ((sizeof (struct fpi_frame) + (frame_size) + 7) & ~(gsize) 7)
+
+struct _FpiFrameStore
+{
+  guint8 *buffer;
+  gsize   slot_size;
+  guint   capacity;
+  /* Index of the oldest frame, and number of frames stored */
+  guint   first;
+  guint   n_frames;
+};
+
+/**
+ * fpi_frame_store_new:
+ * @frame_size: size of the data of every frame, in bytes
+ * @capacity: maximum number of frames in the store
+ *
+ * Creates a store holding up to @capacity frames in a single buffer,
+ * which is allocated once. The store is meant to be created when the
+ * device is opened and cleared for every capture, so that capturing
+ * frames does not allocate memory.
+ *
+ * Frames are written in place: the driver fills the frame returned by
+ * fpi_frame_store_get_next(), e.g. by reading a transfer into its data,
+ * and then adds it using fpi_frame_store_append(). Once the store is full,
+ * every new frame replaces the oldest one.
+ *
+ * Returns: a new #FpiFrameStore
+ */
+FpiFrameStore *
+fpi_frame_store_new (gsize frame_size,
+                     guint capacity)
+{
+  FpiFrameStore *self;
+
+  g_return_val_if_fail (capacity > 0, NULL);
+
+  self = g_new0 (FpiFrameStore, 1);
+  self->slot_size = FRAME_STORE_SLOT_SIZE (frame_size);
+  self->capacity = capacity;
+  self->buffer = g_malloc0 (self->slot_size * capacity);
+
+  return self;
+}
+
+/**
+ * fpi_frame_store_get_next:
+ * @self: a #FpiFrameStore
+ *
+ * Returns the frame which is added by the next fpi_frame_store_append()
+ * call. If the store is full, this is the storage of the oldest frame,
+ * which stays in the store until then.
+ *
+ * Returns: (transfer none): the next #fpi_frame to fill
+ */
+struct fpi_frame *
+fpi_frame_store_get_next (FpiFrameStore *self)
+{
+  guint index = (self->first + self->n_frames) % self->capacity;
+
+  return (struct fpi_frame *) (self->buffer + index * self->slot_size);
+}
+
+/**
+ * fpi_frame_store_append:
+ * @self: a #FpiFrameStore
+ *
+ * Adds the frame returned by fpi_frame_store_get_next() as the newest
+ * frame, dropping the oldest one if the store is full.
+ *
+ * Returns: (transfer none): the added #fpi_frame
+ */
+struct fpi_frame *
+fpi_frame_store_append (FpiFrameStore *self)
+{
+  struct fpi_frame *frame = fpi_frame_store_get_next (self);
+
+  if (self->n_frames < self->capacity)
+    self->n_frames++;
+  else
+    self->first = (self->first + 1) % self->capacity;
+
+  return frame;
+}
+
+/**
+ * fpi_frame_store_get_n_frames:
+ * @self: a #FpiFrameStore
+ *
+ * Returns: the number of frames in the store
+ */
+guint
+fpi_frame_store_get_n_frames (FpiFrameStore *self)
+{
+  return self->n_frames;
+}
+
+/**
+ * fpi_frame_store_get_frame:
+ * @self: a #FpiFrameStore
+ * @index: index of the frame, 0 being the oldest one
+ *
+ * Returns: (transfer none): the #fpi_frame at @index
+ */
+struct fpi_frame *
+fpi_frame_store_get_frame (FpiFrameStore *self,
+                           guint          index)
+{
+  g_return_val_if_fail (index < self->n_frames, NULL);
+
+  index = (self->first + index) % self->capacity;
+
+  return (struct fpi_frame *) (self->buffer + index * self->slot_size);
+}
+
+/**
+ * fpi_frame_store_clear:
+ * @self: a #FpiFrameStore
+ *
+ * Removes all frames from the store, keeping its buffer for the next
+ * capture.
+ */
+void
+fpi_frame_store_clear (FpiFrameStore *self)
+{
+  self->first = 0;
+  self->n_frames = 0;
+}
+
+/**
+ * fpi_frame_store_free:
+ * @self: a #FpiFrameStore
+ *
+ * Frees the store and all its frames.
+ */
+void
+fpi_frame_store_free (FpiFrameStore *self)
+{
+  if (!self)
+    return;
+
+  g_free (self->buffer);
+  g_free (self);
+}
+
+struct _FpiFrameAssembler
+{
+  struct fpi_frame_asmbl_ctx *ctx;
+  /* Same as ctx, but for the 8 bit frames stored in the assembler */
+  struct fpi_frame_asmbl_ctx  pixels_ctx;
+  gboolean                    reverse;
+  guint                       max_frames;
+  /* One more frame than needed, to always have room for the next one */
+  FpiFrameStore              *frames;
+  /* dx, dy, reverse dx and reverse dy of every frame */
+  int                        *deltas;
+  /* Frames in assembling order, filled by fpi_frame_assembler_finish() */
+  struct fpi_frame          **order;
+  unsigned long long          total_error;
+  unsigned long long          total_rev_error;
+  guint8                     *last_coarse;
+  guint8                     *cur_coarse;
+};
+
+/**
+ * fpi_frame_assembler_new:
+ * @ctx: #fpi_frame_asmbl_ctx - frame assembling context
+ * @reverse: whether frames are assembled in the opposite order of
+ *   fpi_frame_assembler_add_frame() calls
+ * @max_frames: maximum number of frames of a capture
+ *
+ * Creates an assembler which estimates the movement between frames while
+ * they are captured, so that the image is ready as soon as the finger is
+ * removed. This gives the same result as calling
+ * fpi_do_movement_estimation() and fpi_assemble_frames() on the list of
+ * all frames, ordered oldest first, or newest first if @reverse is set.
+ *
+ * All memory is allocated here, so the assembler should be kept and reset
+ * using fpi_frame_assembler_reset() for every capture.
+ *
+ * @ctx must stay valid for the lifetime of the assembler.
+ *
+ * Returns: a new #FpiFrameAssembler
+ */
+FpiFrameAssembler *
+fpi_frame_assembler_new (struct fpi_frame_asmbl_ctx *ctx,
+                         gboolean                    reverse,
+                         guint                       max_frames)
+{
+  FpiFrameAssembler *self;
+
+  g_return_val_if_fail (ctx != NULL, NULL);
+  g_return_val_if_fail (max_frames > 0, NULL);
+
+  self = g_new0 (FpiFrameAssembler, 1);
+  self->ctx = ctx;
+  self->pixels_ctx = *ctx;
+  self->pixels_ctx.get_pixel = NULL;
+  self->pixels_ctx.frame_stride = 0;
+  self->reverse = reverse;
+  self->max_frames = max_frames;
+  self->frames = fpi_frame_store_new (ctx->frame_width * ctx->frame_height, max_frames + 1);
+  self->deltas = g_new0 (int, 4 * max_frames);
+  self->order = g_new (struct fpi_frame *, max_frames);
+
+  if (use_pyramid_search (ctx))
+    {
+      unsigned int coarse_size = (ctx->frame_width / 2) * (ctx->frame_height / 2);
+
+      self->last_coarse = g_malloc (coarse_size);
+      self->cur_coarse = g_malloc (coarse_size);
+    }
+
+  return self;
+}
+
+/**
+ * fpi_frame_assembler_reset:
+ * @self: a #FpiFrameAssembler
+ *
+ * Removes all frames from the assembler to start a new capture.
+ */
+void
+fpi_frame_assembler_reset (FpiFrameAssembler *self)
+{
+  fpi_frame_store_clear (self->frames);
+  self->total_error = 0;
+  self->total_rev_error = 0;
+}
+
+/**
+ * fpi_frame_assembler_get_next_frame:
+ * @self: a #FpiFrameAssembler
+ *
+ * Returns the storage of the next frame, as @frame_height rows of
+ * @frame_width 8 bit pixels. Drivers can write the frame there and pass it
+ * to fpi_frame_assembler_add_frame() to avoid copying it.
+ *
+ * Returns: (transfer none): the next #fpi_frame to fill
+ */
+struct fpi_frame *
+fpi_frame_assembler_get_next_frame (FpiFrameAssembler *self)
+{
+  return fpi_frame_store_get_next (self->frames);
+}
+
+/**
+ * fpi_frame_assembler_add_frame:
+ * @self: a #FpiFrameAssembler
+ * @frame: the newly captured #fpi_frame
+ *
+ * Adds a frame to the assembler and estimates its movement relative to the
+ * previously added frame. The frame is copied, unless it was returned by
+ * fpi_frame_assembler_get_next_frame(), so the caller keeps ownership of
+ * @frame.
+ *
+ * Frames beyond the @max_frames of the assembler are ignored.
+ */
+void
+fpi_frame_assembler_add_frame (FpiFrameAssembler *self,
+                               struct fpi_frame  *frame)
+{
+  struct fpi_frame_asmbl_ctx *ctx = self->ctx;
+  struct fpi_frame *next;
+  int *delta;
+  guint n;
+
+  n = fpi_frame_store_get_n_frames (self->frames);
+  if (n == self->max_frames)
+    {
+      fp_warn ("Too many frames, ignoring frame");
+      return;
+    }
+
+  next = fpi_frame_store_get_next (self->frames);
+  if (frame != next)
+    {
+      next->delta_x = frame->delta_x;
+      next->delta_y = frame->delta_y;
+      copy_frame_pixels (ctx, frame, next->data);
+    }
+  fpi_frame_store_append (self->frames);
+  memset (&self->deltas[4 * n], 0, 4 * sizeof (int));
+
+  if (self->cur_coarse)
+    downscale_frame (ctx, next->data, ctx->frame_width, self->cur_coarse);
+
+  if (n > 0)
+    {
+      struct fpi_frame *last = fpi_frame_store_get_frame (self->frames, n - 1);
+
+      /* The deltas are stored on the later frame in assembling order */
+      if (!self->reverse)
+        {
+          delta = &self->deltas[4 * n];
+          estimate_movement (ctx, last->data, next->data, ctx->frame_width,
+                             self->last_coarse, self->cur_coarse,
+                             &delta[0], &delta[2],
+                             &self->total_error, &self->total_rev_error);
+        }
+      else
+        {
+          delta = &self->deltas[4 * (n - 1)];
+          estimate_movement (ctx, next->data, last->data, ctx->frame_width,
+                             self->cur_coarse, self->last_coarse,
+                             &delta[0], &delta[2],
+                             &self->total_error, &self->total_rev_error);
+        }
+    }
+
+  if (self->cur_coarse)
+    {
+      guint8 *tmp = self->last_coarse;
+
+      self->last_coarse = self->cur_coarse;
+      self->cur_coarse = tmp;
+    }
+}
+
+/**
+ * fpi_frame_assembler_get_n_frames:
+ * @self: a #FpiFrameAssembler
+ *
+ * Returns: the number of frames added to the assembler
+ */
+guint
+fpi_frame_assembler_get_n_frames (FpiFrameAssembler *self)
+{
+  return fpi_frame_store_get_n_frames (self->frames);
+}
+
+/**
+ * fpi_frame_assembler_finish:
+ * @self: a #FpiFrameAssembler
+ *
+ * Picks the swipe direction using the movement estimated so far and
+ * assembles all frames into a single image. More frames may still be added
+ * afterwards.
+ *
+ * Returns: a newly allocated #FpImage, or %NULL if no frames were added
+ */
+FpImage *
+fpi_frame_assembler_finish (FpiFrameAssembler *self)
+{
+  guint num_frames = fpi_frame_store_get_n_frames (self->frames);
+  gboolean reverse;
+  guint i;
+
+  g_return_val_if_fail (num_frames > 0, NULL);
+
+  reverse = use_reverse_deltas (self->total_error, self->total_rev_error,
+                                num_frames);
+
+  for (i = 0; i < num_frames; i++)
+    {
+      struct fpi_frame *frame = fpi_frame_store_get_frame (self->frames, i);
+      int *delta = &self->deltas[4 * i];
+
+      frame->delta_x = reverse ? -delta[2] : delta[0];
+      frame->delta_y = reverse ? -delta[3] : delta[1];
+
+      if (self->reverse)
+        self->order[num_frames - 1 - i] = frame;
+      else
+        self->order[i] = frame;
+    }
+
+  return assemble_frames (&self->pixels_ctx, self->order, num_frames);
+}
+
+/**
+ * fpi_frame_assembler_free:
+ * @self: a #FpiFrameAssembler
+ *
+ * Frees the assembler and all frames added to it.
+ */
+void
+fpi_frame_assembler_free (FpiFrameAssembler *self)
+{
+  if (!self)
+    return;
+
+  fpi_frame_store_free (self->frames);
+  g_free (self->deltas);
+  g_free (self->order);
+  g_free (self->last_coarse);
+  g_free (self->cur_coarse);
+  g_free (self);
+}
+
 static int
 cmpint (const void *p1, const void *p2, gpointer data)
 {
@@ -38,12 +38,30 @@ struct fpi_frame
   unsigned char data[0];
 };
 
+/**
+ * FpiFrameAsmblSearch:
+ * @FPI_FRAME_ASMBL_SEARCH_EXHAUSTIVE: compare frames at every possible offset
+ * @FPI_FRAME_ASMBL_SEARCH_PYRAMID: compare frames downscaled by half at every
+ *   possible offset first, then refine the best matches at full resolution
+ *
+ * Strategy used by fpi_do_movement_estimation() to find the offset between
+ * two frames. The pyramid search is a lot faster for tall frames, but may
+ * pick a different offset if the frames have little structure.
+ */
+typedef enum {
+  FPI_FRAME_ASMBL_SEARCH_EXHAUSTIVE,
+  FPI_FRAME_ASMBL_SEARCH_PYRAMID,
+} FpiFrameAsmblSearch;
+
 /**
  * fpi_frame_asmbl_ctx:
  * @frame_width: width of the frame
  * @frame_height: height of the frame
  * @image_width: resulting image width
  * @get_pixel: pixel accessor, returns pixel brightness at x,y of frame
+ * @frame_stride: distance in bytes between the rows of a frame if
+ *                @get_pixel is %NULL, 0 means rows are @frame_width apart
+ * @search: the #FpiFrameAsmblSearch strategy for movement estimation
  *
  * #fpi_frame_asmbl_ctx is a structure holding the context for frame
  * assembling routines.
@@ -51,16 +69,23 @@ struct fpi_frame
  * Drivers should define their own #fpi_frame_asmbl_ctx depending on
  * hardware parameters of scanner. @image_width is usually 25% wider than
  * @frame_width to take horizontal movement into account.
+ *
+ * Drivers which store frames as 8 bit pixels, row by row, should leave
+ * @get_pixel unset. The frame data is then accessed directly, which is
+ * a lot faster. Otherwise, every frame is converted using @get_pixel
+ * once before the movement estimation.
  */
 struct fpi_frame_asmbl_ctx
 {
-  unsigned int  frame_width;
-  unsigned int  frame_height;
-  unsigned int  image_width;
-  unsigned char (*get_pixel)(struct fpi_frame_asmbl_ctx *ctx,
-                             struct fpi_frame           *frame,
-                             unsigned int                x,
-                             unsigned int                y);
+  unsigned int        frame_width;
+  unsigned int        frame_height;
+  unsigned int        image_width;
+  unsigned char       (*get_pixel)(struct fpi_frame_asmbl_ctx *ctx,
+                                   struct fpi_frame           *frame,
+                                   unsigned int                x,
+                                   unsigned int                y);
+  unsigned int        frame_stride;
+  FpiFrameAsmblSearch search;
 };
 
 void fpi_do_movement_estimation (struct fpi_frame_asmbl_ctx *ctx,
@@ -69,6 +94,45 @@ void fpi_do_movement_estimation (struct fpi_frame_asmbl_ctx *ctx,
 FpImage *fpi_assemble_frames (struct fpi_frame_asmbl_ctx *ctx,
                               GSList                     *stripes);
 
+/**
+ * FpiFrameStore:
+ *
+ * An opaque structure storing a bounded number of frames in one buffer.
+ */
+typedef struct _FpiFrameStore FpiFrameStore;
+
+FpiFrameStore *fpi_frame_store_new (gsize frame_size,
+                                    guint capacity);
+struct fpi_frame *fpi_frame_store_get_next (FpiFrameStore *self);
+struct fpi_frame *fpi_frame_store_append (FpiFrameStore *self);
+guint fpi_frame_store_get_n_frames (FpiFrameStore *self);
+struct fpi_frame *fpi_frame_store_get_frame (FpiFrameStore *self,
+                                             guint          index);
+void fpi_frame_store_clear (FpiFrameStore *self);
+void fpi_frame_store_free (FpiFrameStore *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FpiFrameStore, fpi_frame_store_free)
+
+/**
+ * FpiFrameAssembler:
+ *
+ * An opaque structure assembling frames while they are being captured.
+ */
+typedef struct _FpiFrameAssembler FpiFrameAssembler;
+
+FpiFrameAssembler *fpi_frame_assembler_new (struct fpi_frame_asmbl_ctx *ctx,
+                                            gboolean                    reverse,
+                                            guint                       max_frames);
+void fpi_frame_assembler_reset (FpiFrameAssembler *self);
+struct fpi_frame *fpi_frame_assembler_get_next_frame (FpiFrameAssembler *self);
+void fpi_frame_assembler_add_frame (FpiFrameAssembler *self,
+                                    struct fpi_frame  *frame);
+guint fpi_frame_assembler_get_n_frames (FpiFrameAssembler *self);
+FpImage *fpi_frame_assembler_finish (FpiFrameAssembler *self);
+void fpi_frame_assembler_free (FpiFrameAssembler *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FpiFrameAssembler, fpi_frame_assembler_free)
+
 /**
  * fpi_line_asmbl_ctx:
  * @line_width: width of line
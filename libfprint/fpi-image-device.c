@@ -22,6 +22,7 @@
 
 #include "fp-image-device-private.h"
 #include "fp-image-device.h"
+#include "fpi-image.h"
 
 /**
  * SECTION: fpi-image-device
@@ -334,21 +335,15 @@ fpi_image_device_minutiae_detected (GObject *source_object, GAsyncResult *res, g
     }
   else if (action == FPI_DEVICE_ACTION_IDENTIFY)
     {
-      gint i;
       GPtrArray *templates;
       FpPrint *result = NULL;
 
       fpi_device_get_identify_data (device, &templates);
-      for (i = 0; !error && i < templates->len; i++)
-        {
-          FpPrint *template = g_ptr_array_index (templates, i);
-
-          if (fpi_print_bz3_match (template, print, priv->bz3_threshold, &error) == FPI_MATCH_SUCCESS)
-            {
-              result = template;
-              break;
-            }
-        }
+      if (!error)
+        fpi_print_bz3_identify (templates, print, priv->bz3_threshold,
+                                FPI_PRINT_IDENTIFY_FIRST_MATCH,
+                                priv->bz3_prefilter_enabled ? &priv->bz3_prefilter : NULL,
+                                &result, &error);
 
       if (!error || error->domain == FP_DEVICE_RETRY)
         fpi_device_identify_report (device, result, g_steal_pointer (&print), g_steal_pointer (&error));
@@ -392,6 +387,28 @@ fpi_image_device_set_bz3_threshold (FpImageDevice *self,
   priv->bz3_threshold = bz3_threshold;
 }
 
+/**
+ * fpi_image_device_set_bz3_prefilter:
+ * @self: a #FpImageDevice imaging fingerprint device
+ * @prefilter: (nullable): The #FpiPrintPrefilter to use, or %NULL to disable
+ *
+ * Enable pre-filtering of the gallery when identifying, see
+ * fpi_print_bz3_identify(). This only pays off for large galleries and is
+ * disabled by default.
+ */
+void
+fpi_image_device_set_bz3_prefilter (FpImageDevice           *self,
+                                    const FpiPrintPrefilter *prefilter)
+{
+  FpImageDevicePrivate *priv = fp_image_device_get_instance_private (self);
+
+  g_return_if_fail (FP_IS_IMAGE_DEVICE (self));
+
+  priv->bz3_prefilter_enabled = prefilter != NULL;
+  if (prefilter)
+    priv->bz3_prefilter = *prefilter;
+}
+
 /**
  * fpi_image_device_report_finger_status:
  * @self: a #FpImageDevice imaging fingerprint device
@@ -461,6 +478,48 @@ fpi_image_device_report_finger_status (FpImageDevice *self,
     }
 }
 
+/* Images of which less than the minimum coverage has enough contrast for
+ * ridges, or less than the minimum coherence of the contrasted area has a
+ * clear ridge flow, are rejected without detecting their minutiae. */
+static gboolean
+fp_image_device_check_quality (FpImageDevice *self,
+                               FpImage       *image,
+                               FpDeviceRetry *retry)
+{
+  FpImageDeviceClass *cls = FP_IMAGE_DEVICE_GET_CLASS (self);
+  gdouble min_coverage = FPI_IMAGE_DEFAULT_MIN_COVERAGE;
+  gdouble min_coherence = FPI_IMAGE_DEFAULT_MIN_COHERENCE;
+  gdouble coverage, coherence;
+
+  if (cls->min_coverage != 0)
+    min_coverage = cls->min_coverage;
+  if (cls->min_coherence != 0)
+    min_coherence = cls->min_coherence;
+
+  if (min_coverage < 0 && min_coherence < 0)
+    return TRUE;
+
+  fpi_image_estimate_quality (image, &coverage, &coherence);
+  fp_dbg ("Image quality estimate: coverage %.2f, coherence %.2f",
+          coverage, coherence);
+
+  /* Nothing, or only a small part of the finger touched the sensor */
+  if (coverage < min_coverage)
+    {
+      *retry = FP_DEVICE_RETRY_CENTER_FINGER;
+      return FALSE;
+    }
+
+  /* Smudged print without discernible ridges, e.g. a wet finger */
+  if (coherence < min_coherence)
+    {
+      *retry = FP_DEVICE_RETRY_REMOVE_FINGER;
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
 /**
  * fpi_image_device_image_captured:
  * @self: a #FpImageDevice imaging fingerprint device
@@ -470,6 +529,11 @@ fpi_image_device_report_finger_status (FpImageDevice *self,
  * captured successfully. If there was an issue where the user should
  * retry, use fpi_image_device_retry_scan() to report the retry condition.
  *
+ * Except when capturing, the quality of the image is estimated first.
+ * Obviously unusable images are reported as a retry condition right away,
+ * without detecting their minutiae. Drivers can tune or disable this using
+ * the min_coverage and min_coherence fields of #FpImageDeviceClass.
+ *
  * In the event of a fatal error for the operation use
  * fpi_image_device_session_error(). This will abort the entire operation
  * including e.g. an enroll operation which captures multiple images during
@@ -480,6 +544,7 @@ fpi_image_device_image_captured (FpImageDevice *self, FpImage *image)
 {
   FpImageDevicePrivate *priv = fp_image_device_get_instance_private (self);
   FpiDeviceAction action;
+  FpDeviceRetry retry;
 
   action = fpi_device_get_current_action (FP_DEVICE (self));
 
@@ -492,6 +557,15 @@ fpi_image_device_image_captured (FpImageDevice *self, FpImage *image)
 
   g_debug ("Image device captured an image");
 
+  if (action != FPI_DEVICE_ACTION_CAPTURE &&
+      !fp_image_device_check_quality (self, image, &retry))
+    {
+      g_debug ("Rejecting image of insufficient quality");
+      g_object_unref (image);
+      fpi_image_device_retry_scan (self, retry);
+      return;
+    }
+
   priv->minutiae_scan_active = TRUE;
 
   /* XXX: We also detect minutiae in capture mode, we solely do this
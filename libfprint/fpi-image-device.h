@@ -75,6 +75,11 @@ typedef enum {
  * @bz3_threshold: Threshold to consider bozorth3 score a match, default: 40
  * @img_width: Width of the image, only provide if constant
  * @img_height: Height of the image, only provide if constant
+ * @min_coverage: Minimum fraction of the image with enough contrast for
+ *   ridges, see fpi_image_estimate_quality(). Images below it are rejected
+ *   without detecting their minutiae, default: 0.1, negative to disable
+ * @min_coherence: Minimum fraction of the contrasted area with a clear
+ *   ridge flow, default: 0.05, negative to disable
  * @img_open: Open the device and do basic initialization
  *   (use this instead of the #FpDeviceClass open vfunc)
  * @img_close: Close the device
@@ -107,6 +112,8 @@ struct _FpImageDeviceClass
   gint          bz3_threshold;
   gint          img_width;
   gint          img_height;
+  gdouble       min_coverage;
+  gdouble       min_coherence;
 
   void          (*img_open)     (FpImageDevice *dev);
   void          (*img_close)    (FpImageDevice *dev);
@@ -118,6 +125,8 @@ struct _FpImageDeviceClass
 
 void fpi_image_device_set_bz3_threshold (FpImageDevice *self,
                                          gint           bz3_threshold);
+void fpi_image_device_set_bz3_prefilter (FpImageDevice           *self,
+                                         const FpiPrintPrefilter *prefilter);
 
 void fpi_image_device_session_error (FpImageDevice *self,
                                      GError        *error);
@@ -79,3 +79,13 @@ gint fpi_mean_sq_diff_norm (const guint8 *buf1,
 FpImage *fpi_image_resize (FpImage *orig,
                            guint    w_factor,
                            guint    h_factor);
+
+/* Default minimum quality estimates of images to detect minutiae in,
+ * image drivers may override them. These are conservative, so that only
+ * images that would not result in a usable print are rejected. */
+#define FPI_IMAGE_DEFAULT_MIN_COVERAGE 0.1
+#define FPI_IMAGE_DEFAULT_MIN_COHERENCE 0.05
+
+void fpi_image_estimate_quality (FpImage *self,
+                                 gdouble *coverage,
+                                 gdouble *coherence);
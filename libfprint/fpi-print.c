@@ -25,6 +25,8 @@
 #include "fpi-device.h"
 #include "fpi-compat.h"
 
+#include <math.h>
+
 /**
  * SECTION: fpi-print
  * @title: Internal FpPrint
@@ -50,7 +52,10 @@ fpi_print_add_print (FpPrint *print, FpPrint *add)
   g_return_if_fail (add->type == FPI_PRINT_NBIS);
 
   g_assert (add->prints->len == 1);
-  g_ptr_array_add (print->prints, g_memdup2 (add->prints->pdata[0], sizeof (struct xyt_struct)));
+  g_clear_pointer (&print->bz3_edges, g_ptr_array_unref);
+  g_ptr_array_add (print->prints,
+                   g_memdup2 (add->prints->pdata[0],
+                              fpi_print_minutiae_size (add->prints->pdata[0])));
 }
 
 /**
@@ -97,20 +102,61 @@ fpi_print_set_device_stored (FpPrint *print,
   g_object_notify (G_OBJECT (print), "device-stored");
 }
 
+/* Allocates storage for @n_minutiae minutiae, the values are uninitialized. */
+FpiPrintMinutiae *
+fpi_print_minutiae_new (guint n_minutiae)
+{
+  FpiPrintMinutiae *minutiae;
+
+  minutiae = g_malloc (sizeof (FpiPrintMinutiae) + 3 * n_minutiae * sizeof (gint16));
+  minutiae->n_minutiae = n_minutiae;
+
+  return minutiae;
+}
+
+gsize
+fpi_print_minutiae_size (const FpiPrintMinutiae *minutiae)
+{
+  return sizeof (FpiPrintMinutiae) + 3 * minutiae->n_minutiae * sizeof (gint16);
+}
+
+/* Expands the minutiae into the fixed size representation used by NBIS.
+ * Only the used rows of @xyt are written. */
+void
+fpi_print_minutiae_to_xyt (const FpiPrintMinutiae *minutiae,
+                           struct xyt_struct      *xyt)
+{
+  const gint16 *x = FPI_PRINT_MINUTIAE_X (minutiae);
+  const gint16 *y = FPI_PRINT_MINUTIAE_Y (minutiae);
+  const gint16 *theta = FPI_PRINT_MINUTIAE_THETA (minutiae);
+  guint i;
+
+  g_assert (minutiae->n_minutiae <= MAX_BOZORTH_MINUTIAE);
+
+  for (i = 0; i < minutiae->n_minutiae; i++)
+    {
+      xyt->xcol[i] = x[i];
+      xyt->ycol[i] = y[i];
+      xyt->thetacol[i] = theta[i];
+    }
+  xyt->nrows = minutiae->n_minutiae;
+}
+
 /* XXX: This is the old version, but wouldn't it be smarter to instead
  * use the highest quality mintutiae? Possibly just using bz_prune from
  * upstream? */
-static void
-minutiae_to_xyt (struct fp_minutiae *minutiae,
-                 int                 bwidth,
-                 int                 bheight,
-                 struct xyt_struct  *xyt)
+static FpiPrintMinutiae *
+minutiae_to_print_minutiae (struct fp_minutiae *minutiae,
+                            int                 bwidth,
+                            int                 bheight)
 {
   int i;
   struct fp_minutia *minutia;
   struct minutiae_struct c[MAX_FILE_MINUTIAE];
+  FpiPrintMinutiae *result;
+  gint16 *x, *y, *theta;
 
-  /* struct xyt_struct uses arrays of MAX_BOZORTH_MINUTIAE (200) */
+  /* The matcher uses arrays of MAX_BOZORTH_MINUTIAE (200) */
   int nmin = min (minutiae->num, MAX_BOZORTH_MINUTIAE);
 
   for (i = 0; i < nmin; i++)
@@ -128,13 +174,19 @@ minutiae_to_xyt (struct fp_minutiae *minutiae,
   qsort ((void *) &c, (size_t) nmin, sizeof (struct minutiae_struct),
          sort_x_y);
 
+  /* Image coordinates and angles in degrees easily fit into 16 bits */
+  result = fpi_print_minutiae_new (nmin);
+  x = FPI_PRINT_MINUTIAE_X (result);
+  y = FPI_PRINT_MINUTIAE_Y (result);
+  theta = FPI_PRINT_MINUTIAE_THETA (result);
   for (i = 0; i < nmin; i++)
     {
-      xyt->xcol[i]     = c[i].col[0];
-      xyt->ycol[i]     = c[i].col[1];
-      xyt->thetacol[i] = c[i].col[2];
+      x[i]     = c[i].col[0];
+      y[i]     = c[i].col[1];
+      theta[i] = c[i].col[2];
     }
-  xyt->nrows = nmin;
+
+  return result;
 }
 
 /**
@@ -158,7 +210,7 @@ fpi_print_add_from_image (FpPrint *print,
 {
   GPtrArray *minutiae;
   struct fp_minutiae _minutiae;
-  struct xyt_struct *xyt;
+  FpiPrintMinutiae *print_minutiae;
 
   if (print->type != FPI_PRINT_NBIS || !image)
     {
@@ -183,9 +235,9 @@ fpi_print_add_from_image (FpPrint *print,
   _minutiae.list = (struct fp_minutia **) minutiae->pdata;
   _minutiae.alloc = minutiae->len;
 
-  xyt = g_new0 (struct xyt_struct, 1);
-  minutiae_to_xyt (&_minutiae, image->width, image->height, xyt);
-  g_ptr_array_add (print->prints, xyt);
+  print_minutiae = minutiae_to_print_minutiae (&_minutiae, image->width, image->height);
+  g_clear_pointer (&print->bz3_edges, g_ptr_array_unref);
+  g_ptr_array_add (print->prints, print_minutiae);
 
   g_clear_object (&print->image);
   print->image = g_object_ref (image);
@@ -194,6 +246,238 @@ fpi_print_add_from_image (FpPrint *print,
   return TRUE;
 }
 
+/* The bozorth3 working tables are too large to allocate for every match, so
+ * each thread that matches keeps its own context around. */
+static GPrivate bz3_context = G_PRIVATE_INIT ((GDestroyNotify) bz_free_context);
+
+static struct bz_context *
+get_bz3_context (void)
+{
+  struct bz_context *ctx = g_private_get (&bz3_context);
+
+  if (!ctx)
+    {
+      ctx = bz_alloc_context ();
+      g_private_set (&bz3_context, ctx);
+    }
+
+  return ctx;
+}
+
+static gboolean
+check_bz3_probe (FpPrint *print, GError **error)
+{
+  /* XXX: Use a different error type? */
+  if (print->type != FPI_PRINT_NBIS)
+    {
+      *error = fpi_device_error_new_msg (FP_DEVICE_ERROR_NOT_SUPPORTED,
+                                         "It is only possible to match NBIS type print data");
+      return FALSE;
+    }
+
+  if (print->prints->len != 1)
+    {
+      *error = fpi_device_error_new_msg (FP_DEVICE_ERROR_GENERAL,
+                                         "New print contains more than one print!");
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+check_bz3_template (FpPrint *template, GError **error)
+{
+  if (template->type != FPI_PRINT_NBIS)
+    {
+      *error = fpi_device_error_new_msg (FP_DEVICE_ERROR_NOT_SUPPORTED,
+                                         "It is only possible to match NBIS type print data");
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Number of bins for the edge length and for each of the two betas of the
+ * rows in the pre-filter signature. */
+#define BZ3_SIGNATURE_BINS 16
+
+/* Allocates a comparison table with @len rows and room for its signature,
+ * the values are uninitialized. */
+FpiPrintBz3Edges *
+fpi_print_bz3_edges_new (gint len)
+{
+  FpiPrintBz3Edges *edges;
+
+  edges = g_malloc (sizeof (FpiPrintBz3Edges) +
+                    len * COLS_SIZE_2 * sizeof (gint) +
+                    len * sizeof (guint16));
+  edges->len = len;
+
+  return edges;
+}
+
+static gint
+compare_signature_bins (gconstpointer a, gconstpointer b)
+{
+  return *(const guint16 *) a - *(const guint16 *) b;
+}
+
+/* Fills the signature of @edges: a histogram of the edge lengths and betas
+ * of all rows, stored as the sorted list of the bin of each row. These do
+ * not depend on the placement or rotation of the print, so prints of the
+ * same finger share most of their bins. */
+void
+fpi_print_bz3_edges_update_signature (FpiPrintBz3Edges *edges)
+{
+  guint16 *signature = FPI_PRINT_BZ3_SIGNATURE (edges);
+  gint i;
+
+  for (i = 0; i < edges->len; i++)
+    {
+      const gint *row = &edges->edges[i * COLS_SIZE_2];
+      guint length, beta_min, beta_max;
+
+      /* The squared length is at most DM², both betas are in (-180, 180] */
+      length = MIN ((guint) sqrt (row[0]), DM) * BZ3_SIGNATURE_BINS / (DM + 1);
+      beta_min = (CLAMP (row[1], -179, 180) + 179) * BZ3_SIGNATURE_BINS / 360;
+      beta_max = (CLAMP (row[2], -179, 180) + 179) * BZ3_SIGNATURE_BINS / 360;
+
+      signature[i] = (length * BZ3_SIGNATURE_BINS + beta_min) * BZ3_SIGNATURE_BINS + beta_max;
+    }
+
+  qsort (signature, edges->len, sizeof (guint16), compare_signature_bins);
+}
+
+/* Returns the intersection of the normalized signature histograms, between
+ * 0 for no shared bins and 1 for identical histograms. */
+static gdouble
+bz3_signature_similarity (const FpiPrintBz3Edges *a,
+                          const FpiPrintBz3Edges *b)
+{
+  const guint16 *sa = FPI_PRINT_BZ3_SIGNATURE (a);
+  const guint16 *sb = FPI_PRINT_BZ3_SIGNATURE (b);
+  gint64 common = 0;
+  gint i = 0, j = 0;
+
+  if (a->len == 0 || b->len == 0)
+    return 0;
+
+  while (i < a->len && j < b->len)
+    {
+      guint16 bin;
+      gint64 na = 0, nb = 0;
+
+      if (sa[i] < sb[j])
+        {
+          i++;
+          continue;
+        }
+      if (sa[i] > sb[j])
+        {
+          j++;
+          continue;
+        }
+
+      bin = sa[i];
+      for (; i < a->len && sa[i] == bin; i++)
+        na++;
+      for (; j < b->len && sb[j] == bin; j++)
+        nb++;
+
+      common += MIN (na * b->len, nb * a->len);
+    }
+
+  return (gdouble) common / ((gint64) a->len * b->len);
+}
+
+/* Returns the comparison table of the print at @index in @template,
+ * computing and caching it on first use. Concurrent matches against the same
+ * template may race to fill the cache, only one of the tables is kept. */
+FpiPrintBz3Edges *
+fpi_print_get_bz3_edges (FpPrint *template,
+                         guint    index)
+{
+  FpiPrintBz3Edges *edges;
+  struct bz_context *ctx;
+  struct xyt_struct gstruct;
+  GPtrArray *cache;
+  gint len;
+
+  g_assert (template->type == FPI_PRINT_NBIS);
+  g_assert (index < template->prints->len);
+
+  cache = g_atomic_pointer_get (&template->bz3_edges);
+  if (!cache)
+    {
+      cache = g_ptr_array_new_with_free_func (g_free);
+      g_ptr_array_set_size (cache, template->prints->len);
+
+      if (!g_atomic_pointer_compare_and_exchange (&template->bz3_edges, NULL, cache))
+        {
+          g_ptr_array_unref (cache);
+          cache = g_atomic_pointer_get (&template->bz3_edges);
+        }
+    }
+  g_assert (cache->len == template->prints->len);
+
+  edges = g_atomic_pointer_get (&cache->pdata[index]);
+  if (edges)
+    return edges;
+
+  ctx = get_bz3_context ();
+  fpi_print_minutiae_to_xyt (g_ptr_array_index (template->prints, index), &gstruct);
+  len = bozorth_gallery_init (ctx, &gstruct);
+  edges = fpi_print_bz3_edges_new (len);
+  bozorth_gallery_save (ctx, len, edges->edges);
+  fpi_print_bz3_edges_update_signature (edges);
+
+  if (!g_atomic_pointer_compare_and_exchange (&cache->pdata[index], NULL, edges))
+    {
+      g_free (edges);
+      edges = g_atomic_pointer_get (&cache->pdata[index]);
+    }
+
+  return edges;
+}
+
+/* Matches the probe that has been prepared in @ctx using
+ * bozorth_probe_init() against the prints of @template and returns the
+ * highest score. If @first_match is set, this stops at the first print
+ * that reaches @bz3_threshold. Scoring of each print then also stops as soon
+ * as the outcome is known, so the returned score is only meaningful in
+ * relation to @bz3_threshold. */
+static gint
+bz3_template_score (struct bz_context *ctx,
+                    gint               probe_len,
+                    struct xyt_struct *pstruct,
+                    FpPrint           *template,
+                    gint               bz3_threshold,
+                    gboolean           first_match)
+{
+  gint best_score = 0;
+  gint i;
+
+  for (i = 0; i < template->prints->len; i++)
+    {
+      FpiPrintBz3Edges *edges;
+      struct xyt_struct gstruct;
+      gint score;
+      fpi_print_minutiae_to_xyt (g_ptr_array_index (template->prints, i), &gstruct);
+      edges = fpi_print_get_bz3_edges (template, i);
+      score = bozorth_to_gallery_edges (ctx, probe_len, pstruct, &gstruct,
+                                        edges->edges, edges->len,
+                                        first_match ? bz3_threshold : 0);
+      fp_dbg ("score %d/%d", score, bz3_threshold);
+
+      best_score = MAX (best_score, score);
+      if (first_match && score >= bz3_threshold)
+        break;
+    }
+
+  return best_score;
+}
+
 /**
  * fpi_print_bz3_match:
  * @template: A #FpPrint containing one or more prints
@@ -207,48 +491,559 @@ fpi_print_add_from_image (FpPrint *print,
  * Both @template and @print need to be of type #FPI_PRINT_NBIS for this to
  * work.
  *
+ * The comparison tables of @template are computed on first use and kept
+ * with the print, so later matches against it are cheaper.
+ *
+ * This function is thread safe, concurrent matches use separate working
+ * tables.
+ *
  * Returns: Whether the prints match, @error will be set if #FPI_MATCH_ERROR is returned
  */
 FpiMatchResult
 fpi_print_bz3_match (FpPrint *template, FpPrint *print, gint bz3_threshold, GError **error)
 {
-  struct xyt_struct *pstruct;
+  struct bz_context *ctx;
+  struct xyt_struct pstruct;
   gint probe_len;
+
+  if (!check_bz3_probe (print, error))
+    return FPI_MATCH_ERROR;
+
+  if (!check_bz3_template (template, error))
+    return FPI_MATCH_ERROR;
+
+  ctx = get_bz3_context ();
+  fpi_print_minutiae_to_xyt (g_ptr_array_index (print->prints, 0), &pstruct);
+  probe_len = bozorth_probe_init (ctx, &pstruct);
+
+  if (bz3_template_score (ctx, probe_len, &pstruct, template, bz3_threshold, TRUE) >= bz3_threshold)
+    return FPI_MATCH_SUCCESS;
+
+  return FPI_MATCH_FAIL;
+}
+
+/**
+ * fpi_print_bz3_score:
+ * @template: A #FpPrint containing one or more prints
+ * @print: A newly scanned #FpPrint to test
+ * @score: (out): Return location for the score
+ * @error: Return location for error
+ *
+ * Match the newly scanned @print (containing exactly one print) against all
+ * prints contained in @template and return the highest raw BZ3 score. This
+ * allows callers to apply their own thresholds.
+ *
+ * Both @template and @print need to be of type #FPI_PRINT_NBIS for this to
+ * work.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+fpi_print_bz3_score (FpPrint *template,
+                     FpPrint *print,
+                     gint    *score,
+                     GError **error)
+{
+  struct bz_context *ctx;
+  struct xyt_struct pstruct;
+  gint probe_len;
+
+  g_return_val_if_fail (score != NULL, FALSE);
+
+  if (!check_bz3_probe (print, error))
+    return FALSE;
+
+  if (!check_bz3_template (template, error))
+    return FALSE;
+
+  ctx = get_bz3_context ();
+  fpi_print_minutiae_to_xyt (g_ptr_array_index (print->prints, 0), &pstruct);
+  probe_len = bozorth_probe_init (ctx, &pstruct);
+
+  *score = bz3_template_score (ctx, probe_len, &pstruct, template, G_MAXINT, FALSE);
+
+  return TRUE;
+}
+
+typedef struct
+{
+  GPtrArray           *templates;
+  struct xyt_struct   *pstruct;
+  gint                 bz3_threshold;
+  FpiPrintIdentifyMode mode;
+  gint                 n_templates;
+  /* Optional, the indices of the n_templates templates to match in order */
+  gint                *order;
+  /* Optional, receives the score of every template */
+  gint                *scores;
+
+  /* If set, the workers compute the pre-filter similarity of every
+   * template to the probe instead of matching it */
+  const FpiPrintPrefilter *prefilter;
+  guint                    probe_count;
+  FpiPrintBz3Edges        *probe_edges;
+  gdouble                 *similarities;
+
+  /* Position of the next template to match, shared between all workers */
+  gint next;
+  /* Lowest position of a matching template, or n_templates */
+  gint first_match;
+
+  GMutex lock;
+  GCond  cond;
+  gint   pending;
+  gint   best_score;
+  gint   best_match;
+} Bz3IdentifyJob;
+
+static gboolean
+bz3_prefilter_counts_match (guint                    probe_count,
+                            guint                    count,
+                            const FpiPrintPrefilter *prefilter)
+{
+  if (prefilter->max_count_ratio <= 0)
+    return TRUE;
+
+  return MAX (probe_count, count) <= prefilter->max_count_ratio * MIN (probe_count, count);
+}
+
+/* Returns the highest signature similarity of the prints of @template to
+ * the probe of @job, or -1 if none of them passes the minutiae count limit.
+ * The comparison tables of @template are computed here if not cached yet. */
+static gdouble
+bz3_prefilter_similarity (Bz3IdentifyJob *job,
+                          FpPrint        *template)
+{
+  gdouble similarity = -1;
+  guint i;
+
+  for (i = 0; i < template->prints->len; i++)
+    {
+      FpiPrintMinutiae *minutiae = g_ptr_array_index (template->prints, i);
+
+      if (!bz3_prefilter_counts_match (job->probe_count, minutiae->n_minutiae,
+                                       job->prefilter))
+        continue;
+
+      similarity = MAX (similarity,
+                        bz3_signature_similarity (job->probe_edges,
+                                                  fpi_print_get_bz3_edges (template, i)));
+    }
+
+  return similarity;
+}
+
+/* Computes the pre-filter similarity of templates of @job until none are
+ * left. Building the comparison tables of a gallery that has none cached
+ * is expensive, so it is split between the workers just like matching. */
+static void
+bz3_identify_prefilter_templates (Bz3IdentifyJob *job)
+{
+  while (TRUE)
+    {
+      gint pos;
+
+      pos = g_atomic_int_add (&job->next, 1);
+      if (pos >= job->n_templates)
+        break;
+
+      job->similarities[pos] = bz3_prefilter_similarity (job,
+                                                         g_ptr_array_index (job->templates, pos));
+    }
+}
+
+/* Matches templates of @job against the probe until none are left, or in
+ * first match mode, until one before the next position has matched. */
+static void
+bz3_identify_match_templates (Bz3IdentifyJob *job)
+{
+  struct bz_context *ctx = get_bz3_context ();
+  gboolean first_match = job->mode == FPI_PRINT_IDENTIFY_FIRST_MATCH;
+  gint probe_len;
+
+  probe_len = bozorth_probe_init (ctx, job->pstruct);
+
+  while (TRUE)
+    {
+      FpPrint *template;
+      gint score;
+      gint pos;
+      gint i;
+
+      pos = g_atomic_int_add (&job->next, 1);
+      if (pos >= job->n_templates)
+        break;
+
+      /* Positions only grow, so once a lower one matched in first match
+       * mode, nothing this worker could still find would be reported. */
+      if (first_match && pos > g_atomic_int_get (&job->first_match))
+        break;
+
+      i = job->order ? job->order[pos] : pos;
+      template = g_ptr_array_index (job->templates, i);
+      score = bz3_template_score (ctx, probe_len, job->pstruct, template,
+                                  job->bz3_threshold, first_match);
+      if (job->scores)
+        job->scores[i] = score;
+
+      if (score < job->bz3_threshold)
+        continue;
+
+      if (first_match)
+        {
+          gint prev;
+
+          do
+            {
+              prev = g_atomic_int_get (&job->first_match);
+            }
+          while (pos < prev &&
+                 !g_atomic_int_compare_and_exchange (&job->first_match, prev, pos));
+        }
+      else
+        {
+          g_mutex_lock (&job->lock);
+          if (score > job->best_score ||
+              (score == job->best_score && pos < job->best_match))
+            {
+              job->best_score = score;
+              job->best_match = pos;
+            }
+          g_mutex_unlock (&job->lock);
+        }
+    }
+}
+
+static void
+bz3_identify_worker (gpointer data, gpointer user_data)
+{
+  Bz3IdentifyJob *job = data;
+
+  if (job->prefilter)
+    bz3_identify_prefilter_templates (job);
+  else
+    bz3_identify_match_templates (job);
+
+  g_mutex_lock (&job->lock);
+  job->pending -= 1;
+  if (job->pending == 0)
+    g_cond_signal (&job->cond);
+  g_mutex_unlock (&job->lock);
+}
+
+static GThreadPool *
+get_bz3_identify_pool (void)
+{
+  static gsize pool = 0;
+
+  if (g_once_init_enter (&pool))
+    {
+      GThreadPool *new_pool;
+
+      /* The calling thread always takes part in matching */
+      new_pool = g_thread_pool_new (bz3_identify_worker, NULL,
+                                    MAX (1, g_get_num_processors () - 1),
+                                    FALSE, NULL);
+      g_once_init_leave (&pool, (gsize) new_pool);
+    }
+
+  return (GThreadPool *) pool;
+}
+
+/* Splits the job between the calling thread and the worker pool and waits
+ * for all of them to finish. */
+static void
+bz3_identify_run (Bz3IdentifyJob *job)
+{
+  gint n_workers;
   gint i;
 
-  /* XXX: Use a different error type? */
-  if (template->type != FPI_PRINT_NBIS || print->type != FPI_PRINT_NBIS)
+  n_workers = MIN (g_get_num_processors (), job->n_templates);
+  job->pending = MAX (n_workers, 1);
+  g_mutex_init (&job->lock);
+  g_cond_init (&job->cond);
+
+  for (i = 1; i < n_workers; i++)
+    g_thread_pool_push (get_bz3_identify_pool (), job, NULL);
+
+  bz3_identify_worker (job, NULL);
+
+  g_mutex_lock (&job->lock);
+  while (job->pending > 0)
+    g_cond_wait (&job->cond, &job->lock);
+  g_mutex_unlock (&job->lock);
+
+  g_cond_clear (&job->cond);
+  g_mutex_clear (&job->lock);
+}
+
+typedef struct
+{
+  gint    index;
+  gdouble similarity;
+} Bz3PrefilterCandidate;
+
+static gint
+compare_prefilter_candidates (gconstpointer a, gconstpointer b)
+{
+  const Bz3PrefilterCandidate *ca = a;
+  const Bz3PrefilterCandidate *cb = b;
+
+  if (ca->similarity != cb->similarity)
+    return cb->similarity > ca->similarity ? 1 : -1;
+
+  return ca->index - cb->index;
+}
+
+/* Compares the signature of @print with the first @n_templates of
+ * @templates and returns the indices of the templates that pass @prefilter,
+ * most similar first. The signatures of the templates are cached together
+ * with their comparison tables, which are computed on the worker pool if
+ * needed. */
+GArray *
+fpi_print_bz3_prefilter (GPtrArray               *templates,
+                         gint                     n_templates,
+                         FpPrint                 *print,
+                         const FpiPrintPrefilter *prefilter)
+{
+  Bz3IdentifyJob job = { 0, };
+  g_autoptr(GArray) candidates = NULL;
+  g_autofree gdouble *similarities = NULL;
+  FpiPrintMinutiae *probe_minutiae;
+  GArray *order;
+  gint i;
+
+  probe_minutiae = g_ptr_array_index (print->prints, 0);
+  similarities = g_new (gdouble, n_templates);
+
+  job.templates = templates;
+  job.n_templates = n_templates;
+  job.prefilter = prefilter;
+  job.probe_count = probe_minutiae->n_minutiae;
+  job.probe_edges = fpi_print_get_bz3_edges (print, 0);
+  job.similarities = similarities;
+
+  bz3_identify_run (&job);
+
+  candidates = g_array_sized_new (FALSE, FALSE, sizeof (Bz3PrefilterCandidate),
+                                  n_templates);
+  for (i = 0; i < n_templates; i++)
     {
-      *error = fpi_device_error_new_msg (FP_DEVICE_ERROR_NOT_SUPPORTED,
-                                         "It is only possible to match NBIS type print data");
-      return FPI_MATCH_ERROR;
+      Bz3PrefilterCandidate candidate = { i, similarities[i] };
+
+      if (candidate.similarity < 0 || candidate.similarity < prefilter->min_similarity)
+        continue;
+
+      g_array_append_val (candidates, candidate);
     }
 
-  if (print->prints->len != 1)
+  g_array_sort (candidates, compare_prefilter_candidates);
+
+  if (prefilter->max_candidates > 0 && candidates->len > prefilter->max_candidates)
+    g_array_set_size (candidates, prefilter->max_candidates);
+
+  fp_dbg ("Pre-filter kept %u of %d templates", candidates->len, n_templates);
+
+  order = g_array_sized_new (FALSE, FALSE, sizeof (gint), candidates->len);
+  for (i = 0; i < candidates->len; i++)
+    g_array_append_val (order, g_array_index (candidates, Bz3PrefilterCandidate, i).index);
+
+  return order;
+}
+
+/**
+ * fpi_print_bz3_identify:
+ * @templates: (element-type FpPrint): The gallery of #FpPrint to search
+ * @print: A newly scanned #FpPrint to test
+ * @bz3_threshold: The BZ3 match threshold
+ * @mode: The #FpiPrintIdentifyMode to use
+ * @prefilter: (nullable): The #FpiPrintPrefilter to apply, or %NULL
+ * @match: (out) (transfer none) (nullable): Return location for the matching template
+ * @error: Return location for error
+ *
+ * Identify the newly scanned @print (containing exactly one print) within
+ * the gallery of @templates. The pairwise comparison table of @print is
+ * only computed once per worker and the gallery is split between a pool
+ * of worker threads, one for each available CPU core.
+ *
+ * With #FPI_PRINT_IDENTIFY_FIRST_MATCH, the result is the same as calling
+ * fpi_print_bz3_match() for each template in turn and all workers stop as
+ * soon as a match is found. With #FPI_PRINT_IDENTIFY_BEST_MATCH, the whole
+ * gallery is matched and the template with the highest score is returned.
+ *
+ * If @prefilter is given, the templates are first compared using a cheap
+ * signature and only those passing it are matched, most similar first. In
+ * first match mode, the first matching template in that order is returned.
+ *
+ * The matching template is stored in @match, which is set to %NULL
+ * otherwise. All prints need to be of type #FPI_PRINT_NBIS.
+ *
+ * Returns: Whether a template matched, @error will be set if #FPI_MATCH_ERROR is returned
+ */
+FpiMatchResult
+fpi_print_bz3_identify (GPtrArray               *templates,
+                        FpPrint                 *print,
+                        gint                     bz3_threshold,
+                        FpiPrintIdentifyMode     mode,
+                        const FpiPrintPrefilter *prefilter,
+                        FpPrint                **match,
+                        GError                 **error)
+{
+  Bz3IdentifyJob job = { 0, };
+  struct xyt_struct pstruct;
+  g_autoptr(GArray) order = NULL;
+  GError *template_error = NULL;
+  gint i;
+
+  if (match)
+    *match = NULL;
+
+  if (!check_bz3_probe (print, error))
+    return FPI_MATCH_ERROR;
+
+  /* Only match up to the first invalid template. In first match mode, a
+   * match before it is still reported just like sequential matching would. */
+  for (i = 0; i < templates->len; i++)
     {
-      *error = fpi_device_error_new_msg (FP_DEVICE_ERROR_GENERAL,
-                                         "New print contains more than one print!");
+      if (!check_bz3_template (g_ptr_array_index (templates, i), &template_error))
+        break;
+    }
+
+  if (template_error && mode == FPI_PRINT_IDENTIFY_BEST_MATCH)
+    {
+      g_propagate_error (error, template_error);
       return FPI_MATCH_ERROR;
     }
 
-  pstruct = g_ptr_array_index (print->prints, 0);
-  probe_len = bozorth_probe_init (pstruct);
+  job.templates = templates;
+  fpi_print_minutiae_to_xyt (g_ptr_array_index (print->prints, 0), &pstruct);
+  job.pstruct = &pstruct;
+  job.bz3_threshold = bz3_threshold;
+  job.mode = mode;
+  job.n_templates = i;
+  if (prefilter)
+    {
+      order = fpi_print_bz3_prefilter (templates, job.n_templates, print, prefilter);
+      job.order = (gint *) order->data;
+      job.n_templates = order->len;
+    }
+  job.first_match = job.n_templates;
+  job.best_match = job.n_templates;
 
-  for (i = 0; i < template->prints->len; i++)
+  bz3_identify_run (&job);
+
+  if (mode == FPI_PRINT_IDENTIFY_FIRST_MATCH)
+    i = job.first_match;
+  else
+    i = job.best_match;
+
+  if (i < job.n_templates)
     {
-      struct xyt_struct *gstruct;
-      gint score;
-      gstruct = g_ptr_array_index (template->prints, i);
-      score = bozorth_to_gallery (probe_len, pstruct, gstruct);
-      fp_dbg ("score %d/%d", score, bz3_threshold);
+      g_clear_error (&template_error);
+      if (match)
+        *match = g_ptr_array_index (templates, job.order ? job.order[i] : i);
+
+      return FPI_MATCH_SUCCESS;
+    }
 
-      if (score >= bz3_threshold)
-        return FPI_MATCH_SUCCESS;
+  if (template_error)
+    {
+      g_propagate_error (error, template_error);
+      return FPI_MATCH_ERROR;
     }
 
   return FPI_MATCH_FAIL;
 }
 
+static gint
+compare_candidates (gconstpointer a, gconstpointer b)
+{
+  const FpiPrintCandidate *ca = a;
+  const FpiPrintCandidate *cb = b;
+
+  if (ca->score != cb->score)
+    return cb->score > ca->score ? 1 : -1;
+
+  return ca->index > cb->index ? 1 : (ca->index < cb->index ? -1 : 0);
+}
+
+/**
+ * fpi_print_bz3_rank:
+ * @templates: (element-type FpPrint): The gallery of #FpPrint to search
+ * @print: A newly scanned #FpPrint to test
+ * @max_candidates: Maximum number of candidates to return, or 0 for all
+ * @error: Return location for error
+ *
+ * Match the newly scanned @print (containing exactly one print) against the
+ * whole gallery of @templates and rank the templates by their raw BZ3 score.
+ * The gallery is matched using the same worker pool as
+ * fpi_print_bz3_identify(), but no threshold is applied, so callers can
+ * do their own thresholding or fusion of the scores.
+ *
+ * The candidates are sorted by decreasing score, templates with the same
+ * score are kept in gallery order. Passing 0 for @max_candidates returns
+ * the score for every template. All prints need to be of type
+ * #FPI_PRINT_NBIS.
+ *
+ * Returns: (transfer full) (element-type FpiPrintCandidate): The ranked
+ *   candidates, or %NULL on error
+ */
+GArray *
+fpi_print_bz3_rank (GPtrArray *templates,
+                    FpPrint   *print,
+                    guint      max_candidates,
+                    GError   **error)
+{
+  Bz3IdentifyJob job = { 0, };
+  struct xyt_struct pstruct;
+  g_autofree gint *scores = NULL;
+  GArray *candidates;
+  guint i;
+
+  if (!check_bz3_probe (print, error))
+    return NULL;
+
+  for (i = 0; i < templates->len; i++)
+    {
+      if (!check_bz3_template (g_ptr_array_index (templates, i), error))
+        return NULL;
+    }
+
+  scores = g_new0 (gint, templates->len);
+
+  job.templates = templates;
+  fpi_print_minutiae_to_xyt (g_ptr_array_index (print->prints, 0), &pstruct);
+  job.pstruct = &pstruct;
+  job.bz3_threshold = G_MAXINT;
+  job.mode = FPI_PRINT_IDENTIFY_BEST_MATCH;
+  job.n_templates = templates->len;
+  job.scores = scores;
+  job.first_match = job.n_templates;
+  job.best_match = job.n_templates;
+
+  bz3_identify_run (&job);
+
+  candidates = g_array_sized_new (FALSE, FALSE, sizeof (FpiPrintCandidate),
+                                  templates->len);
+  for (i = 0; i < templates->len; i++)
+    {
+      FpiPrintCandidate candidate = {
+        .print = g_ptr_array_index (templates, i),
+        .index = i,
+        .score = scores[i],
+      };
+
+      g_array_append_val (candidates, candidate);
+    }
+
+  g_array_sort (candidates, compare_candidates);
+
+  if (max_candidates > 0 && candidates->len > max_candidates)
+    g_array_set_size (candidates, max_candidates);
+
+  return candidates;
+}
+
 /**
  * fpi_print_generate_user_id:
  * @print: #FpPrint to generate the ID for
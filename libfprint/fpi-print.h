@@ -6,6 +6,9 @@
 
 G_BEGIN_DECLS
 
+/* Default BZ3 match threshold, drivers may override it. */
+#define BOZORTH3_DEFAULT_THRESHOLD 40
+
 /**
  * FpiPrintType:
  * @FPI_PRINT_UNDEFINED: Undefined type, this happens prior to enrollment
@@ -30,6 +33,53 @@ typedef enum {
   FPI_MATCH_SUCCESS,
 } FpiMatchResult;
 
+/**
+ * FpiPrintIdentifyMode:
+ * @FPI_PRINT_IDENTIFY_FIRST_MATCH: Stop at the first template that matches
+ * @FPI_PRINT_IDENTIFY_BEST_MATCH: Match the whole gallery and return the
+ *   template with the highest score
+ */
+typedef enum {
+  FPI_PRINT_IDENTIFY_FIRST_MATCH,
+  FPI_PRINT_IDENTIFY_BEST_MATCH,
+} FpiPrintIdentifyMode;
+
+/**
+ * FpiPrintCandidate:
+ * @print: The template #FpPrint, owned by the gallery
+ * @index: Index of @print in the gallery
+ * @score: The highest BZ3 score of any of the prints in @print
+ *
+ * A ranked identification candidate, see fpi_print_bz3_rank().
+ */
+typedef struct
+{
+  FpPrint *print;
+  guint    index;
+  gint     score;
+} FpiPrintCandidate;
+
+/**
+ * FpiPrintPrefilter:
+ * @max_candidates: Maximum number of templates to match, or 0 for no limit
+ * @min_similarity: Minimum signature similarity between 0 and 1 for a
+ *   template to be matched
+ * @max_count_ratio: Skip template prints whose number of minutiae differs
+ *   from that of the probe by more than this factor, or 0 to disable
+ *
+ * Settings for the pre-filter of fpi_print_bz3_identify(). Templates are
+ * ranked using the similarity of their edge length and angle histograms to
+ * the probe, which is a lot cheaper than matching them. The limits need to
+ * be chosen so that genuine matches are not dropped for the gallery sizes
+ * and sensors in use.
+ */
+typedef struct
+{
+  guint   max_candidates;
+  gdouble min_similarity;
+  gdouble max_count_ratio;
+} FpiPrintPrefilter;
+
 void     fpi_print_add_print (FpPrint *print,
                               FpPrint *add);
 
@@ -47,6 +97,24 @@ FpiMatchResult fpi_print_bz3_match (FpPrint *temp,
                                     gint     bz3_threshold,
                                     GError **error);
 
+gboolean fpi_print_bz3_score (FpPrint *temp,
+                              FpPrint *print,
+                              gint    *score,
+                              GError **error);
+
+FpiMatchResult fpi_print_bz3_identify (GPtrArray               *templates,
+                                       FpPrint                 *print,
+                                       gint                     bz3_threshold,
+                                       FpiPrintIdentifyMode     mode,
+                                       const FpiPrintPrefilter *prefilter,
+                                       FpPrint                **match,
+                                       GError                 **error);
+
+GArray * fpi_print_bz3_rank (GPtrArray *templates,
+                             FpPrint   *print,
+                             guint      max_candidates,
+                             GError   **error);
+
 /* Helpers to encode metadata into user ID strings. */
 gchar *  fpi_print_generate_user_id (FpPrint *print);
 gboolean fpi_print_fill_from_user_id (FpPrint    *print,
@@ -56,6 +56,9 @@ of the software.
 ***********************************************************************
 
       ROUTINES:
+#cat: bz_comp_init - fills the edge angle table of a matcher context
+#cat:            and selects the pair loop used by bz_comp
+#cat: bz_comp_rows_select - picks the fastest pair loop for the CPU
 #cat: bz_comp -  takes a set of minutiae (probe or gallery) and
 #cat:            compares/measures  each minutia's {x,y,t} with every
 #cat:            other minutia's {x,y,t} in the set creating a table
@@ -70,6 +73,8 @@ of the software.
 #cat:            a sufficiently long path (or a cluster of compatible paths)
 #cat:            of "linked" match table entries
 #cat:            the accumulation of which results in a match "score"
+#cat: bz_match_score_bounded - same as bz_match_score, but stops as soon
+#cat:            as the score is known to be above or below a threshold
 #cat: bz_sift -  main routine handling the path linking and match table
 #cat:            traversal
 #cat: bz_final_loop - (declared static) a final postprocess after
@@ -79,42 +84,151 @@ of the software.
 ***********************************************************************/
 
 #include <stdio.h>
+#include <string.h>
 #include <bozorth.h>
 
-/***********************************************************************/
-void bz_comp(
-	int npoints,				/* INPUT: # of points */
-	int xcol[     MAX_BOZORTH_MINUTIAE ],	/* INPUT: x cordinates */
-	int ycol[     MAX_BOZORTH_MINUTIAE ],	/* INPUT: y cordinates */
-	int thetacol[ MAX_BOZORTH_MINUTIAE ],	/* INPUT: theta values */
+/* The pair loop of bz_comp() uses the generic vector extensions of GCC */
+/* and clang, which map to e.g. SSE2 or NEON. On x86, a second copy is  */
+/* built for AVX2 and selected at runtime.                              */
+#if defined(__GNUC__) && !defined(BZ_COMP_NO_VECTOR)
+#define BZ_COMP_VECTOR
+#define BZ_VEC_LEN 8
+typedef int bz_vec __attribute__(( vector_size( BZ_VEC_LEN * sizeof( int ) ) ));
+#if defined(__x86_64__) || defined(__i386__)
+#define BZ_COMP_AVX2
+#endif
+#endif
 
-	int * ncomparisons,			/* OUTPUT: number of pointwise comparisons */
-	int cols[][ COLS_SIZE_2 ],		/* OUTPUT: pointwise comparison table */
-	int * colptrs[]				/* INPUT and OUTPUT: sorted list of pointers to rows in cols[] */
-	)
+/***********************************************************************/
+/* The angle of the edge between two points, rounded to whole degrees. */
+/* This is only evaluated to fill the table in the matcher context.    */
+/***********************************************************************/
+static int bz_theta_kj( int dx, int dy )
 {
-int i, j, k;
+int theta_kj;
 
-int b;
-int t;
-int n;
-int l;
+if ( dx == 0 )
+	theta_kj = 90;
+else {
+	double dz;
 
-int table_index;
+	if ( 0 )
+		dz = ( 180.0F / PI_SINGLE ) * atanf( (float) -dy / (float) dx );
+	else
+		dz = ( 180.0F / PI_SINGLE ) * atanf( (float) dy / (float) dx );
+	if ( dz < 0.0F )
+		dz -= 0.5F;
+	else
+		dz += 0.5F;
+	theta_kj = (int) dz;
+}
 
-int dx;
-int dy;
-int distance;
+return theta_kj;
+}
+
+/***********************************************************************/
+/* Only edges up to a length of DM are stored, so the edge angle is    */
+/* looked up for all possible {dx,dy} instead of calling atanf() for   */
+/* every pair. Negating both dx and dy yields the exact same quotient, */
+/* so only dx >= 0 is stored. Also selects the pair loop for the CPU.  */
+/***********************************************************************/
+void bz_comp_init( struct bz_context * ctx )
+{
+int dx, dy;
+
+for ( dx = 0; dx <= DM; dx++ ) {
+	for ( dy = -DM; dy <= DM; dy++ ) {
+		ctx->theta_kj[dx][dy+DM] = bz_theta_kj( dx, dy );
+	}
+}
+
+ctx->comp_rows = bz_comp_rows_select( BZ_COMP_ROWS_BEST );
+}
 
+/***********************************************************************/
+/* Appends the row for the edge between points K and J to the table,   */
+/* returns 0 once the table is full.                                   */
+/***********************************************************************/
+static inline int bz_comp_add_row(
+	struct bz_context * ctx,
+	int thetacol[],
+	int k,
+	int j,
+	int dx,
+	int dy,
+	int distance,
+	int cols[][ COLS_SIZE_2 ],
+	int * table_index
+	)
+{
 int theta_kj;
 int beta_j;
 int beta_k;
-
 int * c;
 
+					/* The distance is in the range [ 0, 125^2 ] */
+if ( dx < 0 )
+	theta_kj = ctx->theta_kj[-dx][-dy+DM];
+else
+	theta_kj = ctx->theta_kj[dx][dy+DM];
+
+
+beta_k = theta_kj - thetacol[k];
+beta_k = IANGLE180(beta_k);
+
+beta_j = theta_kj - thetacol[j] + 180;
+beta_j = IANGLE180(beta_j);
+
+
+c = &cols[*table_index][0];
+if ( beta_k < beta_j ) {
+	*c++ = distance;
+	*c++ = beta_k;
+	*c++ = beta_j;
+	*c++ = k+1;
+	*c++ = j+1;
+	*c++ = theta_kj;
+} else {
+	*c++ = distance;
+	*c++ = beta_j;
+	*c++ = beta_k;
+	*c++ = k+1;
+	*c++ = j+1;
+	*c++ = theta_kj + 400;
+
+}
+
+
+++*table_index;
+if ( *table_index == 19999 ) {
+#ifndef NOVERBOSE
+	if ( 0 )
+		printf( "bz_comp(): breaking loop to avoid table overflow\n" );
+#endif
+	return 0;
+}
 
+return 1;
+}
 
-c = &cols[0][0];
+/***********************************************************************/
+/* Pairs all points, creating a table row for each edge that is short  */
+/* enough. Returns the number of rows in the unsorted table.           */
+/***********************************************************************/
+static int bz_comp_rows_scalar(
+	struct bz_context * ctx,
+	int npoints,
+	int xcol[],
+	int ycol[],
+	int thetacol[],
+	int cols[][ COLS_SIZE_2 ]
+	)
+{
+int j, k;
+int dx;
+int dy;
+int distance;
+int table_index;
 
 table_index = 0;
 for ( k = 0; k < npoints - 1; k++ ) {
@@ -143,126 +257,252 @@ for ( k = 0; k < npoints - 1; k++ ) {
 
 		}
 
-					/* The distance is in the range [ 0, 125^2 ] */
-		if ( dx == 0 )
-			theta_kj = 90;
-		else {
-			double dz;
-
-			if ( 0 )
-				dz = ( 180.0F / PI_SINGLE ) * atanf( (float) -dy / (float) dx );
-			else
-				dz = ( 180.0F / PI_SINGLE ) * atanf( (float) dy / (float) dx );
-			if ( dz < 0.0F )
-				dz -= 0.5F;
-			else
-				dz += 0.5F;
-			theta_kj = (int) dz;
-		}
-
-
-		beta_k = theta_kj - thetacol[k];
-		beta_k = IANGLE180(beta_k);
-
-		beta_j = theta_kj - thetacol[j] + 180;
-		beta_j = IANGLE180(beta_j);
-
-
-		if ( beta_k < beta_j ) {
-			*c++ = distance;
-			*c++ = beta_k;
-			*c++ = beta_j;
-			*c++ = k+1;
-			*c++ = j+1;
-			*c++ = theta_kj;
-		} else {
-			*c++ = distance;
-			*c++ = beta_j;
-			*c++ = beta_k;
-			*c++ = k+1;
-			*c++ = j+1;
-			*c++ = theta_kj + 400;
-
-		}
-
-
+		if ( ! bz_comp_add_row( ctx, thetacol, k, j, dx, dy, distance, cols, &table_index ) )
+			return table_index;
 
+	} /* END for j */
 
+} /* END for k */
 
+return table_index;
+}
 
-		b = 0;
-		t = table_index + 1;
-		l = 1;
-		n = -1;			/* Init binary search state ... */
+#ifdef BZ_COMP_VECTOR
+/***********************************************************************/
+/* Same as bz_comp_rows_scalar(), but tests BZ_VEC_LEN points J at a   */
+/* time using vector arithmetic. The rows are added in the same order. */
+/* Built once for the baseline instruction set (SSE2, NEON, ...) and   */
+/* once for AVX2 where supported.                                      */
+/***********************************************************************/
+static inline __attribute__(( always_inline )) int bz_comp_rows_vector(
+	struct bz_context * ctx,
+	int npoints,
+	int xcol[],
+	int ycol[],
+	int thetacol[],
+	int cols[][ COLS_SIZE_2 ]
+	)
+{
+int i, j, k;
+int dx;
+int dy;
+int distance;
+int table_index;
 
+table_index = 0;
+for ( k = 0; k < npoints - 1; k++ ) {
+	bz_vec xk = xcol[k] - (bz_vec) { 0 };
+	bz_vec yk = ycol[k] - (bz_vec) { 0 };
+	bz_vec tk = thetacol[k] - (bz_vec) { 0 };
 
+	for ( j = k + 1; j + BZ_VEC_LEN <= npoints; j += BZ_VEC_LEN ) {
+		bz_vec xj, yj, tj;
+		bz_vec vdx, vdy, vdist, opposite, skip, stop;
 
+		memcpy( &xj, &xcol[j], sizeof( xj ) );
+		memcpy( &yj, &ycol[j], sizeof( yj ) );
+		memcpy( &tj, &thetacol[j], sizeof( tj ) );
 
-		while ( t - b > 1 ) {
-			int * midpoint;
+		/* Pairs of points with opposite directions are skipped */
+		opposite = ( ( tj > 0 ) & ( tk == tj - 180 ) ) |
+		           ( ( tj <= 0 ) & ( tk == tj + 180 ) );
 
-			l = ( b + t ) / 2;
-			midpoint = colptrs[l-1];
+		vdx = xj - xk;
+		vdy = yj - yk;
+		vdist = vdx * vdx + vdy * vdy;
 
+		skip = opposite | ( vdist > SQUARED(DM) );
+		stop = ~opposite & ( vdist > SQUARED(DM) ) & ( vdx > DM );
 
+		for ( i = 0; i < BZ_VEC_LEN; i++ ) {
+			if ( stop[i] )
+				goto next_k;
+			if ( skip[i] )
+				continue;
 
+			if ( ! bz_comp_add_row( ctx, thetacol, k, j + i, vdx[i], vdy[i], vdist[i], cols, &table_index ) )
+				return table_index;
+		}
+	}
 
-			for ( i=0; i < 3; i++ ) {
-				int dd, ff;
+	for ( ; j < npoints; j++ ) {
+		if ( thetacol[j] > 0 ) {
+			if ( thetacol[k] == thetacol[j] - 180 )
+				continue;
+		} else {
+			if ( thetacol[k] == thetacol[j] + 180 )
+				continue;
+		}
 
-				dd = cols[table_index][i];
+		dx = xcol[j] - xcol[k];
+		dy = ycol[j] - ycol[k];
+		distance = SQUARED(dx) + SQUARED(dy);
+		if ( distance > SQUARED(DM) ) {
+			if ( dx > DM )
+				break;
+			else
+				continue;
+		}
 
-				ff = midpoint[i];
+		if ( ! bz_comp_add_row( ctx, thetacol, k, j, dx, dy, distance, cols, &table_index ) )
+			return table_index;
+	}
 
+next_k:
+	;
+}
 
-				n = SENSE(dd,ff);
+return table_index;
+}
 
+static int bz_comp_rows_baseline(
+	struct bz_context * ctx,
+	int npoints,
+	int xcol[],
+	int ycol[],
+	int thetacol[],
+	int cols[][ COLS_SIZE_2 ]
+	)
+{
+return bz_comp_rows_vector( ctx, npoints, xcol, ycol, thetacol, cols );
+}
 
-				if ( n < 0 ) {
-					t = l;
-					break;
-				}
-				if ( n > 0 ) {
-					b = l;
-					break;
-				}
-			}
+#ifdef BZ_COMP_AVX2
+__attribute__(( target( "avx2" ) ))
+static int bz_comp_rows_avx2(
+	struct bz_context * ctx,
+	int npoints,
+	int xcol[],
+	int ycol[],
+	int thetacol[],
+	int cols[][ COLS_SIZE_2 ]
+	)
+{
+return bz_comp_rows_vector( ctx, npoints, xcol, ycol, thetacol, cols );
+}
+#endif
+#endif
 
-			if ( n == 0 ) {
-				n = 1;
-				b = l;
-			}
-		} /* END while */
+/***********************************************************************/
+/* Returns the fastest pair loop the CPU supports, using no more than  */
+/* the instruction sets of LEVEL: BZ_COMP_ROWS_SCALAR, *_BASELINE for  */
+/* the vector loop built for the target, or *_BEST to also allow AVX2. */
+/***********************************************************************/
+bz_comp_rows_func bz_comp_rows_select( int level )
+{
+if ( level == BZ_COMP_ROWS_SCALAR )
+	return bz_comp_rows_scalar;
+
+#ifdef BZ_COMP_AVX2
+if ( level >= BZ_COMP_ROWS_BEST ) {
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "avx2" ) )
+		return bz_comp_rows_avx2;
+}
+#endif
 
-		if ( n == 1 )
-			++l;
+#ifdef BZ_COMP_VECTOR
+return bz_comp_rows_baseline;
+#else
+return bz_comp_rows_scalar;
+#endif
+}
 
+/***********************************************************************/
+/* Rows are sorted on distance, then min and max beta. Rows that are   */
+/* equal keep their order, which is the order inserting every new row  */
+/* after all equal ones used to give. The sort key packs these values  */
+/* and the row index into one integer: the distance is at most DM^2    */
+/* (14 bits), the betas are in ( -180, 180 ] (9 bits each) and there   */
+/* are less than 2^15 rows.                                            */
+/***********************************************************************/
+#define BZ_COMP_KEY(row,index)	( ( (unsigned long long) (row)[0] << 33 ) | \
+				  ( (unsigned long long) ( (row)[1] + 180 ) << 24 ) | \
+				  ( (unsigned long long) ( (row)[2] + 180 ) << 15 ) | \
+				  (unsigned long long) (index) )
+#define BZ_COMP_KEY_INDEX(key)	( (int) ( (key) & 0x7fff ) )
 
+static void bz_comp_sort( unsigned long long keys[], unsigned long long tmp[], int n )
+{
+unsigned long long * src;
+unsigned long long * dst;
+unsigned long long * swap;
+unsigned long long v;
+int width;
+int lo, mid, hi;
+int i, j, k;
 
+/* Insertion sort short runs first */
+for ( lo = 0; lo < n; lo += 8 ) {
+	hi = ( lo + 8 < n ) ? lo + 8 : n;
+	for ( i = lo + 1; i < hi; i++ ) {
+		v = keys[i];
+		for ( j = i; j > lo && keys[j-1] > v; j-- )
+			keys[j] = keys[j-1];
+		keys[j] = v;
+	}
+}
 
-		for ( i = table_index; i >= l; --i )
-			colptrs[i] = colptrs[i-1];
+/* Then merge them bottom up, alternating between both arrays */
+src = keys;
+dst = tmp;
+for ( width = 8; width < n; width *= 2 ) {
+	for ( lo = 0; lo < n; lo += 2 * width ) {
+		mid = ( lo + width < n ) ? lo + width : n;
+		hi = ( lo + 2 * width < n ) ? lo + 2 * width : n;
+		i = lo;
+		j = mid;
+		k = lo;
+		while ( i < mid && j < hi ) {
+			if ( src[j] < src[i] )
+				dst[k++] = src[j++];
+			else
+				dst[k++] = src[i++];
+		}
+		while ( i < mid )
+			dst[k++] = src[i++];
+		while ( j < hi )
+			dst[k++] = src[j++];
+	}
+	swap = src;
+	src = dst;
+	dst = swap;
+}
 
+if ( src != keys )
+	memcpy( keys, src, n * sizeof( keys[0] ) );
+}
 
-		colptrs[l-1] = &cols[table_index][0];
-		++table_index;
+/***********************************************************************/
+void bz_comp(
+	struct bz_context * ctx,		/* INPUT: matcher context with working tables */
+	int npoints,				/* INPUT: # of points */
+	int xcol[     MAX_BOZORTH_MINUTIAE ],	/* INPUT: x cordinates */
+	int ycol[     MAX_BOZORTH_MINUTIAE ],	/* INPUT: y cordinates */
+	int thetacol[ MAX_BOZORTH_MINUTIAE ],	/* INPUT: theta values */
 
+	int * ncomparisons,			/* OUTPUT: number of pointwise comparisons */
+	int cols[][ COLS_SIZE_2 ],		/* OUTPUT: pointwise comparison table */
+	int * colptrs[]				/* INPUT and OUTPUT: sorted list of pointers to rows in cols[] */
+	)
+{
+int i;
+int table_index;
 
-		if ( table_index == 19999 ) {
-#ifndef NOVERBOSE
-			if ( 0 )
-				printf( "bz_comp(): breaking loop to avoid table overflow\n" );
-#endif
-			goto COMP_END;
-		}
+/* Rows used to be inserted into the sorted pointer list one at a time, */
+/* shifting on average half of the list for every row. Collecting all   */
+/* rows first and sorting them once gives the same list.                */
+table_index = ctx->comp_rows( ctx, npoints, xcol, ycol, thetacol, cols );
 
-	} /* END for j */
+for ( i = 0; i < table_index; i++ )
+	ctx->comp_keys[i] = BZ_COMP_KEY( cols[i], i );
 
-} /* END for k */
+bz_comp_sort( ctx->comp_keys, ctx->comp_keys_tmp, table_index );
 
-COMP_END:
-	*ncomparisons = table_index;
+for ( i = 0; i < table_index; i++ )
+	colptrs[i] = &cols[ BZ_COMP_KEY_INDEX( ctx->comp_keys[i] ) ][0];
 
+*ncomparisons = table_index;
 }
 
 /***********************************************************************/
@@ -342,6 +582,7 @@ while ( shiftcount-- > 0 ) {
 /* Return value is the # of compatible edge pairs           */
 /***********************************************************************/
 int bz_match(
+	struct bz_context * ctx,	/* INOUT:  matcher working tables */
 	int probe_ptrlist_len,		/* INPUT:  pruned length of Subject's pointer list */
 	int gallery_ptrlist_len		/* INPUT:  pruned length of On-File Record's pointer list */
 	)
@@ -366,21 +607,12 @@ int t;			/* Top of search range */
 register int * rotptr;
 
 
-#define ROT_SIZE_1 20000
-#define ROT_SIZE_2 5
-
-static int rot[ ROT_SIZE_1 ][ ROT_SIZE_2 ];
-
-
-static int * rtp[ ROT_SIZE_1 ];
-
-
-
-
-/* These now externally defined in bozorth.h */
-/* extern int * scolpt[ SCOLPT_SIZE ];			 INPUT */
-/* extern int * fcolpt[ FCOLPT_SIZE ];			 INPUT */
-/* extern int   colp[ COLP_SIZE_1 ][ COLP_SIZE_2 ];	 OUTPUT */
+/* These are now part of the matcher context */
+/* ctx->scolpt[ SCOLPT_SIZE ];			 INPUT */
+/* ctx->fcolpt[ FCOLPT_SIZE ];			 INPUT */
+/* ctx->colp[ COLP_SIZE_1 ][ COLP_SIZE_2 ];	 OUTPUT */
+/* ctx->rot[ ROT_SIZE_1 ][ ROT_SIZE_2 ];	 WORKSPACE */
+/* ctx->rtp[ ROT_SIZE_1 ];			 WORKSPACE */
 /* extern int 0; */
 /* extern FILE * stderr; */
 /* extern char * get_progname( void ); */
@@ -393,17 +625,17 @@ static int * rtp[ ROT_SIZE_1 ];
 
 st = 1;
 edge_pair_index = 0;
-rotptr = &rot[0][0];
+rotptr = &ctx->rot[0][0];
 
 /* Foreach sorted edge in Subject's Web ... */
 
 for ( k = 1; k < probe_ptrlist_len; k++ ) {
-	ss = scolpt[k-1];
+	ss = ctx->scolpt[k-1];
 
 	/* Foreach sorted edge in On-File Record's Web ... */
 
 	for ( j = st; j <= gallery_ptrlist_len; j++ ) {
-		ff = fcolpt[j-1];
+		ff = ctx->fcolpt[j-1];
 		dz = *ff - *ss;
 
 		fi = ( 2.0F * TK ) * ( *ff + *ss );
@@ -530,8 +762,8 @@ for ( k = 1; k < probe_ptrlist_len; k++ ) {
 								/*	2 = Subject's Jth */
 
 				ii = ii_table[i];
-				p1 = rot[edge_pair_index][ii];
-				p2 = *( rtp[l-1] + ii );
+				p1 = ctx->rot[edge_pair_index][ii];
+				p2 = *( ctx->rtp[l-1] + ii );
 
 				n = SENSE(p1,p2);
 
@@ -555,7 +787,7 @@ for ( k = 1; k < probe_ptrlist_len; k++ ) {
 		if ( n == 1 )
 			++l;
 
-		rtp_insert( rtp, l, edge_pair_index, &rot[edge_pair_index][0] );
+		rtp_insert( ctx->rtp, l, edge_pair_index, &ctx->rot[edge_pair_index][0] );
 		++edge_pair_index;
 
 		if ( edge_pair_index == 19999 ) {
@@ -575,10 +807,10 @@ for ( k = 1; k < probe_ptrlist_len; k++ ) {
 
 END:
 {
-	int * colp_ptr = &colp[0][0];
+	int * colp_ptr = &ctx->colp[0][0];
 
 	for ( i = 0; i < edge_pair_index; i++ ) {
-		INT_COPY( colp_ptr, rtp[i], COLP_SIZE_2 );
+		INT_COPY( colp_ptr, ctx->rtp[i], COLP_SIZE_2 );
 
 
 	}
@@ -590,24 +822,41 @@ return edge_pair_index;			/* Return the number of compatible edge pairs stored i
 }
 
 /**************************************************************************/
-/* These global arrays are declared "static" as they are only used        */
-/* between bz_match_score() & bz_final_loop()                             */
+/* The ct[], gct[], ctt[], ctp[] and yy[] arrays of the matcher context   */
+/* are only used between bz_match_score() & bz_final_loop()               */
 /**************************************************************************/
-static int ct[ CT_SIZE ];
-static int gct[ GCT_SIZE ];
-static int ctt[ CTT_SIZE ];
-static int ctp[ CTP_SIZE_1 ][ CTP_SIZE_2 ];
-static int yy[ YY_SIZE_1 ][ YY_SIZE_2 ][ YY_SIZE_3 ];
-
-static int    bz_final_loop( int );
+static int    bz_final_loop( struct bz_context *, int, int );
 
 /**************************************************************************/
 int bz_match_score(
+	struct bz_context * ctx,
 	int np,
 	struct xyt_struct * pstruct,
 	struct xyt_struct * gstruct
 	)
 {
+return bz_match_score_bounded( ctx, np, pstruct, gstruct, 0 );
+}
+
+/**************************************************************************/
+/* With a THRESHOLD > 0, the returned score is only guaranteed to be on   */
+/* the same side of THRESHOLD as the real score:                          */
+/*  - A cluster's TOT is a lower bound for the final score, so traversal  */
+/*    stops once a single cluster reaches THRESHOLD.                      */
+/*  - Clusters started at edge pair K only contain edge pairs from K on,  */
+/*    and combined clusters never share edge pairs, so the final score    */
+/*    is at most MATCH_SCORE + NP - K. Traversal stops once that can not  */
+/*    reach THRESHOLD anymore.                                            */
+/* As traversal may stop early, a later qq[] overflow is not reported.    */
+/**************************************************************************/
+int bz_match_score_bounded(
+	struct bz_context * ctx,
+	int np,
+	struct xyt_struct * pstruct,
+	struct xyt_struct * gstruct,
+	int threshold
+	)
+{
 int kx, kq;
 int ftt;
 int tot;
@@ -680,16 +929,16 @@ if ( gstruct->nrows < MIN_COMPUTABLE_BOZORTH_MINUTIAE ) {
 
 
 								/* initialize tables to 0's */
-INT_SET( (int *) &yl, YL_SIZE_1 * YL_SIZE_2, 0 );
+INT_SET( (int *) &ctx->yl, YL_SIZE_1 * YL_SIZE_2, 0 );
 
 
 
-INT_SET( (int *) &sc, SC_SIZE, 0 );
-INT_SET( (int *) &cp, CP_SIZE, 0 );
-INT_SET( (int *) &rp, RP_SIZE, 0 );
-INT_SET( (int *) &tq, TQ_SIZE, 0 );
-INT_SET( (int *) &rq, RQ_SIZE, 0 );
-INT_SET( (int *) &zz, ZZ_SIZE, 1000 );				/* zz[] initialized to 1000's */
+INT_SET( (int *) &ctx->sc, SC_SIZE, 0 );
+INT_SET( (int *) &ctx->cp, CP_SIZE, 0 );
+INT_SET( (int *) &ctx->rp, RP_SIZE, 0 );
+INT_SET( (int *) &ctx->tq, TQ_SIZE, 0 );
+INT_SET( (int *) &ctx->rq, RQ_SIZE, 0 );
+INT_SET( (int *) &ctx->zz, ZZ_SIZE, 1000 );				/* zz[] initialized to 1000's */
 
 INT_SET( (int *) &avn, AVN_SIZE, 0 );				/* avn[0...4] <== 0; */
 
@@ -706,19 +955,23 @@ match_score = 0;
 for ( k = 0; k < np - 1; k++ ) {
 					/* printf( "compute(): looping with k=%d\n", k ); */
 
-	if ( sc[k] )			/* If SC counter for current pair already incremented ... */
+	if ( ctx->sc[k] )			/* If SC counter for current pair already incremented ... */
 		continue;		/*		Skip to next pair */
 
 
-	i = colp[k][1];
-	t = colp[k][3];
+	if ( threshold > 0 && match_score + np - k < threshold )
+		return match_score;	/* Remaining edge pairs can not raise the score to THRESHOLD */
+
+
+	i = ctx->colp[k][1];
+	t = ctx->colp[k][3];
 
 
 
 
-	qq[0]   = i;
-	rq[t-1] = i;
-	tq[i-1] = t;
+	ctx->qq[0]   = i;
+	ctx->rq[t-1] = i;
+	ctx->tq[i-1] = t;
 
 
 	ww = 0;
@@ -743,10 +996,10 @@ for ( k = 0; k < np - 1; k++ ) {
 
 
 
-			kz = colp[kx][2];
-			l  = colp[kx][4];
+			kz = ctx->colp[kx][2];
+			l  = ctx->colp[kx][4];
 			kx++;
-			bz_sift( &ww, kz, &qh, l, kx, ftt, &tot, &qq_overflow );
+			bz_sift( ctx, &ww, kz, &qh, l, kx, ftt, &tot, &qq_overflow );
 			if ( qq_overflow ) {
 				fprintf( stderr, "%s: WARNING: bz_match_score(): qq[] overflow from bz_sift() #1 [p=%s; g=%s]\n",
 							get_progname(), get_probe_filename(), get_gallery_filename() );
@@ -755,10 +1008,10 @@ for ( k = 0; k < np - 1; k++ ) {
 
 #ifndef NOVERBOSE
 			if ( 0 )
-				printf( "x1 %d %d %d %d %d %d\n", kx, colp[kx][0], colp[kx][1], colp[kx][2], colp[kx][3], colp[kx][4] );
+				printf( "x1 %d %d %d %d %d %d\n", kx, ctx->colp[kx][0], ctx->colp[kx][1], ctx->colp[kx][2], ctx->colp[kx][3], ctx->colp[kx][4] );
 #endif
 
-		} while ( colp[kx][3] == colp[k][3] && colp[kx][1] == colp[k][1] );
+		} while ( ctx->colp[kx][3] == ctx->colp[k][3] && ctx->colp[kx][1] == ctx->colp[k][1] );
 			/* While the startpoints of lookahead edge pairs are the same as the starting points of the */
 			/* current pair, set KQ to lookahead edge pair index where above bz_sift() loop left off */
 
@@ -774,9 +1027,9 @@ for ( k = 0; k < np - 1; k++ ) {
 								get_progname(), j-1, get_probe_filename(), get_gallery_filename() );
 							return QQ_OVERFLOW_SCORE;
 						}
-						p1 = qq[j];
+						p1 = ctx->qq[j];
 					} else {
-						p1 = tq[p1-1];
+						p1 = ctx->tq[p1-1];
 
 					}
 
@@ -785,20 +1038,20 @@ for ( k = 0; k < np - 1; k++ ) {
 
 
 
-					if ( colp[i][2*z] != p1 )
+					if ( ctx->colp[i][2*z] != p1 )
 						break;
 				}
 
 
 				if ( z == 3 ) {
-					z = colp[i][1];
-					l = colp[i][3];
+					z = ctx->colp[i][1];
+					l = ctx->colp[i][3];
 
 
 
-					if ( z != colp[k][1] && l != colp[k][3] ) {
+					if ( z != ctx->colp[k][1] && l != ctx->colp[k][3] ) {
 						kx = i + 1;
-						bz_sift( &ww, z, &qh, l, kx, ftt, &tot, &qq_overflow );
+						bz_sift( ctx, &ww, z, &qh, l, kx, ftt, &tot, &qq_overflow );
 						if ( qq_overflow ) {
 							fprintf( stderr, "%s: WARNING: bz_match_score(): qq[] overflow from bz_sift() #2 [p=%s; g=%s]\n",
 								get_progname(), get_probe_filename(), get_gallery_filename() );
@@ -830,14 +1083,14 @@ for ( k = 0; k < np - 1; k++ ) {
 								get_progname(), j-1, get_probe_filename(), get_gallery_filename() );
 							return QQ_OVERFLOW_SCORE;
 						}
-						p1 = qq[j];
+						p1 = ctx->qq[j];
 					} else {
-						p1 = tq[p1-1];
+						p1 = ctx->tq[p1-1];
 					}
 
 
 
-					p2 = colp[l-1][i*2-1];
+					p2 = ctx->colp[l-1][i*2-1];
 
 					n = SENSE(p1,p2);
 
@@ -859,23 +1112,23 @@ for ( k = 0; k < np - 1; k++ ) {
 
 
 					/* Locates the head of consecutive sequence of edge pairs all having the same starting Subject and On-File edgepoints */
-					while ( colp[l-2][3] == p2 && colp[l-2][1] == colp[l-1][1] )
+					while ( ctx->colp[l-2][3] == p2 && ctx->colp[l-2][1] == ctx->colp[l-1][1] )
 						l--;
 
 					kx = l - 1;
 
 
 					do {
-						kz = colp[kx][2];
-						l  = colp[kx][4];
+						kz = ctx->colp[kx][2];
+						l  = ctx->colp[kx][4];
 						kx++;
-						bz_sift( &ww, kz, &qh, l, kx, ftt, &tot, &qq_overflow );
+						bz_sift( ctx, &ww, kz, &qh, l, kx, ftt, &tot, &qq_overflow );
 						if ( qq_overflow ) {
 							fprintf( stderr, "%s: WARNING: bz_match_score(): qq[] overflow from bz_sift() #3 [p=%s; g=%s]\n",
 								get_progname(), get_probe_filename(), get_gallery_filename() );
 							return QQ_OVERFLOW_SCORE;
 						}
-					} while ( colp[kx][3] == p2 && colp[kx][1] == colp[kx-1][1] );
+					} while ( ctx->colp[kx][3] == p2 && ctx->colp[kx][1] == ctx->colp[kx-1][1] );
 
 					break;
 				} /* END if ( n == 0 ) */
@@ -896,7 +1149,7 @@ for ( k = 0; k < np - 1; k++ ) {
 			for ( i = 0; i < tot; i++ ) {
 
 
-				int colp_value = colp[ bz_y[i]-1 ][0];
+				int colp_value = ctx->colp[ ctx->bz_y[i]-1 ][0];
 				if ( colp_value < 0 ) {
 					kk += colp_value;
 					n++;
@@ -933,7 +1186,7 @@ for ( k = 0; k < np - 1; k++ ) {
 
 			kk = 0;
 			for ( i = 0; i < tot; i++ ) {
-				int diff = colp[ bz_y[i]-1 ][0] - jj;
+				int diff = ctx->colp[ ctx->bz_y[i]-1 ][0] - jj;
 				j = SQUARED( diff );
 
 
@@ -942,7 +1195,7 @@ for ( k = 0; k < np - 1; k++ ) {
 				if ( j > TXS && j < CTXS )
 					kk++;
 				else
-					bz_y[i-kk] = bz_y[i];
+					ctx->bz_y[i-kk] = ctx->bz_y[i];
 			} /* END FOR i */
 
 			tot -= kk;				/* Adjust the total edge pairs TOT based on # of edge pairs skipped */
@@ -958,11 +1211,11 @@ for ( k = 0; k < np - 1; k++ ) {
 
 
 			for ( i = tot-1 ; i >= 0; i-- ) {
-				int idx = bz_y[i] - 1;
-				if ( rk[idx] == 0 ) {
-					sc[idx] = -1;
+				int idx = ctx->bz_y[i] - 1;
+				if ( ctx->rk[idx] == 0 ) {
+					ctx->sc[idx] = -1;
 				} else {
-					sc[idx] = rk[idx];
+					ctx->sc[idx] = ctx->rk[idx];
 				}
 			}
 			ftt--;
@@ -976,7 +1229,7 @@ for ( k = 0; k < np - 1; k++ ) {
 			int pd = 0;
 
 			for ( i = 0; i < tot; i++ ) {
-				int idx = bz_y[i] - 1;
+				int idx = ctx->bz_y[i] - 1;
 				for ( ii = 1; ii < 4; ii++ ) {
 
 
@@ -987,15 +1240,15 @@ for ( k = 0; k < np - 1; k++ ) {
 
 
 
-					jj = colp[idx][kk];
+					jj = ctx->colp[idx][kk];
 
 					switch ( ii ) {
 					  case 1:
-						if ( colp[idx][0] < 0 ) {
-							pd += colp[idx][0];
+						if ( ctx->colp[idx][0] < 0 ) {
+							pd += ctx->colp[idx][0];
 							pb++;
 						} else {
-							pa += colp[idx][0];
+							pa += ctx->colp[idx][0];
 							pc++;
 						}
 						break;
@@ -1025,15 +1278,15 @@ for ( k = 0; k < np - 1; k++ ) {
 
 
 
-						p1 = colp[idx][ 2 * ii + jj ];
+						p1 = ctx->colp[idx][ 2 * ii + jj ];
 
 
 						b = 0;
-						t = yl[ii][tp] + 1;
+						t = ctx->yl[ii][tp] + 1;
 
 						while ( t - b > 1 ) {
 							l  = ( b + t ) / 2;
-							p2 = yy[l-1][ii][tp];
+							p2 = ctx->yy[l-1][ii][tp];
 							n  = SENSE(p1,p2);
 
 							if ( n < 0 ) {
@@ -1051,12 +1304,12 @@ for ( k = 0; k < np - 1; k++ ) {
 							if ( n == 1 )
 								++l;
 
-							for ( kk = yl[ii][tp]; kk >= l; --kk ) {
-								yy[kk][ii][tp] = yy[kk-1][ii][tp];
+							for ( kk = ctx->yl[ii][tp]; kk >= l; --kk ) {
+								ctx->yy[kk][ii][tp] = ctx->yy[kk-1][ii][tp];
 							}
 
-							++yl[ii][tp];
-							yy[l-1][ii][tp] = p1;
+							++ctx->yl[ii][tp];
+							ctx->yy[l-1][ii][tp] = p1;
 
 
 						} /* END if ( n != 0 ) */
@@ -1098,14 +1351,17 @@ for ( k = 0; k < np - 1; k++ ) {
 				avn[ii] = 0;
 			}
 
-			ct[tp]  = tot;
-			gct[tp] = tot;
+			ctx->ct[tp]  = tot;
+			ctx->gct[tp] = tot;
+
+			if ( threshold > 0 && tot >= threshold )
+				return tot;	/* Final score is at least TOT */
 
 			if ( tot > match_score )		/* If current TOT > match_score ... */
 				match_score = tot;		/*	Keep track of max TOT in match_score */
 
-			ctt[tp]    = 0;		/* Init CTT[TP] to 0 */
-			ctp[tp][0] = tp;	/* Store TP into CTP */
+			ctx->ctt[tp]    = 0;		/* Init CTT[TP] to 0 */
+			ctx->ctp[tp][0] = tp;	/* Store TP into CTP */
 
 			for ( ii = 0; ii < tp; ii++ ) {
 				int found;
@@ -1294,7 +1550,7 @@ for ( k = 0; k < np - 1; k++ ) {
 					ll = 0;
 
 					do {
-						while ( yy[jj][kk][ii] < yy[ll][kk][tp] && jj < yl[kk][ii] ) {
+						while ( ctx->yy[jj][kk][ii] < ctx->yy[ll][kk][tp] && jj < ctx->yl[kk][ii] ) {
 
 							jj++;
 						}
@@ -1302,7 +1558,7 @@ for ( k = 0; k < np - 1; k++ ) {
 
 
 
-						while ( yy[jj][kk][ii] > yy[ll][kk][tp] && ll < yl[kk][tp] ) {
+						while ( ctx->yy[jj][kk][ii] > ctx->yy[ll][kk][tp] && ll < ctx->yl[kk][tp] ) {
 
 							ll++;
 						}
@@ -1310,23 +1566,23 @@ for ( k = 0; k < np - 1; k++ ) {
 
 
 
-						if ( yy[jj][kk][ii] == yy[ll][kk][tp] && jj < yl[kk][ii] && ll < yl[kk][tp] ) {
+						if ( ctx->yy[jj][kk][ii] == ctx->yy[ll][kk][tp] && jj < ctx->yl[kk][ii] && ll < ctx->yl[kk][tp] ) {
 							found = 1;
 							break;
 						}
 
 
-					} while ( jj < yl[kk][ii] && ll < yl[kk][tp] );
+					} while ( jj < ctx->yl[kk][ii] && ll < ctx->yl[kk][tp] );
 					if ( found )
 						break;
 				} /* END for kk */
 
 				if ( ! found ) {			/* If we didn't find what we were searching for ... */
-					gct[ii] += ct[tp];
-					if ( gct[ii] > match_score )
-						match_score = gct[ii];
-					++ctt[ii];
-					ctp[ii][ctt[ii]] = tp;
+					ctx->gct[ii] += ctx->ct[tp];
+					if ( ctx->gct[ii] > match_score )
+						match_score = ctx->gct[ii];
+					++ctx->ctt[ii];
+					ctx->ctp[ii][ctx->ctt[ii]] = tp;
 				}
 
 			} /* END for ii in [0,TP-1] prior TP group */
@@ -1344,55 +1600,55 @@ for ( k = 0; k < np - 1; k++ ) {
 			return QQ_OVERFLOW_SCORE;
 		}
 		for ( i = qh - 1; i > 0; i-- ) {
-			n = qq[i] - 1;
-			if ( ( tq[n] - 1 ) >= 0 ) {
-				rq[tq[n]-1] = 0;
-				tq[n]       = 0;
-				zz[n]       = 1000;
+			n = ctx->qq[i] - 1;
+			if ( ( ctx->tq[n] - 1 ) >= 0 ) {
+				ctx->rq[ctx->tq[n]-1] = 0;
+				ctx->tq[n]       = 0;
+				ctx->zz[n]       = 1000;
 			}
 		}
 
 		for ( i = dw - 1; i >= 0; i-- ) {
 			n = rr[i] - 1;
-			if ( tq[n] ) {
-				rq[tq[n]-1] = 0;
-				tq[n]       = 0;
+			if ( ctx->tq[n] ) {
+				ctx->rq[ctx->tq[n]-1] = 0;
+				ctx->tq[n]       = 0;
 			}
 		}
 
 		i = 0;
 		j = ww - 1;
 		while ( i >= 0 && j >= 0 ) {
-			if ( nn[j] < mm[j] ) {
-				++nn[j];
+			if ( ctx->nn[j] < ctx->mm[j] ) {
+				++ctx->nn[j];
 
 				for ( i = ww - 1; i >= 0; i-- ) {
-					int rt = rx[i];
+					int rt = ctx->rx[i];
 					if ( rt < 0 ) {
 						rt = - rt;
 						rt--;
-						z  = rf[i][nn[i]-1]-1;
+						z  = ctx->rf[i][ctx->nn[i]-1]-1;
 
 
 
-						if (( tq[z] != (rt+1) && tq[z] ) || ( rq[rt] != (z+1) && rq[rt] ))
+						if (( ctx->tq[z] != (rt+1) && ctx->tq[z] ) || ( ctx->rq[rt] != (z+1) && ctx->rq[rt] ))
 							break;
 
 
-						tq[z]  = rt+1;
-						rq[rt] = z+1;
+						ctx->tq[z]  = rt+1;
+						ctx->rq[rt] = z+1;
 						rr[i]  = z+1;
 					} else {
 						rt--;
-						z = cf[i][nn[i]-1]-1;
+						z = ctx->cf[i][ctx->nn[i]-1]-1;
 
 
-						if (( tq[rt] != (z+1) && tq[rt] ) || ( rq[z] != (rt+1) && rq[z] ))
+						if (( ctx->tq[rt] != (z+1) && ctx->tq[rt] ) || ( ctx->rq[z] != (rt+1) && ctx->rq[z] ))
 							break;
 
 
-						tq[rt] = z+1;
-						rq[z]  = rt+1;
+						ctx->tq[rt] = z+1;
+						ctx->rq[z]  = rt+1;
 						rr[i]  = rt+1;
 					}
 				} /* END for i */
@@ -1400,16 +1656,16 @@ for ( k = 0; k < np - 1; k++ ) {
 				if ( i >= 0 ) {
 					for ( z = i + 1; z < ww; z++) {
 						n = rr[z] - 1;
-						if ( tq[n] - 1 >= 0 ) {
-							rq[tq[n]-1] = 0;
-							tq[n]       = 0;
+						if ( ctx->tq[n] - 1 >= 0 ) {
+							ctx->rq[ctx->tq[n]-1] = 0;
+							ctx->tq[n]       = 0;
 						}
 					}
 					j = ww - 1;
 				}
 
 			} else {
-				nn[j] = 1;
+				ctx->nn[j] = 1;
 				j--;
 			}
 
@@ -1430,19 +1686,19 @@ for ( k = 0; k < np - 1; k++ ) {
 
 
 
-	n = qq[0] - 1;
-	if ( tq[n] - 1 >= 0 ) {
-		rq[tq[n]-1] = 0;
-		tq[n]       = 0;
+	n = ctx->qq[0] - 1;
+	if ( ctx->tq[n] - 1 >= 0 ) {
+		ctx->rq[ctx->tq[n]-1] = 0;
+		ctx->tq[n]       = 0;
 	}
 
 	for ( i = ww-1; i >= 0; i-- ) {
-		n = rx[i];
+		n = ctx->rx[i];
 		if ( n < 0 ) {
 			n = - n;
-			rp[n-1] = 0;
+			ctx->rp[n-1] = 0;
 		} else {
-			cp[n-1] = 0;
+			ctx->cp[n-1] = 0;
 		}
 
 	}
@@ -1455,30 +1711,33 @@ if ( match_score < MMSTR ) {
 	return match_score;
 }
 
-match_score = bz_final_loop( tp );
+if ( threshold > 0 && match_score < threshold )
+	return match_score;		/* Combined clusters never exceed the largest GCT[] */
+
+match_score = bz_final_loop( ctx, tp, threshold );
 return match_score;
 }
 
 
 /***********************************************************************/
-/* These globals signficantly used by bz_sift () */
-/* Now externally defined in bozorth.h */
-/* extern int sc[ SC_SIZE ]; */
-/* extern int rq[ RQ_SIZE ]; */
-/* extern int tq[ TQ_SIZE ]; */
-/* extern int rf[ RF_SIZE_1 ][ RF_SIZE_2 ]; */
-/* extern int cf[ CF_SIZE_1 ][ CF_SIZE_2 ]; */
-/* extern int zz[ ZZ_SIZE ]; */
-/* extern int rx[ RX_SIZE ]; */
-/* extern int mm[ MM_SIZE ]; */
-/* extern int nn[ NN_SIZE ]; */
-/* extern int qq[ QQ_SIZE ]; */
-/* extern int rk[ RK_SIZE ]; */
-/* extern int cp[ CP_SIZE ]; */
-/* extern int rp[ RP_SIZE ]; */
-/* extern int bz_y[ Y_SIZE ]; */
+/* These context tables signficantly used by bz_sift () */
+/* ctx->sc[ SC_SIZE ]; */
+/* ctx->rq[ RQ_SIZE ]; */
+/* ctx->tq[ TQ_SIZE ]; */
+/* ctx->rf[ RF_SIZE_1 ][ RF_SIZE_2 ]; */
+/* ctx->cf[ CF_SIZE_1 ][ CF_SIZE_2 ]; */
+/* ctx->zz[ ZZ_SIZE ]; */
+/* ctx->rx[ RX_SIZE ]; */
+/* ctx->mm[ MM_SIZE ]; */
+/* ctx->nn[ NN_SIZE ]; */
+/* ctx->qq[ QQ_SIZE ]; */
+/* ctx->rk[ RK_SIZE ]; */
+/* ctx->cp[ CP_SIZE ]; */
+/* ctx->rp[ RP_SIZE ]; */
+/* ctx->bz_y[ Y_SIZE ]; */
 
 void bz_sift(
+	struct bz_context * ctx,	/* INPUT and OUTPUT; matcher working tables */
 	int * ww,		/* INPUT and OUTPUT; endpoint groups index; *ww may be bumped by one or by two */
 	int   kz,		/* INPUT only;       endpoint of lookahead Subject edge */
 	int * qh,		/* INPUT and OUTPUT; the value is an index into qq[] and is stored in zz[]; *qh may be bumped by one */
@@ -1500,16 +1759,16 @@ int t;
 
 
 
-n = tq[ kz - 1];	/* Lookup On-File edgepoint stored in TQ at index of endpoint of lookahead Subject edge */
-t = rq[ l  - 1];	/* Lookup Subject edgepoint stored in RQ at index of endpoint of lookahead On-File edge */
+n = ctx->tq[ kz - 1];	/* Lookup On-File edgepoint stored in TQ at index of endpoint of lookahead Subject edge */
+t = ctx->rq[ l  - 1];	/* Lookup Subject edgepoint stored in RQ at index of endpoint of lookahead On-File edge */
 
 if ( n == 0 && t == 0 ) {
 
 
-	if ( sc[kx-1] != ftt ) {
-		bz_y[ (*tot)++ ] = kx;
-		rk[kx-1] = sc[kx-1];
-		sc[kx-1] = ftt;
+	if ( ctx->sc[kx-1] != ftt ) {
+		ctx->bz_y[ (*tot)++ ] = kx;
+		ctx->rk[kx-1] = ctx->sc[kx-1];
+		ctx->sc[kx-1] = ftt;
 	}
 
 	if ( *qh >= QQ_SIZE ) {
@@ -1519,13 +1778,13 @@ if ( n == 0 && t == 0 ) {
 		*qq_overflow = 1;
 		return;
 	}
-	qq[ *qh ]  = kz;
-	zz[ kz-1 ] = (*qh)++;
+	ctx->qq[ *qh ]  = kz;
+	ctx->zz[ kz-1 ] = (*qh)++;
 
 
 				/* The TQ and RQ locations are set, so set them ... */
-	tq[ kz-1 ] = l;
-	rq[ l-1 ] = kz;
+	ctx->tq[ kz-1 ] = l;
+	ctx->rq[ l-1 ] = kz;
 
 	return;
 } /* END if ( n == 0 && t == 0 ) */
@@ -1540,8 +1799,8 @@ if ( n == 0 && t == 0 ) {
 
 if ( n == l ) {
 
-	if ( sc[kx-1] != ftt ) {
-		if ( zz[kx-1] == 1000 ) {
+	if ( ctx->sc[kx-1] != ftt ) {
+		if ( ctx->zz[kx-1] == 1000 ) {
 			if ( *qh >= QQ_SIZE ) {
 				fprintf( stderr, "%s: ERROR: bz_sift(): qq[] overflow #2; the index [*qh] is %d [p=%s; g=%s]\n",
 							get_progname(),
@@ -1550,12 +1809,12 @@ if ( n == l ) {
 				*qq_overflow = 1;
 				return;
 			}
-			qq[*qh]  = kz;
-			zz[kz-1] = (*qh)++;
+			ctx->qq[*qh]  = kz;
+			ctx->zz[kz-1] = (*qh)++;
 		}
-		bz_y[(*tot)++] = kx;
-		rk[kx-1] = sc[kx-1];
-		sc[kx-1] = ftt;
+		ctx->bz_y[(*tot)++] = kx;
+		ctx->rk[kx-1] = ctx->sc[kx-1];
+		ctx->sc[kx-1] = ftt;
 	}
 
 	return;
@@ -1580,22 +1839,22 @@ register int * lptr;
 /* If lookahead Subject endpoint previously assigned to TQ but not paired with lookahead On-File endpoint ... */
 
 if ( n ) {
-	b = cp[ kz - 1 ];
+	b = ctx->cp[ kz - 1 ];
 	if ( b == 0 ) {
 		b              = ++*ww;
 		b_index        = b - 1;
-		cp[kz-1]       = b;
-		cf[b_index][0] = n;
-		mm[b_index]    = 1;
-		nn[b_index]    = 1;
-		rx[b_index]    = kz;
+		ctx->cp[kz-1]       = b;
+		ctx->cf[b_index][0] = n;
+		ctx->mm[b_index]    = 1;
+		ctx->nn[b_index]    = 1;
+		ctx->rx[b_index]    = kz;
 
 	} else {
 		b_index = b - 1;
 	}
 
-	lim = mm[b_index];
-	lptr = &cf[b_index][0];
+	lim = ctx->mm[b_index];
+	lptr = &ctx->cf[b_index][0];
 	notfound = 1;
 
 #ifndef NOVERBOSE
@@ -1616,8 +1875,8 @@ if ( n ) {
 		}
 	}
 	if ( notfound ) {		/* If lookahead On-File endpoint not in list ... */
-		cf[b_index][i] = l;
-		++mm[b_index];
+		ctx->cf[b_index][i] = l;
+		++ctx->mm[b_index];
 	}
 } /* END if ( n ) */
 
@@ -1625,23 +1884,23 @@ if ( n ) {
 /* If lookahead On-File endpoint previously assigned to RQ but not paired with lookahead Subject endpoint... */
 
 if ( t ) {
-	b = rp[ l - 1 ];
+	b = ctx->rp[ l - 1 ];
 	if ( b == 0 ) {
 		b              = ++*ww;
 		b_index        = b - 1;
-		rp[l-1]        = b;
-		rf[b_index][0] = t;
-		mm[b_index]    = 1;
-		nn[b_index]    = 1;
-		rx[b_index]    = -l;
+		ctx->rp[l-1]        = b;
+		ctx->rf[b_index][0] = t;
+		ctx->mm[b_index]    = 1;
+		ctx->nn[b_index]    = 1;
+		ctx->rx[b_index]    = -l;
 
 
 	} else {
 		b_index = b - 1;
 	}
 
-	lim = mm[b_index];
-	lptr = &rf[b_index][0];
+	lim = ctx->mm[b_index];
+	lptr = &ctx->rf[b_index][0];
 	notfound = 1;
 
 #ifndef NOVERBOSE
@@ -1662,8 +1921,8 @@ if ( t ) {
 		}
 	}
 	if ( notfound ) {		/* If lookahead Subject endpoint not in list ... */
-		rf[b_index][i] = kz;
-		++mm[b_index];
+		ctx->rf[b_index][i] = kz;
+		++ctx->mm[b_index];
 	}
 } /* END if ( t ) */
 
@@ -1673,94 +1932,96 @@ if ( t ) {
 
 /**************************************************************************/
 
-static int bz_final_loop( int tp )
+static int bz_final_loop( struct bz_context * ctx, int tp, int threshold )
 {
 int ii, i, t, b, n, k, j, kk, jj;
 int lim;
 int match_score;
 
-/* This array originally declared global, but moved here */
-/* locally because it is only used herein.  The use of   */
-/* "static" is required as the array will exceed the     */
-/* stack allocation on our local systems otherwise.      */
-static int sct[ SCT_SIZE_1 ][ SCT_SIZE_2 ];
+/* The sct[] array originally declared global, but moved  */
+/* locally because it is only used herein.  It lives in   */
+/* the matcher context as it would exceed the stack       */
+/* allocation on our local systems otherwise.             */
 
 match_score = 0;
 for ( ii = 0; ii < tp; ii++ ) {				/* For each index up to the current value of TP ... */
 
-		if ( match_score >= gct[ii] )		/* if next group total not bigger than current match_score.. */
+		if ( match_score >= ctx->gct[ii] )		/* if next group total not bigger than current match_score.. */
 			continue;			/*		skip to next TP index */
 
-		lim = ctt[ii] + 1;
+		lim = ctx->ctt[ii] + 1;
 		for ( i = 0; i < lim; i++ ) {
-			sct[i][0] = ctp[ii][i];
+			ctx->sct[i][0] = ctx->ctp[ii][i];
 		}
 
 		t     = 0;
-		bz_y[0]  = lim;
-		cp[0] = 1;
+		ctx->bz_y[0]  = lim;
+		ctx->cp[0] = 1;
 		b     = 0;
 		n     = 1;
 		do {					/* looping until T < 0 ... */
-			if (bz_y[t] - cp[t] > 1 ) {
-				k = sct[cp[t]][t];
-				j = ctt[k] + 1;
+			if (ctx->bz_y[t] - ctx->cp[t] > 1 ) {
+				k = ctx->sct[ctx->cp[t]][t];
+				j = ctx->ctt[k] + 1;
 				for ( i = 0; i < j; i++ ) {
-					rp[i] = ctp[k][i];
+					ctx->rp[i] = ctx->ctp[k][i];
 				}
 				k  = 0;
-				kk = cp[t];
+				kk = ctx->cp[t];
 				jj = 0;
 
 				do {
-					while ( rp[jj] < sct[kk][t] && jj < j )
+					while ( ctx->rp[jj] < ctx->sct[kk][t] && jj < j )
 						jj++;
-					while ( rp[jj] > sct[kk][t] && kk < bz_y[t] )
+					while ( ctx->rp[jj] > ctx->sct[kk][t] && kk < ctx->bz_y[t] )
 						kk++;
-					while ( rp[jj] == sct[kk][t] && kk < bz_y[t] && jj < j ) {
-						sct[k][t+1] = sct[kk][t];
+					while ( ctx->rp[jj] == ctx->sct[kk][t] && kk < ctx->bz_y[t] && jj < j ) {
+						ctx->sct[k][t+1] = ctx->sct[kk][t];
 						k++;
 						kk++;
 						jj++;
 					}
-				} while ( kk < bz_y[t] && jj < j );
+				} while ( kk < ctx->bz_y[t] && jj < j );
 
 				t++;
-				cp[t] = 1;
-				bz_y[t]  = k;
+				ctx->cp[t] = 1;
+				ctx->bz_y[t]  = k;
 				b     = t;
 				n     = 1;
 			} else {
 				int tot = 0;
 
-				lim = bz_y[t];
+				lim = ctx->bz_y[t];
 				for ( i = n-1; i < lim; i++ ) {
-					tot += ct[ sct[i][t] ];
+					tot += ctx->ct[ ctx->sct[i][t] ];
 				}
 
 				for ( i = 0; i < b; i++ ) {
-					tot += ct[ sct[0][i] ];
+					tot += ctx->ct[ ctx->sct[0][i] ];
 				}
 
 				if ( tot > match_score ) {		/* If the current total is larger than the running total ... */
 					match_score = tot;		/*	then set match_score to the new total */
 					for ( i = 0; i < b; i++ ) {
-						rk[i] = sct[0][i];
+						ctx->rk[i] = ctx->sct[0][i];
 					}
 
 					{
 					int rk_index = b;
-					lim = bz_y[t];
+					lim = ctx->bz_y[t];
 					for ( i = n-1; i < lim; ) {
-						rk[ rk_index++ ] = sct[ i++ ][ t ];
+						ctx->rk[ rk_index++ ] = ctx->sct[ i++ ][ t ];
 					}
 					}
+
+					if ( threshold > 0 && match_score >= threshold )
+						return match_score;
 				}
 				b = t;
 				t--;
 				if ( t >= 0 ) {
-					++cp[t];
-					n = bz_y[t];
+					++ctx->cp[t];
+					n = ctx->bz_y[t];
 				}
 			} /* END IF */
 
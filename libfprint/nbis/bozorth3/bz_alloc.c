@@ -60,11 +60,15 @@ of the software.
 #cat:        specified length exiting directly upon system error
 #cat: malloc_or_return_error - allocates a buffer of bytes from the heap
 #cat:        of specified length returning an error code upon system error
+#cat: bz_alloc_context - allocates the working tables used by a single
+#cat:        match, one context is needed per concurrently running match
+#cat: bz_free_context - deallocates a matcher context
 
 ***********************************************************************/
 
 #include <stdio.h>
 #include <string.h>
+#include <nbis-helpers.h>
 #include <bozorth.h>
 
 
@@ -72,3 +76,23 @@ of the software.
 
 /***********************************************************************/
 /* returns CNULL on error */
+
+/***********************************************************************/
+/* The tables are large (tens of MB), but most of them are only ever   */
+/* partially written, so zeroed heap pages are only committed on use.  */
+/***********************************************************************/
+struct bz_context * bz_alloc_context( void )
+{
+struct bz_context * ctx;
+
+ctx = g_new0( struct bz_context, 1 );
+bz_comp_init( ctx );
+
+return ctx;
+}
+
+/***********************************************************************/
+void bz_free_context( struct bz_context * ctx )
+{
+g_free( ctx );
+}
@@ -60,10 +60,17 @@ of the software.
 #cat:                        table for the probe fingerprint
 #cat: bozorth_gallery_init - creates the pairwise minutia comparison
 #cat:                        table for the gallery fingerprint
+#cat: bozorth_gallery_save - copies the pruned and sorted comparison
+#cat:                        table of the gallery fingerprint so that it
+#cat:                        can be reused for later matches
 #cat: bozorth_to_gallery -   supports the matching scenario where the
 #cat:                        same probe fingerprint is matches repeatedly
 #cat:                        to multiple gallery fingerprints as in
 #cat:                        identification mode
+#cat: bozorth_to_gallery_edges - same as bozorth_to_gallery, but uses a
+#cat:                        comparison table that was saved using
+#cat:                        bozorth_gallery_save, optionally only
+#cat:                        scoring up to a threshold
 #cat: bozorth_main -         supports the matching scenario where a
 #cat:                        single probe fingerprint is to be matched
 #cat:                        to a single gallery fingerprint as in
@@ -78,7 +85,7 @@ of the software.
 
 /**************************************************************************/
 
-int bozorth_probe_init( struct xyt_struct * pstruct )
+int bozorth_probe_init( struct bz_context * ctx, struct xyt_struct * pstruct )
 {
 int sim;	/* number of pointwise comparisons for Subject's record*/
 int msim;	/* Pruned length of Subject's comparison pointer list */
@@ -88,19 +95,20 @@ int msim;	/* Pruned length of Subject's comparison pointer list */
 /* Take Subject's points and compute pointwise comparison statistics table and sorted row-pointer list. */
 /* This builds a "Web" of relative edge statistics between points. */
 bz_comp(
+	ctx,
 	pstruct->nrows,
 	pstruct->xcol,
 	pstruct->ycol,
 	pstruct->thetacol,
 	&sim,
-	scols,
-	scolpt );
+	ctx->scols,
+	ctx->scolpt );
 
 msim = sim;	/* Init search to end of Subject's pointwise comparison table (last edge in Web) */
 
 
 
-bz_find( &msim, scolpt );
+bz_find( &msim, ctx->scolpt );
 
 
 
@@ -116,7 +124,7 @@ return msim;
 
 /**************************************************************************/
 
-int bozorth_gallery_init( struct xyt_struct * gstruct )
+int bozorth_gallery_init( struct bz_context * ctx, struct xyt_struct * gstruct )
 {
 int fim;	/* number of pointwise comparisons for On-File record*/
 int mfim;	/* Pruned length of On-File Record's pointer list */
@@ -125,19 +133,20 @@ int mfim;	/* Pruned length of On-File Record's pointer list */
 /* Take On-File Record's points and compute pointwise comparison statistics table and sorted row-pointer list. */
 /* This builds a "Web" of relative edge statistics between points. */
 bz_comp(
+	ctx,
 	gstruct->nrows,
 	gstruct->xcol,
 	gstruct->ycol,
 	gstruct->thetacol,
 	&fim,
-	fcols,
-	fcolpt );
+	ctx->fcols,
+	ctx->fcolpt );
 
 mfim = fim;	/* Init search to end of On-File Record's pointwise comparison table (last edge in Web) */
 
 
 
-bz_find( &mfim, fcolpt );
+bz_find( &mfim, ctx->fcolpt );
 
 
 
@@ -153,7 +162,20 @@ return mfim;
 
 /**************************************************************************/
 
+void bozorth_gallery_save( struct bz_context * ctx, int gallery_len, int * edges )
+{
+int i;
+
+/* Store the rows in sorted order, so the copy can directly serve as the */
+/* On-File Record's pointer list again. */
+for ( i = 0; i < gallery_len; i++ )
+	memcpy( &edges[ i * COLS_SIZE_2 ], ctx->fcolpt[i], COLS_SIZE_2 * sizeof( int ) );
+}
+
+/**************************************************************************/
+
 int bozorth_to_gallery(
+		struct bz_context * ctx,
 		int probe_len,
 		struct xyt_struct * pstruct,
 		struct xyt_struct * gstruct
@@ -162,10 +184,31 @@ int bozorth_to_gallery(
 int np;
 int gallery_len;
 
-gallery_len = bozorth_gallery_init( gstruct );
-np = bz_match( probe_len, gallery_len );
-return bz_match_score( np, pstruct, gstruct );
+gallery_len = bozorth_gallery_init( ctx, gstruct );
+np = bz_match( ctx, probe_len, gallery_len );
+return bz_match_score( ctx, np, pstruct, gstruct );
 }
 
 /**************************************************************************/
 
+int bozorth_to_gallery_edges(
+		struct bz_context * ctx,
+		int probe_len,
+		struct xyt_struct * pstruct,
+		struct xyt_struct * gstruct,
+		int * edges,
+		int gallery_len,
+		int threshold
+		)
+{
+int np;
+int i;
+
+for ( i = 0; i < gallery_len; i++ )
+	ctx->fcolpt[i] = &edges[ i * COLS_SIZE_2 ];
+
+np = bz_match( ctx, probe_len, gallery_len );
+return bz_match_score_bounded( ctx, np, pstruct, gstruct, threshold );
+}
+
+/**************************************************************************/
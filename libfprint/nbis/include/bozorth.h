@@ -206,6 +206,66 @@ struct xytq_struct {
 #define XYT_NULL ( (struct xyt_struct *) NULL ) /* bz_load() */
 #define XYTQ_NULL ( (struct xytq_struct *) NULL ) /* bz_load() */
 
+/**************************************************************************/
+/* In BOZORTH3.C : Loop pairing all points in bz_comp(), implemented for  */
+/* several instruction sets                                               */
+/**************************************************************************/
+struct bz_context;
+typedef int (*bz_comp_rows_func)(struct bz_context *, int, int [], int [],
+                    int [], int [][COLS_SIZE_2]);
+
+/* Instruction sets bz_comp_rows_select() may pick a pair loop for */
+#define BZ_COMP_ROWS_SCALAR     0
+#define BZ_COMP_ROWS_BASELINE   1
+#define BZ_COMP_ROWS_BEST       2
+
+/**************************************************************************/
+/* In BZ_ALLOC.C : Supports reentrant matching */
+/**************************************************************************/
+/* Working tables supporting the "core" bozorth algorithm.  These used to */
+/* be process-wide globals; keeping them in a context allocated by the    */
+/* caller makes the matcher reentrant, so one context per thread allows   */
+/* several matches to run concurrently.                                   */
+struct bz_context {
+	int colp[ COLP_SIZE_1 ][ COLP_SIZE_2 ];	/* Sorted table of compatible edge pairs, output from bz_match() */
+	int scols[ SCOLS_SIZE_1 ][ COLS_SIZE_2 ];	/* Subject's pointwise comparison table */
+	int fcols[ FCOLS_SIZE_1 ][ COLS_SIZE_2 ];	/* On-File Record's pointwise comparison table */
+	int * scolpt[ SCOLPT_SIZE ];			/* Subject's sorted list of pointers to rows in scols[] */
+	int * fcolpt[ FCOLPT_SIZE ];			/* On-File Record's sorted list of pointers to rows in fcols[] */
+	int sc[ SC_SIZE ];				/* Flags all compatible edges in the Subject's Web */
+	int yl[ YL_SIZE_1 ][ YL_SIZE_2 ];
+	/* Used significantly by sift() */
+	int rq[ RQ_SIZE ];
+	int tq[ TQ_SIZE ];
+	int zz[ ZZ_SIZE ];
+	int rx[ RX_SIZE ];
+	int mm[ MM_SIZE ];
+	int nn[ NN_SIZE ];
+	int qq[ QQ_SIZE ];
+	int rk[ RK_SIZE ];
+	int cp[ CP_SIZE ];
+	int rp[ RP_SIZE ];
+	int rf[ RF_SIZE_1 ][ RF_SIZE_2 ];
+	int cf[ CF_SIZE_1 ][ CF_SIZE_2 ];
+	int bz_y[ Y_SIZE ];
+	/* Used only by bz_match() */
+	int rot[ ROT_SIZE_1 ][ ROT_SIZE_2 ];
+	int * rtp[ ROT_SIZE_1 ];
+	/* Used only between bz_match_score() & bz_final_loop() */
+	int ct[ CT_SIZE ];
+	int gct[ GCT_SIZE ];
+	int ctt[ CTT_SIZE ];
+	int ctp[ CTP_SIZE_1 ][ CTP_SIZE_2 ];
+	int yy[ YY_SIZE_1 ][ YY_SIZE_2 ][ YY_SIZE_3 ];
+	/* Used only by bz_final_loop() */
+	int sct[ SCT_SIZE_1 ][ SCT_SIZE_2 ];
+	/* Used only by bz_comp() */
+	unsigned long long comp_keys[ COMP_KEYS_SIZE ];
+	unsigned long long comp_keys_tmp[ COMP_KEYS_SIZE ];
+	signed char theta_kj[ DM + 1 ][ 2 * DM + 1 ];
+	bz_comp_rows_func comp_rows;
+};
+
 
 /**************************************************************************/
 /**************************************************************************/
@@ -218,50 +278,36 @@ struct xytq_struct {
 /* Globals supporting command line options */
 extern int verbose_threshold;
 
-/**************************************************************************/
-/* In: BZ_GBLS.C */
-/**************************************************************************/
-/* Global arrays supporting "core" bozorth algorithm */
-extern int colp[ COLP_SIZE_1 ][ COLP_SIZE_2 ];
-extern int scols[ SCOLS_SIZE_1 ][ COLS_SIZE_2 ];
-extern int fcols[ FCOLS_SIZE_1 ][ COLS_SIZE_2 ];
-extern int * scolpt[ SCOLPT_SIZE ];
-extern int * fcolpt[ FCOLPT_SIZE ];
-extern int sc[ SC_SIZE ];
-extern int yl[ YL_SIZE_1 ][ YL_SIZE_2 ];
-/* Global arrays supporting "core" bozorth algorithm continued: */
-/*    Globals used significantly by sift() */
-extern int rq[ RQ_SIZE ];
-extern int tq[ TQ_SIZE ];
-extern int zz[ ZZ_SIZE ];
-extern int rx[ RX_SIZE ];
-extern int mm[ MM_SIZE ];
-extern int nn[ NN_SIZE ];
-extern int qq[ QQ_SIZE ];
-extern int rk[ RK_SIZE ];
-extern int cp[ CP_SIZE ];
-extern int rp[ RP_SIZE ];
-extern int rf[RF_SIZE_1][RF_SIZE_2];
-extern int cf[CF_SIZE_1][CF_SIZE_2];
-extern int bz_y[20000];
 
 /**************************************************************************/
 /**************************************************************************/
 /* ROUTINE PROTOTYPES */
 /**************************************************************************/
 /* In: BZ_DRVRS.C */
-extern int bozorth_probe_init( struct xyt_struct *);
-extern int bozorth_gallery_init( struct xyt_struct *);
-extern int bozorth_to_gallery(int, struct xyt_struct *, struct xyt_struct *);
+extern int bozorth_probe_init(struct bz_context *, struct xyt_struct *);
+extern int bozorth_gallery_init(struct bz_context *, struct xyt_struct *);
+extern void bozorth_gallery_save(struct bz_context *, int, int *);
+extern int bozorth_to_gallery(struct bz_context *, int, struct xyt_struct *,
+                    struct xyt_struct *);
+extern int bozorth_to_gallery_edges(struct bz_context *, int,
+                    struct xyt_struct *, struct xyt_struct *, int *, int, int);
 extern int bozorth_main(struct xyt_struct *, struct xyt_struct *);
 /* In: BOZORTH3.C */
-extern void bz_comp(int, int [], int [], int [], int *, int [][COLS_SIZE_2],
-                    int *[]);
+extern void bz_comp_init(struct bz_context *);
+extern bz_comp_rows_func bz_comp_rows_select(int);
+extern void bz_comp(struct bz_context *, int, int [], int [], int [], int *,
+                    int [][COLS_SIZE_2], int *[]);
 extern void bz_find(int *, int *[]);
-extern int bz_match(int, int);
-extern int bz_match_score(int, struct xyt_struct *, struct xyt_struct *);
-extern void bz_sift(int *, int, int *, int, int, int, int *, int *);
+extern int bz_match(struct bz_context *, int, int);
+extern int bz_match_score(struct bz_context *, int, struct xyt_struct *,
+                    struct xyt_struct *);
+extern int bz_match_score_bounded(struct bz_context *, int,
+                    struct xyt_struct *, struct xyt_struct *, int);
+extern void bz_sift(struct bz_context *, int *, int, int *, int, int, int,
+                    int *, int *);
 /* In: BZ_ALLOC.C */
+extern struct bz_context *bz_alloc_context(void);
+extern void bz_free_context(struct bz_context *);
 extern char *malloc_or_exit(int, const char *);
 extern char *malloc_or_return_error(int, const char *);
 /* In: BZ_IO.C */
@@ -56,6 +56,7 @@ of the software.
 
 #define SCOLPT_SIZE 20000
 #define FCOLPT_SIZE 20000
+#define COMP_KEYS_SIZE 20000
 
 #define SC_SIZE 20000
 
@@ -110,6 +111,9 @@ rp[x] == ctp[][x] :: sct[x][]
 
 #define Y_SIZE 20000
 
+#define ROT_SIZE_1 20000
+#define ROT_SIZE_2 5
+
 
 
 
@@ -158,6 +158,32 @@ typedef struct rotgrids{
 typedef struct fp_minutia MINUTIA;
 typedef struct fp_minutiae MINUTIAE;
 
+/* Index of a list of minutiae by location, as a grid of square cells. */
+typedef struct minutiae_grid{
+   int cell_size;     /* Pixel dimension of a grid cell.                */
+   int grid_w;        /* Number of cells horizontally.                  */
+   int grid_h;        /* Number of cells vertically.                    */
+   int *heads;        /* Last entry added to each cell, or -1.          */
+   MINUTIA **entries; /* Minutia of each entry, NULL once removed.      */
+   int *next;         /* Previous entry added to the same cell, or -1.  */
+   int *seqs;         /* Entry of each minutia in the list.             */
+   int *cands;        /* List positions found by find_grid_minutiae().  */
+   int nentries;      /* Number of entries added to the grid.           */
+   int alloc;         /* Number of entries allocated.                   */
+} MINUTIAE_GRID;
+
+/* Time spent (in seconds) in each stage of the last minutiae extraction */
+/* on a thread, as returned by get_minutiae_timings().                  */
+typedef struct lfs_timings{
+   double maps;          /* Padding the image and generating the maps.  */
+   double binarization;  /* Binarizing the image and filling holes.     */
+   double detection;     /* Scanning the binary image for minutiae.     */
+   double removal;       /* Removing false minutiae.                    */
+   double ridge_counts;  /* Counting ridges between neighbor minutiae.  */
+   double quality;       /* Quality map and minutiae reliabilities.     */
+   double total;         /* Whole extraction, including the above.      */
+} LFS_TIMINGS;
+
 typedef struct feature_pattern{
    int type;
    int appearing;
@@ -340,6 +366,10 @@ typedef struct g_lfsparms{
 /*                             FORK_INTERVAL                          */
 #define NUM_DIRECTIONS          16
 
+/* Maximum number of threads analyzing blocks of the image at once */
+/* when generating the initial Direction Map.                      */
+#define MAX_MAP_THREADS          8
+
 /* This is the theta from which integer directions   */
 /* are to begin.                                     */
 #define START_DIR_ANGLE     (double)(M_PI/2.0)    /* 90 degrees */
@@ -730,6 +760,8 @@ extern int binarize_image_V2(unsigned char **, int *, int *,
                      const int *, const int, const int,
                      const int, const ROTGRIDS *);
 extern int dirbinarize(const unsigned char *, const int, const ROTGRIDS *);
+extern void dirbinarize_run(unsigned char *, const unsigned char *,
+                     const int, const int, const ROTGRIDS *);
 extern int isobinarize(unsigned char *, const int, const int, const int);
 
 /* block.c */
@@ -740,6 +772,8 @@ extern int low_contrast_block(const int, const int,
 extern int find_valid_block(int *, int *, int *, int *, int *,
                      const int, const int, const int, const int,
                      const int, const int);
+extern void foreground_region(int *, int *, int *, int *, const int *,
+                     const int, const int, const int, const int, const int);
 extern void set_margin_blocks(int *, const int, const int, const int);
 
 /* chaincod.c */
@@ -791,6 +825,8 @@ extern int lfs_detect_minutiae_V2(MINUTIAE **,
 extern int dft_dir_powers(double **, unsigned char *, const int,
                      const int, const int, const DFTWAVES *,
                      const ROTGRIDS *);
+extern void select_dft_kernel(const int);
+extern void select_dft_fixed_point(const int);
 extern void sum_rot_block_rows(int *, const unsigned char *, const int *,
                      const int);
 extern void dft_power(double *, const int *, const DFTWAVE *, const int);
@@ -811,6 +847,7 @@ extern int get_minutiae(MINUTIAE **, int **, int **, int **,
                  unsigned char **, int *, int *, int *,
                  unsigned char *, const int, const int,
                  const int, const double, const LFSPARMS *);
+extern void get_minutiae_timings(LFS_TIMINGS *);
 
 /* imgutil.c */
 extern void bits_6to8(unsigned char *, const int, const int);
@@ -820,7 +857,8 @@ extern void gray2bin(const int, const int, const int,
 extern int pad_uchar_image(unsigned char **, int *, int *,
                      unsigned char *, const int, const int, const int,
                      const int);
-extern void fill_holes(unsigned char *, const int, const int);
+extern void fill_holes(unsigned char *, const int, const int,
+                     const int, const int, const int, const int);
 extern int free_path(const int, const int, const int, const int,
                      unsigned char *, const int, const int, const LFSPARMS *);
 extern int search_in_direction(int *, int *, int *, int *, const int,
@@ -834,6 +872,11 @@ extern int get_max_padding(const int, const int, const int, const int);
 extern int get_max_padding_V2(const int, const int, const int, const int);
 extern int init_rotgrids(ROTGRIDS **, const int, const int, const int,
                      const double, const int, const int, const int, const int);
+extern int get_cached_dir2rad(DIR2RAD **, const int);
+extern int get_cached_dftwaves(DFTWAVES **, const double *, const int,
+                     const int);
+extern int get_cached_rotgrids(ROTGRIDS **, const int, const int, const int,
+                     const double, const int, const int, const int, const int);
 extern int alloc_dir_powers(double ***, const int, const int);
 extern int alloc_power_stats(int **, double **, int **, double **, const int);
 
@@ -900,10 +943,14 @@ extern int gen_image_maps(int **, int **, int **, int **, int *, int *,
                     unsigned char *, const int, const int,
                     const DIR2RAD *, const DFTWAVES *,
                     const ROTGRIDS *, const LFSPARMS *);
+extern int gen_foreground_map(int **, int *, const int, const int,
+                    unsigned char *, const int, const int, const int,
+                    const LFSPARMS *);
 extern int gen_initial_maps(int **, int **, int **,
                     int *, const int, const int,
                     unsigned char *, const int, const int,
                     const DFTWAVES *, const  ROTGRIDS *, const LFSPARMS *);
+extern void select_map_threads(const int);
 extern int interpolate_direction_map(int *, int *, const int, const int,
                     const LFSPARMS *);
 extern int morph_TF_map(int *, const int, const int, const LFSPARMS *);
@@ -975,9 +1022,17 @@ extern int detect_minutiae_V2(MINUTIAE *,
                      const LFSPARMS *);
 extern int update_minutiae(MINUTIAE *, MINUTIA *, unsigned char *,
                      const int, const int, const LFSPARMS *);
-extern int update_minutiae_V2(MINUTIAE *, MINUTIA *, const int, const int,
+extern int update_minutiae_V2(MINUTIAE *, MINUTIAE_GRID *, MINUTIA *,
+                     const int, const int,
                      unsigned char *, const int, const int,
                      const LFSPARMS *);
+extern int alloc_minutiae_grid(MINUTIAE_GRID **, MINUTIAE *,
+                     const int, const int, const int);
+extern void free_minutiae_grid(MINUTIAE_GRID *);
+extern void add_grid_minutia(MINUTIAE_GRID *, MINUTIA *, const int);
+extern int find_grid_minutiae(MINUTIAE_GRID *, MINUTIAE *,
+                     const int, const int);
+extern int remove_grid_minutia(const int, MINUTIAE *, MINUTIAE_GRID *);
 extern int sort_minutiae(MINUTIAE *, const int, const int);
 extern int sort_minutiae_y_x(MINUTIAE *, const int, const int);
 extern int sort_minutiae_x_y(MINUTIAE *, const int, const int);
@@ -1004,9 +1059,10 @@ extern int scan4minutiae_horizontally(MINUTIAE *, unsigned char *,
                      const int, const int, const int, const int,
                      const int, const int, const int, const int,
                      const LFSPARMS *);
-extern int scan4minutiae_horizontally_V2(MINUTIAE *,
+extern int scan4minutiae_horizontally_V2(MINUTIAE *, MINUTIAE_GRID *,
                      unsigned char *, const int, const int,
                      int *, int *, int *,
+                     const int, const int, const int, const int,
                      const LFSPARMS *);
 extern int scan4minutiae_vertically(MINUTIAE *, unsigned char *,
                      const int, const int, const int, const int,
@@ -1017,9 +1073,11 @@ extern int rescan4minutiae_horizontally(MINUTIAE *, unsigned char *bdata,
                      const int, const int, const int, const int,
                      const int, const int, const int, const int,
                      const LFSPARMS *);
-extern int scan4minutiae_vertically_V2(MINUTIAE *,
+extern int scan4minutiae_vertically_V2(MINUTIAE *, MINUTIAE_GRID *,
                      unsigned char *, const int, const int,
-                     int *, int *, int *, const LFSPARMS *);
+                     int *, int *, int *,
+                     const int, const int, const int, const int,
+                     const LFSPARMS *);
 extern int rescan4minutiae_vertically(MINUTIAE *, unsigned char *,
                      const int, const int, const int *, const int *,
                      const int, const int, const int, const int,
@@ -1047,7 +1105,7 @@ extern int process_horizontal_scan_minutia(MINUTIAE *, const int, const int,
                      const int, const int,
                      unsigned char *, const int, const int,
                      const int, const int, const LFSPARMS *);
-extern int process_horizontal_scan_minutia_V2(MINUTIAE *,
+extern int process_horizontal_scan_minutia_V2(MINUTIAE *, MINUTIAE_GRID *,
                      const int, const int, const int, const int,
                      unsigned char *, const int, const int,
                      int *, int *, int *, const LFSPARMS *);
@@ -1055,11 +1113,13 @@ extern int process_vertical_scan_minutia(MINUTIAE *, const int, const int,
                      const int, const int,
                      unsigned char *, const int, const int,
                      const int, const int, const LFSPARMS *);
-extern int process_vertical_scan_minutia_V2(MINUTIAE *, const int, const int,
+extern int process_vertical_scan_minutia_V2(MINUTIAE *, MINUTIAE_GRID *,
+                     const int, const int,
                      const int, const int,
                      unsigned char *, const int, const int,
                      int *, int *, int *, const LFSPARMS *);
-extern int update_minutiae_V2(MINUTIAE *, MINUTIA *, const int, const int,
+extern int update_minutiae_V2(MINUTIAE *, MINUTIAE_GRID *, MINUTIA *,
+                     const int, const int,
                      unsigned char *, const int, const int,
                      const LFSPARMS *);
 extern int adjust_high_curvature_minutia(int *, int *, int *, int *, int *,
@@ -1189,6 +1249,7 @@ extern void sort_row_on_x(ROW *);
 /* sort.c */
 extern int sort_indices_int_inc(int **, int *, const int);
 extern int sort_indices_double_inc(int **, double *, const int);
+extern void merge_sort_int_inc_2(int *, int *, const int);
 extern void bubble_sort_int_inc_2(int *, int *, const int);
 extern void bubble_sort_double_inc_2(double *, int *, const int);
 extern void bubble_sort_double_dec_2(double *, int *,  const int);
@@ -1208,6 +1269,15 @@ extern double angle2line(const int, const int, const int, const int);
 extern int line2direction(const int, const int, const int, const int,
                      const int);
 extern int closest_dir_dist(const int, const int, const int);
+extern int lfs_arena_enabled(void);
+extern void lfs_arena_begin(void);
+extern void lfs_arena_end(void);
+extern void *lfs_alloc(const size_t);
+extern void *lfs_realloc(void *, const size_t);
+extern void lfs_free(void *);
+extern void *lfs_arena_export(void *);
+extern LFS_TIMINGS *lfs_timings(void);
+extern double lfs_lap_time(gint64 *);
 
 /* xytreps.c */
 extern void lfs2nist_minutia_XYT(int *, int *, int *,
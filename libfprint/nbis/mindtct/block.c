@@ -60,6 +60,7 @@ of the software.
                         block_offsets()
                         low_contrast_block()
                         find_valid_block()
+                        foreground_region()
                         set_margin_blocks()
 
 ***********************************************************************/
@@ -134,7 +135,7 @@ int block_offsets(int **optr, int *ow, int *oh,
    lastbh = bh - 1;
 
    /* Allocate list of block offsets */
-   blkoffs = (int *)g_malloc(bsize * sizeof(int));
+   blkoffs = (int *)lfs_alloc(bsize * sizeof(int));
 
    /* Current block index */
    bi = 0;
@@ -352,6 +353,72 @@ int find_valid_block(int *nbr_dir, int *nbr_x, int *nbr_y,
    return(NOT_FOUND);
 }
 
+/*************************************************************************
+**************************************************************************
+#cat: foreground_region - Determines the smallest rectangle of pixels
+#cat:             holding every block with a valid direction in the
+#cat:             Direction Map, plus a margin of one pixel on each side.
+#cat:             Blocks without a valid direction are binarized white, so
+#cat:             filling holes and scanning for minutiae outside of this
+#cat:             region finds nothing.  The region is empty if no block
+#cat:             has a valid direction.
+
+   Input:
+      direction_map - map of blocks containing directional ridge flows
+      mw        - number of blocks horizontally in the map
+      mh        - number of blocks vertically in the map
+      iw        - width (in pixels) of the image
+      ih        - height (in pixels) of the image
+      blocksize - the width and height (in pixels) of each block
+   Output:
+      ox        - x-pixel coord of origin of the region
+      oy        - y-pixel coord of origin of the region
+      ow        - width (in pixels) of the region
+      oh        - height (in pixels) of the region
+**************************************************************************/
+void foreground_region(int *ox, int *oy, int *ow, int *oh,
+                       const int *direction_map, const int mw, const int mh,
+                       const int iw, const int ih, const int blocksize)
+{
+   int bx, by, sx, sy, ex, ey;
+
+   /* Find the extent of the blocks with valid direction. */
+   sx = mw;
+   sy = mh;
+   ex = -1;
+   ey = -1;
+   for(by = 0; by < mh; by++){
+      for(bx = 0; bx < mw; bx++){
+         if(*(direction_map+(by*mw)+bx) != INVALID_DIR){
+            sx = min(sx, bx);
+            sy = min(sy, by);
+            ex = max(ex, bx);
+            ey = max(ey, by);
+         }
+      }
+   }
+
+   /* If no block has a valid direction ... */
+   if(ex < 0){
+      *ox = 0;
+      *oy = 0;
+      *ow = 0;
+      *oh = 0;
+      return;
+   }
+
+   /* Convert to pixels, adding the margin and clipping to the image. */
+   sx = max(sx * blocksize - 1, 0);
+   sy = max(sy * blocksize - 1, 0);
+   ex = min((ex + 1) * blocksize + 1, iw);
+   ey = min((ey + 1) * blocksize + 1, ih);
+
+   *ox = sx;
+   *oy = sy;
+   *ow = ex - sx;
+   *oh = ey - sy;
+}
+
 /*************************************************************************
 **************************************************************************
 #cat: set_margin_blocks - Take an image map and sets its perimeter values to
@@ -110,16 +110,16 @@ int allocate_contour(int **ocontour_x, int **ocontour_y,
    ASSERT_SIZE_MUL(ncontour, sizeof(int));
 
    /* Allocate contour's x-coord list. */
-   contour_x = (int *)g_malloc(ncontour * sizeof(int));
+   contour_x = (int *)lfs_alloc(ncontour * sizeof(int));
 
    /* Allocate contour's y-coord list. */
-   contour_y = (int *)g_malloc(ncontour * sizeof(int));
+   contour_y = (int *)lfs_alloc(ncontour * sizeof(int));
 
    /* Allocate contour's edge x-coord list. */
-   contour_ex = (int *)g_malloc(ncontour * sizeof(int));
+   contour_ex = (int *)lfs_alloc(ncontour * sizeof(int));
 
    /* Allocate contour's edge y-coord list. */
-   contour_ey = (int *)g_malloc(ncontour * sizeof(int));
+   contour_ey = (int *)lfs_alloc(ncontour * sizeof(int));
 
    /* Otherwise, allocations successful, so assign output pointers. */
    *ocontour_x = contour_x;
@@ -152,10 +152,10 @@ int allocate_contour(int **ocontour_x, int **ocontour_y,
 void free_contour(int *contour_x, int *contour_y,
                   int *contour_ex, int *contour_ey)
 {
-   g_free(contour_x);
-   g_free(contour_y);
-   g_free(contour_ex);
-   g_free(contour_ey);
+   lfs_free(contour_x);
+   lfs_free(contour_y);
+   lfs_free(contour_ex);
+   lfs_free(contour_ey);
 }
 
 /*************************************************************************
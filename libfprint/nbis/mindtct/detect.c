@@ -62,6 +62,7 @@ of the software.
 ***********************************************************************/
 
 #include <stdio.h>
+#include <string.h>
 #include <lfs.h>
 #include <mytime.h>
 #include <log.h>
@@ -149,8 +150,14 @@ int lfs_detect_minutiae_V2(MINUTIAE **ominutiae,
    int mw, mh;
    int ret, maxpad;
    MINUTIAE *minutiae;
+   LFS_TIMINGS *timings;
+   gint64 start, stage_start;
 
-   set_timer(total_timer);
+   /* Restart the stage timings of this thread. */
+   timings = lfs_timings();
+   memset(timings, 0, sizeof(LFS_TIMINGS));
+   start = g_get_monotonic_time();
+   stage_start = start;
 
    /******************/
    /* INITIALIZATION */
@@ -166,31 +173,26 @@ int lfs_detect_minutiae_V2(MINUTIAE **ominutiae,
    maxpad = get_max_padding_V2(lfsparms->windowsize, lfsparms->windowoffset,
                           lfsparms->dirbin_grid_w, lfsparms->dirbin_grid_h);
 
-   /* Initialize lookup table for converting integer directions */
-   /* to angles in radians.                                     */
-   if((ret = init_dir2rad(&dir2rad, lfsparms->num_directions))){
-      /* Free memory allocated to this point. */
+   /* Get lookup table for converting integer directions */
+   /* to angles in radians.                              */
+   /* The lookup tables are shared and must not be freed. */
+   if((ret = get_cached_dir2rad(&dir2rad, lfsparms->num_directions))){
       return(ret);
    }
 
-   /* Initialize wave form lookup tables for DFT analyses. */
+   /* Get wave form lookup tables for DFT analyses. */
    /* used for direction binarization.                             */
-   if((ret = init_dftwaves(&dftwaves, g_dft_coefs, lfsparms->num_dft_waves,
-                        lfsparms->windowsize))){
-      /* Free memory allocated to this point. */
-      free_dir2rad(dir2rad);
+   if((ret = get_cached_dftwaves(&dftwaves, g_dft_coefs,
+                        lfsparms->num_dft_waves, lfsparms->windowsize))){
       return(ret);
    }
 
-   /* Initialize lookup table for pixel offsets to rotated grids */
-   /* used for DFT analyses.                                     */
-   if((ret = init_rotgrids(&dftgrids, iw, ih, maxpad,
+   /* Get lookup table for pixel offsets to rotated grids */
+   /* used for DFT analyses.                              */
+   if((ret = get_cached_rotgrids(&dftgrids, iw, ih, maxpad,
                         lfsparms->start_dir_angle, lfsparms->num_directions,
                         lfsparms->windowsize, lfsparms->windowsize,
                         RELATIVE2ORIGIN))){
-      /* Free memory allocated to this point. */
-      free_dir2rad(dir2rad);
-      free_dftwaves(dftwaves);
       return(ret);
    }
 
@@ -198,16 +200,12 @@ int lfs_detect_minutiae_V2(MINUTIAE **ominutiae,
    if(maxpad > 0){   /* May not need to pad at all */
       if((ret = pad_uchar_image(&pdata, &pw, &ph, idata, iw, ih,
                              maxpad, lfsparms->pad_value))){
-         /* Free memory allocated to this point. */
-         free_dir2rad(dir2rad);
-         free_dftwaves(dftwaves);
-         free_rotgrids(dftgrids);
          return(ret);
       }
    }
    else{
       /* If padding is unnecessary, then copy the input image. */
-      pdata = (unsigned char *)g_malloc(iw * ih);
+      pdata = (unsigned char *)lfs_alloc(iw * ih);
       memcpy(pdata, idata, iw*ih);
       pw = iw;
       ph = ih;
@@ -226,45 +224,36 @@ int lfs_detect_minutiae_V2(MINUTIAE **ominutiae,
    /******************/
    /*      MAPS      */
    /******************/
-   set_timer(imap_timer);
 
    /* Generate block maps from the input image. */
    if((ret = gen_image_maps(&direction_map, &low_contrast_map,
                     &low_flow_map, &high_curve_map, &mw, &mh,
                     pdata, pw, ph, dir2rad, dftwaves, dftgrids, lfsparms))){
       /* Free memory allocated to this point. */
-      free_dir2rad(dir2rad);
-      free_dftwaves(dftwaves);
-      free_rotgrids(dftgrids);
-      g_free(pdata);
+      lfs_free(pdata);
       return(ret);
    }
-   /* Deallocate working memories. */
-   free_dir2rad(dir2rad);
-   free_dftwaves(dftwaves);
-   free_rotgrids(dftgrids);
 
    print2log("\nMAPS DONE\n");
 
-   time_accum(imap_timer, imap_time);
+   timings->maps = lfs_lap_time(&stage_start);
 
    /******************/
    /* BINARIZARION   */
    /******************/
-   set_timer(bin_timer);
 
-   /* Initialize lookup table for pixel offsets to rotated grids */
-   /* used for directional binarization.                         */
-   if((ret = init_rotgrids(&dirbingrids, iw, ih, maxpad,
+   /* Get lookup table for pixel offsets to rotated grids */
+   /* used for directional binarization.                  */
+   if((ret = get_cached_rotgrids(&dirbingrids, iw, ih, maxpad,
                         lfsparms->start_dir_angle, lfsparms->num_directions,
                         lfsparms->dirbin_grid_w, lfsparms->dirbin_grid_h,
                         RELATIVE2CENTER))){
       /* Free memory allocated to this point. */
-      g_free(pdata);
-      g_free(direction_map);
-      g_free(low_contrast_map);
-      g_free(low_flow_map);
-      g_free(high_curve_map);
+      lfs_free(pdata);
+      lfs_free(direction_map);
+      lfs_free(low_contrast_map);
+      lfs_free(low_flow_map);
+      lfs_free(high_curve_map);
       return(ret);
    }
 
@@ -273,28 +262,24 @@ int lfs_detect_minutiae_V2(MINUTIAE **ominutiae,
                       pdata, pw, ph, direction_map, mw, mh,
                       dirbingrids, lfsparms))){
       /* Free memory allocated to this point. */
-      g_free(pdata);
-      g_free(direction_map);
-      g_free(low_contrast_map);
-      g_free(low_flow_map);
-      g_free(high_curve_map);
-      free_rotgrids(dirbingrids);
+      lfs_free(pdata);
+      lfs_free(direction_map);
+      lfs_free(low_contrast_map);
+      lfs_free(low_flow_map);
+      lfs_free(high_curve_map);
       return(ret);
    }
 
-   /* Deallocate working memory. */
-   free_rotgrids(dirbingrids);
-
    /* Check dimension of binary image.  If they are different from */
    /* the input image, then ERROR.                                 */
    if((iw != bw) || (ih != bh)){
       /* Free memory allocated to this point. */
-      g_free(pdata);
-      g_free(direction_map);
-      g_free(low_contrast_map);
-      g_free(low_flow_map);
-      g_free(high_curve_map);
-      g_free(bdata);
+      lfs_free(pdata);
+      lfs_free(direction_map);
+      lfs_free(low_contrast_map);
+      lfs_free(low_flow_map);
+      lfs_free(high_curve_map);
+      lfs_free(bdata);
       fprintf(stderr, "ERROR : lfs_detect_minutiae_V2 :");
       fprintf(stderr,"binary image has bad dimensions : %d, %d\n",
               bw, bh);
@@ -303,12 +288,11 @@ int lfs_detect_minutiae_V2(MINUTIAE **ominutiae,
 
    print2log("\nBINARIZATION DONE\n");
 
-   time_accum(bin_timer, bin_time);
+   timings->binarization = lfs_lap_time(&stage_start);
 
    /******************/
    /*   DETECTION    */
    /******************/
-   set_timer(minutia_timer);
 
    /* Convert 8-bit grayscale binary image [0,255] to */
    /* 8-bit binary image [0,1].                       */
@@ -324,49 +308,46 @@ int lfs_detect_minutiae_V2(MINUTIAE **ominutiae,
                              direction_map, low_flow_map, high_curve_map,
                              mw, mh, lfsparms))){
       /* Free memory allocated to this point. */
-      g_free(pdata);
-      g_free(direction_map);
-      g_free(low_contrast_map);
-      g_free(low_flow_map);
-      g_free(high_curve_map);
-      g_free(bdata);
+      lfs_free(pdata);
+      lfs_free(direction_map);
+      lfs_free(low_contrast_map);
+      lfs_free(low_flow_map);
+      lfs_free(high_curve_map);
+      lfs_free(bdata);
       return(ret);
    }
 
-   time_accum(minutia_timer, minutia_time);
-
-   set_timer(rm_minutia_timer);
+   timings->detection = lfs_lap_time(&stage_start);
 
    if((ret = remove_false_minutia_V2(minutiae, bdata, iw, ih,
                        direction_map, low_flow_map, high_curve_map, mw, mh,
                        lfsparms))){
       /* Free memory allocated to this point. */
-      g_free(pdata);
-      g_free(direction_map);
-      g_free(low_contrast_map);
-      g_free(low_flow_map);
-      g_free(high_curve_map);
-      g_free(bdata);
+      lfs_free(pdata);
+      lfs_free(direction_map);
+      lfs_free(low_contrast_map);
+      lfs_free(low_flow_map);
+      lfs_free(high_curve_map);
+      lfs_free(bdata);
       free_minutiae(minutiae);
       return(ret);
    }
 
    print2log("\nMINUTIA DETECTION DONE\n");
 
-   time_accum(rm_minutia_timer, rm_minutia_time);
+   timings->removal = lfs_lap_time(&stage_start);
 
    /******************/
    /*  RIDGE COUNTS  */
    /******************/
-   set_timer(ridge_count_timer);
 
    if((ret = count_minutiae_ridges(minutiae, bdata, iw, ih, lfsparms))){
       /* Free memory allocated to this point. */
-      g_free(pdata);
-      g_free(direction_map);
-      g_free(low_contrast_map);
-      g_free(low_flow_map);
-      g_free(high_curve_map);
+      lfs_free(pdata);
+      lfs_free(direction_map);
+      lfs_free(low_contrast_map);
+      lfs_free(low_flow_map);
+      lfs_free(high_curve_map);
       free_minutiae(minutiae);
       return(ret);
    }
@@ -374,7 +355,7 @@ int lfs_detect_minutiae_V2(MINUTIAE **ominutiae,
 
    print2log("\nNEIGHBOR RIDGE COUNT DONE\n");
 
-   time_accum(ridge_count_timer, ridge_count_time);
+   timings->ridge_counts = lfs_lap_time(&stage_start);
 
    /******************/
    /*    WRAP-UP     */
@@ -385,7 +366,7 @@ int lfs_detect_minutiae_V2(MINUTIAE **ominutiae,
    gray2bin(1, 255, 0, bdata, iw, ih);
 
    /* Deallocate working memory. */
-   g_free(pdata);
+   lfs_free(pdata);
 
    /* Assign results to output pointers. */
    *odmap = direction_map;
@@ -399,27 +380,28 @@ int lfs_detect_minutiae_V2(MINUTIAE **ominutiae,
    *obh = bh;
    *ominutiae = minutiae;
 
-   time_accum(total_timer, total_time);
+   timings->total = lfs_lap_time(&start);
 
    /******************/
    /* PRINT TIMINGS  */
    /******************/
    /* These Timings will print when TIMER is defined. */
    /* print MAP generation timing statistics */
-   print_time(stderr, "TIMER: MAPS time   = %f (secs)\n", imap_time);
+   print_time(stderr, "TIMER: MAPS time   = %f (secs)\n", timings->maps);
    /* print binarization timing statistics */
-   print_time(stderr, "TIMER: Binarization time   = %f (secs)\n", bin_time);
+   print_time(stderr, "TIMER: Binarization time   = %f (secs)\n",
+              timings->binarization);
    /* print minutia detection timing statistics */
    print_time(stderr, "TIMER: Minutia Detection time   = %f (secs)\n",
-              minutia_time);
+              timings->detection);
    /* print minutia removal timing statistics */
    print_time(stderr, "TIMER: Minutia Removal time   = %f (secs)\n",
-              rm_minutia_time);
+              timings->removal);
    /* print neighbor ridge count timing statistics */
    print_time(stderr, "TIMER: Neighbor Ridge Counting time   = %f (secs)\n",
-              ridge_count_time);
+              timings->ridge_counts);
    /* print total timing statistics */
-   print_time(stderr, "TIMER: Total time   = %f (secs)\n", total_time);
+   print_time(stderr, "TIMER: Total time   = %f (secs)\n", timings->total);
 
    /* If LOG_REPORT defined, close log report file. */
    if((ret = close_logfile()))
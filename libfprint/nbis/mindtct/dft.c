@@ -57,6 +57,8 @@ of the software.
 ***********************************************************************
                ROUTINES:
                         dft_dir_powers()
+                        select_dft_kernel()
+                        select_dft_fixed_point()
                         sum_rot_block_rows()
                         dft_power()
                         dft_power_stats()
@@ -65,8 +67,357 @@ of the software.
 ***********************************************************************/
 
 #include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
 #include <lfs.h>
 
+/* The DFT analysis of a block is done using the generic vector         */
+/* extensions of GCC and clang, which map to e.g. SSE2 or NEON.  On x86, */
+/* a second copy is built for AVX2 and selected at runtime.  Every wave  */
+/* form is still accumulated in the same order as by dft_power(), so     */
+/* the resulting powers are exactly the same.                            */
+#if defined(__GNUC__) && !defined(LFS_NO_VECTOR)
+#define DFT_VECTOR
+#define DFT_VEC_LEN 4
+typedef double dft_vec __attribute__((vector_size(DFT_VEC_LEN * sizeof(double))));
+typedef int dft_fixed_vec __attribute__((vector_size(DFT_VEC_LEN * sizeof(int))));
+#if defined(__x86_64__) || defined(__i386__)
+#define DFT_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+#define DFT_KERNEL_SCALAR   0
+#define DFT_KERNEL_VECTOR   1
+#define DFT_KERNEL_AVX2     2
+
+static int dft_kernel = 0;
+
+/* The fixed-point analysis is for CPUs without fast double precision   */
+/* arithmetic.  The wave forms are scaled to DFT_FIXED_SHIFT fractional */
+/* bits, so that the row sums of a block of 6 bit pixels can be         */
+/* accumulated in 32 bit integers.  The powers are not exactly the same */
+/* as the ones of the double precision analysis, which is why it has to */
+/* be selected explicitly, either at build time or at runtime.          */
+#define DFT_FIXED_SHIFT     14
+#define DFT_FIXED_MAX_PIXEL 63
+
+#ifdef LFS_FIXED_POINT
+static int dft_fixed_point = TRUE;
+#else
+static int dft_fixed_point = FALSE;
+#endif
+
+/*************************************************************************
+**************************************************************************
+#cat: select_dft_kernel - Selects the implementation used by dft_dir_powers().
+#cat:         By default, the fastest one supported by the CPU is selected
+#cat:         on first use.  Passing FALSE selects the scalar reference
+#cat:         implementation, mainly to validate the others against it.
+
+   Input:
+      allow_vector - whether vector instructions may be used
+**************************************************************************/
+void select_dft_kernel(const int allow_vector)
+{
+   int kernel = DFT_KERNEL_SCALAR;
+
+   if(allow_vector){
+#ifdef DFT_VECTOR
+      kernel = DFT_KERNEL_VECTOR;
+#endif
+#ifdef DFT_AVX2
+      __builtin_cpu_init();
+      if(__builtin_cpu_supports("avx2"))
+         kernel = DFT_KERNEL_AVX2;
+#endif
+   }
+
+   /* Stored with an offset of one, zero means not selected yet. */
+   g_atomic_int_set(&dft_kernel, kernel + 1);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: select_dft_fixed_point - Selects whether dft_dir_powers() uses
+#cat:         fixed-point arithmetic instead of double precision.  This
+#cat:         defaults to FALSE, unless built with LFS_FIXED_POINT.
+
+   Input:
+      fixed_point - whether fixed-point arithmetic is used
+**************************************************************************/
+void select_dft_fixed_point(const int fixed_point)
+{
+   g_atomic_int_set(&dft_fixed_point, fixed_point);
+}
+
+#ifdef DFT_VECTOR
+static int get_dft_kernel(void)
+{
+   int kernel = g_atomic_int_get(&dft_kernel);
+
+   if(kernel == 0){
+      select_dft_kernel(TRUE);
+      kernel = g_atomic_int_get(&dft_kernel);
+   }
+
+   return(kernel - 1);
+}
+#endif
+
+#ifdef DFT_AVX2
+/*************************************************************************
+**************************************************************************
+   Same as sum_rot_block_rows(), but loads 8 pixels at once using AVX2
+   gather instructions.  These load 4 bytes for every pixel, so at least
+   3 more bytes must be readable after every pixel of the rotated grid.
+**************************************************************************/
+__attribute__((target("avx2")))
+static void sum_rot_block_rows_gather(int *rowsums, const unsigned char *blkptr,
+                        const int *grid_offsets, const int blocksize)
+{
+   const __m256i mask = _mm256_set1_epi32(0xff);
+   int iy, ix;
+
+   /* For each row in block ... */
+   for(iy = 0; iy < blocksize; iy++){
+      const int *offsets = grid_offsets + iy * blocksize;
+      __m256i acc = _mm256_setzero_si256();
+      __m128i sum;
+
+      /* Foreach 8 columns in block ... */
+      for(ix = 0; ix + 8 <= blocksize; ix += 8){
+         __m256i offs = _mm256_loadu_si256((const __m256i *)(offsets + ix));
+         __m256i pix = _mm256_i32gather_epi32((const int *)blkptr, offs, 1);
+         acc = _mm256_add_epi32(acc, _mm256_and_si256(pix, mask));
+      }
+
+      sum = _mm_add_epi32(_mm256_castsi256_si128(acc),
+                          _mm256_extracti128_si256(acc, 1));
+      sum = _mm_hadd_epi32(sum, sum);
+      sum = _mm_hadd_epi32(sum, sum);
+      rowsums[iy] = _mm_cvtsi128_si32(sum);
+
+      /* Remaining columns ... */
+      for(; ix < blocksize; ix++)
+         rowsums[iy] += blkptr[offsets[ix]];
+   }
+}
+#endif
+
+#ifdef DFT_VECTOR
+/*************************************************************************
+**************************************************************************
+   Same as dft_dir_powers(), but applies DFT_VEC_LEN wave forms at once.
+   Built once for the baseline instruction set and once for AVX2, where
+   the rotated pixel rows are also summed using gather instructions.
+**************************************************************************/
+static inline __attribute__((always_inline)) void dft_dir_powers_vector(
+               double **powers, unsigned char *pdata,
+               const int blkoffset, const int pw, const int ph,
+               const DFTWAVES *dftwaves, const ROTGRIDS *dftgrids,
+               const int use_gather)
+{
+   const int nwaves = dftwaves->nwaves;
+   const int wavelen = dftwaves->wavelen;
+   const int ngroups = nwaves / DFT_VEC_LEN;
+   const int blocksize = dftgrids->grid_w;
+   double *wcos, *wsin;
+   int *rowsums;
+   unsigned char *blkptr;
+   int gather;
+   int w, g, i, k, dir;
+
+   rowsums = (int *)lfs_alloc(blocksize * sizeof(int));
+
+   /* Interleave the wave forms of each group, so that point I of all */
+   /* of them can be loaded as one vector.                            */
+   wcos = (double *)lfs_alloc(ngroups * wavelen * DFT_VEC_LEN * sizeof(double));
+   wsin = (double *)lfs_alloc(ngroups * wavelen * DFT_VEC_LEN * sizeof(double));
+   for(g = 0; g < ngroups; g++){
+      for(i = 0; i < wavelen; i++){
+         for(k = 0; k < DFT_VEC_LEN; k++){
+            wcos[(g * wavelen + i) * DFT_VEC_LEN + k] =
+                  dftwaves->waves[g * DFT_VEC_LEN + k]->cos[i];
+            wsin[(g * wavelen + i) * DFT_VEC_LEN + k] =
+                  dftwaves->waves[g * DFT_VEC_LEN + k]->sin[i];
+         }
+      }
+   }
+
+   blkptr = pdata + blkoffset;
+
+   /* Gathers load 4 bytes for every pixel, so they are only used if the */
+   /* whole rotated grid plus 3 bytes is within the image.               */
+   gather = use_gather &&
+            blkoffset + (blocksize + dftgrids->pad) * (pw + 1) + 3 < pw * ph;
+
+   /* Foreach direction ... */
+   for(dir = 0; dir < dftgrids->ngrids; dir++){
+      /* Compute vector of line sums from rotated grid */
+#ifdef DFT_AVX2
+      if(gather)
+         sum_rot_block_rows_gather(rowsums, blkptr, dftgrids->grids[dir],
+                                   blocksize);
+      else
+#endif
+         sum_rot_block_rows(rowsums, blkptr, dftgrids->grids[dir], blocksize);
+
+      /* Foreach group of DFT waves ... */
+      for(g = 0; g < ngroups; g++){
+         const double *c = wcos + g * wavelen * DFT_VEC_LEN;
+         const double *sn = wsin + g * wavelen * DFT_VEC_LEN;
+         dft_vec cospart = { 0 };
+         dft_vec sinpart = { 0 };
+         dft_vec power, cv, sv;
+
+         /* Accumulate cos and sin components of DFT. */
+         for(i = 0; i < wavelen; i++){
+            double r = rowsums[i];
+
+            memcpy(&cv, c + i * DFT_VEC_LEN, sizeof(cv));
+            memcpy(&sv, sn + i * DFT_VEC_LEN, sizeof(sv));
+            cospart += r * cv;
+            sinpart += r * sv;
+         }
+
+         /* Power is the sum of the squared cos and sin components */
+         power = (cospart * cospart) + (sinpart * sinpart);
+         for(k = 0; k < DFT_VEC_LEN; k++)
+            powers[g * DFT_VEC_LEN + k][dir] = power[k];
+      }
+
+      /* Remaining DFT waves ... */
+      for(w = ngroups * DFT_VEC_LEN; w < nwaves; w++){
+         dft_power(&(powers[w][dir]), rowsums,
+                   dftwaves->waves[w], wavelen);
+      }
+   }
+
+   /* Deallocate working memory. */
+   lfs_free(rowsums);
+   lfs_free(wcos);
+   lfs_free(wsin);
+}
+
+static void dft_dir_powers_baseline(double **powers, unsigned char *pdata,
+               const int blkoffset, const int pw, const int ph,
+               const DFTWAVES *dftwaves, const ROTGRIDS *dftgrids)
+{
+   dft_dir_powers_vector(powers, pdata, blkoffset, pw, ph,
+                         dftwaves, dftgrids, FALSE);
+}
+
+#ifdef DFT_AVX2
+__attribute__((target("avx2")))
+static void dft_dir_powers_avx2(double **powers, unsigned char *pdata,
+               const int blkoffset, const int pw, const int ph,
+               const DFTWAVES *dftwaves, const ROTGRIDS *dftgrids)
+{
+   dft_dir_powers_vector(powers, pdata, blkoffset, pw, ph,
+                         dftwaves, dftgrids, TRUE);
+}
+#endif
+#endif
+
+/*************************************************************************
+**************************************************************************
+   Same as dft_dir_powers(), but uses fixed-point wave forms and integer
+   accumulators.  The resulting powers are scaled back to the range of
+   the double precision ones, so the same thresholds apply to them.  As
+   in dft_dir_powers_vector(), the wave forms are interleaved in groups
+   so that point I of all of them can be loaded as one vector.
+**************************************************************************/
+static void dft_dir_powers_fixed(double **powers, unsigned char *pdata,
+               const int blkoffset,
+               const DFTWAVES *dftwaves, const ROTGRIDS *dftgrids)
+{
+   const int nwaves = dftwaves->nwaves;
+   const int wavelen = dftwaves->wavelen;
+   const double scale = 1.0 / ((double)(1 << DFT_FIXED_SHIFT) *
+                               (double)(1 << DFT_FIXED_SHIFT));
+#ifdef DFT_VECTOR
+   const int ngroups = nwaves / DFT_VEC_LEN;
+   const int grouplen = DFT_VEC_LEN;
+#else
+   const int ngroups = 0;
+   const int grouplen = 1;
+#endif
+   int *wcos, *wsin, *rowsums;
+   unsigned char *blkptr;
+   int w, g, i, k, dir;
+
+   rowsums = (int *)lfs_alloc(dftgrids->grid_w * sizeof(int));
+   wcos = (int *)lfs_alloc(nwaves * wavelen * sizeof(int));
+   wsin = (int *)lfs_alloc(nwaves * wavelen * sizeof(int));
+   for(w = 0; w < nwaves; w++){
+      /* Waves within a group are interleaved, the remaining ones not. */
+      g = w / grouplen;
+      k = w % grouplen;
+      for(i = 0; i < wavelen; i++){
+         int wi = (g < ngroups) ? (g * wavelen + i) * grouplen + k
+                                : w * wavelen + i;
+
+         wcos[wi] = sround(dftwaves->waves[w]->cos[i] * (1 << DFT_FIXED_SHIFT));
+         wsin[wi] = sround(dftwaves->waves[w]->sin[i] * (1 << DFT_FIXED_SHIFT));
+      }
+   }
+
+   blkptr = pdata + blkoffset;
+
+   /* Foreach direction ... */
+   for(dir = 0; dir < dftgrids->ngrids; dir++){
+      /* Compute vector of line sums from rotated grid */
+      sum_rot_block_rows(rowsums, blkptr, dftgrids->grids[dir],
+                         dftgrids->grid_w);
+
+#ifdef DFT_VECTOR
+      /* Foreach group of DFT waves ... */
+      for(g = 0; g < ngroups; g++){
+         const int *c = wcos + g * wavelen * DFT_VEC_LEN;
+         const int *sn = wsin + g * wavelen * DFT_VEC_LEN;
+         dft_fixed_vec cospart = { 0 };
+         dft_fixed_vec sinpart = { 0 };
+         dft_fixed_vec cv, sv;
+
+         /* Accumulate cos and sin components of DFT. */
+         for(i = 0; i < wavelen; i++){
+            memcpy(&cv, c + i * DFT_VEC_LEN, sizeof(cv));
+            memcpy(&sv, sn + i * DFT_VEC_LEN, sizeof(sv));
+            cospart += rowsums[i] * cv;
+            sinpart += rowsums[i] * sv;
+         }
+
+         /* Power is the sum of the squared cos and sin components */
+         for(k = 0; k < DFT_VEC_LEN; k++)
+            powers[g * DFT_VEC_LEN + k][dir] =
+                  (double)((int64_t)cospart[k] * cospart[k] +
+                           (int64_t)sinpart[k] * sinpart[k]) * scale;
+      }
+#endif
+
+      /* Remaining DFT waves ... */
+      for(w = ngroups * grouplen; w < nwaves; w++){
+         const int *c = wcos + w * wavelen;
+         const int *sn = wsin + w * wavelen;
+         int cospart = 0, sinpart = 0;
+
+         for(i = 0; i < wavelen; i++){
+            cospart += rowsums[i] * c[i];
+            sinpart += rowsums[i] * sn[i];
+         }
+
+         powers[w][dir] = (double)((int64_t)cospart * cospart +
+                                   (int64_t)sinpart * sinpart) * scale;
+      }
+   }
+
+   /* Deallocate working memory. */
+   lfs_free(rowsums);
+   lfs_free(wcos);
+   lfs_free(wsin);
+}
+
 /*************************************************************************
 **************************************************************************
 #cat: dft_dir_powers - Conducts the DFT analysis on a block of image data.
@@ -113,7 +464,34 @@ int dft_dir_powers(double **powers, unsigned char *pdata,
       fprintf(stderr, "ERROR : dft_dir_powers : DFT grids must be square\n");
       return(-90);
    }
-   rowsums = (int *)g_malloc(dftgrids->grid_w * sizeof(int));
+
+   /* The fixed-point accumulators hold up to the sum of all pixels of */
+   /* a block, each multiplied by at most 1 << DFT_FIXED_SHIFT.        */
+   if(g_atomic_int_get(&dft_fixed_point) &&
+      dftgrids->grid_w * dftwaves->wavelen <=
+            (INT_MAX >> DFT_FIXED_SHIFT) / DFT_FIXED_MAX_PIXEL){
+      dft_dir_powers_fixed(powers, pdata, blkoffset, dftwaves, dftgrids);
+      return(0);
+   }
+
+#ifdef DFT_VECTOR
+   switch(get_dft_kernel()){
+#ifdef DFT_AVX2
+      case DFT_KERNEL_AVX2:
+         dft_dir_powers_avx2(powers, pdata, blkoffset, pw, ph,
+                             dftwaves, dftgrids);
+         return(0);
+#endif
+      case DFT_KERNEL_VECTOR:
+         dft_dir_powers_baseline(powers, pdata, blkoffset, pw, ph,
+                                 dftwaves, dftgrids);
+         return(0);
+      default:
+         break;
+   }
+#endif
+
+   rowsums = (int *)lfs_alloc(dftgrids->grid_w * sizeof(int));
    memset(rowsums, 0, dftgrids->grid_w * sizeof(int));
 
    /* Foreach direction ... */
@@ -131,7 +509,7 @@ int dft_dir_powers(double **powers, unsigned char *pdata,
    }
 
    /* Deallocate working memory. */
-   g_free(rowsums);
+   lfs_free(rowsums);
 
    return(0);
 }
@@ -351,7 +729,7 @@ int sort_dft_waves(int *wis, const double *powmaxs, const double *pownorms,
    double *pownorms2;
 
    /* Allocate normalized power^2 array */
-   pownorms2 = (double *)g_malloc(nstats * sizeof(double));
+   pownorms2 = (double *)lfs_alloc(nstats * sizeof(double));
 
    for(i = 0; i < nstats; i++){
       /* Wis will hold the sorted statistic indices when all is done. */
@@ -364,7 +742,7 @@ int sort_dft_waves(int *wis, const double *powmaxs, const double *pownorms,
    bubble_sort_double_dec_2(pownorms2, wis, nstats);
 
    /* Deallocate the working memory. */
-   g_free(pownorms2);
+   lfs_free(pownorms2);
 
    return(0);
 }
@@ -129,8 +129,8 @@ void free_dir_powers(double **powers, const int nwaves)
    int w;
 
    for(w = 0; w < nwaves; w++)
-      g_free(powers[w]);
+      lfs_free(powers[w]);
 
-   g_free(powers);
+   lfs_free(powers);
 }
 
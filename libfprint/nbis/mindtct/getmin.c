@@ -58,12 +58,35 @@ of the software.
 ***********************************************************************
                ROUTINES:
                         get_minutiae()
+                        get_minutiae_timings()
 
 ***********************************************************************/
 
 #include <stdio.h>
 #include <lfs.h>
 
+/*************************************************************************
+**************************************************************************
+   Moves the list of minutiae out of the arena of the calling thread, so
+   that it stays valid after lfs_arena_end() and can be released by
+   free_minutiae().
+**************************************************************************/
+static MINUTIAE *export_minutiae(MINUTIAE *minutiae)
+{
+   MINUTIA *minutia;
+   int i;
+
+   for(i = 0; i < minutiae->num; i++){
+      minutia = minutiae->list[i];
+      minutia->nbrs = (int *)lfs_arena_export(minutia->nbrs);
+      minutia->ridge_counts = (int *)lfs_arena_export(minutia->ridge_counts);
+      minutiae->list[i] = (MINUTIA *)lfs_arena_export(minutia);
+   }
+   minutiae->list = (MINUTIA **)lfs_arena_export(minutiae->list);
+
+   return((MINUTIAE *)lfs_arena_export(minutiae));
+}
+
 /*************************************************************************
 **************************************************************************
 #cat:   get_minutiae - Takes a grayscale fingerprint image, binarizes the input
@@ -111,6 +134,8 @@ int get_minutiae(MINUTIAE **ominutiae, int **oquality_map,
    int map_w, map_h;
    unsigned char *bdata;
    int bw, bh;
+   LFS_TIMINGS *timings;
+   gint64 start, stage_start;
 
    /* If input image is not 8-bit grayscale ... */
    if(id != 8){
@@ -119,6 +144,11 @@ int get_minutiae(MINUTIAE **ominutiae, int **oquality_map,
       return(-2);
    }
 
+   start = g_get_monotonic_time();
+
+   /* Allocate the working memory from the arena of this thread. */
+   lfs_arena_begin();
+
    /* Detect minutiae in grayscale fingerpeint image. */
    if((ret = lfs_detect_minutiae_V2(&minutiae,
                                    &direction_map, &low_contrast_map,
@@ -126,19 +156,25 @@ int get_minutiae(MINUTIAE **ominutiae, int **oquality_map,
                                    &map_w, &map_h,
                                    &bdata, &bw, &bh,
                                    idata, iw, ih, lfsparms))){
+      lfs_arena_end();
       return(ret);
    }
 
+   /* The detection restarted the stage timings of this thread. */
+   timings = lfs_timings();
+   stage_start = g_get_monotonic_time();
+
    /* Build integrated quality map. */
    if((ret = gen_quality_map(&quality_map,
                             direction_map, low_contrast_map,
                             low_flow_map, high_curve_map, map_w, map_h))){
       free_minutiae(minutiae);
-      g_free(direction_map);
-      g_free(low_contrast_map);
-      g_free(low_flow_map);
-      g_free(high_curve_map);
-      g_free(bdata);
+      lfs_free(direction_map);
+      lfs_free(low_contrast_map);
+      lfs_free(low_flow_map);
+      lfs_free(high_curve_map);
+      lfs_free(bdata);
+      lfs_arena_end();
       return(ret);
    }
 
@@ -147,29 +183,51 @@ int get_minutiae(MINUTIAE **ominutiae, int **oquality_map,
                                      lfsparms->blocksize,
                                      idata, iw, ih, id, ppmm))){
       free_minutiae(minutiae);
-      g_free(direction_map);
-      g_free(low_contrast_map);
-      g_free(low_flow_map);
-      g_free(high_curve_map);
-      g_free(quality_map);
-      g_free(bdata);
+      lfs_free(direction_map);
+      lfs_free(low_contrast_map);
+      lfs_free(low_flow_map);
+      lfs_free(high_curve_map);
+      lfs_free(quality_map);
+      lfs_free(bdata);
+      lfs_arena_end();
       return(ret);
    }
 
-   /* Set output pointers. */
-   *ominutiae = minutiae;
-   *oquality_map = quality_map;
-   *odirection_map = direction_map;
-   *olow_contrast_map = low_contrast_map;
-   *olow_flow_map = low_flow_map;
-   *ohigh_curve_map = high_curve_map;
+   timings->quality = lfs_lap_time(&stage_start);
+
+   /* Set output pointers, moving the results out of the arena. */
+   *ominutiae = export_minutiae(minutiae);
+   *oquality_map = (int *)lfs_arena_export(quality_map);
+   *odirection_map = (int *)lfs_arena_export(direction_map);
+   *olow_contrast_map = (int *)lfs_arena_export(low_contrast_map);
+   *olow_flow_map = (int *)lfs_arena_export(low_flow_map);
+   *ohigh_curve_map = (int *)lfs_arena_export(high_curve_map);
    *omap_w = map_w;
    *omap_h = map_h;
-   *obdata = bdata;
+   *obdata = (unsigned char *)lfs_arena_export(bdata);
    *obw = bw;
    *obh = bh;
    *obd = id;
 
+   lfs_arena_end();
+
+   timings->total = lfs_lap_time(&start);
+
    /* Return normally. */
    return(0);
 }
+
+/*************************************************************************
+**************************************************************************
+#cat:   get_minutiae_timings - Returns the time spent in each stage of the
+#cat:                last minutiae extraction by get_minutiae() on the
+#cat:                calling thread.  The timings are all zero if there was
+#cat:                no extraction on the thread yet.
+
+   Output:
+      otimings - stage timings (in seconds) of the last extraction
+**************************************************************************/
+void get_minutiae_timings(LFS_TIMINGS *otimings)
+{
+   *otimings = *lfs_timings();
+}
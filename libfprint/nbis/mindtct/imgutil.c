@@ -191,7 +191,7 @@ int pad_uchar_image(unsigned char **optr, int *ow, int *oh,
    psize = pw * ph;
 
    /* Allocate padded image */
-   pdata = (unsigned char *)g_malloc(psize * sizeof(unsigned char));
+   pdata = (unsigned char *)lfs_alloc(psize * sizeof(unsigned char));
 
    /* Initialize values to a constant PAD value */
    memset(pdata, pad_value, psize);
@@ -219,29 +219,40 @@ int pad_uchar_image(unsigned char **optr, int *ow, int *oh,
 #cat:              the neighboring 2 pixels are equal, AND the center pixel
 #cat:              is different.  Each hole is filled with the value of its
 #cat:              immediate neighbors. This routine modifies the input image.
+#cat:              Only the holes centered in the given region are filled,
+#cat:              which is all of them if the image is white outside of it.
 
    Input:
       bdata - binary image data to be processed
       iw    - width (in pixels) of the binary input image
       ih    - height (in pixels) of the binary input image
+      rx    - x-pixel coord of origin of region to be processed
+      ry    - y-pixel coord of origin of region to be processed
+      rw    - width (in pixels) of region to be processed
+      rh    - height (in pixels) of region to be processed
    Output:
       bdata - points to the results
 **************************************************************************/
-void fill_holes(unsigned char *bdata, const int iw, const int ih)
+void fill_holes(unsigned char *bdata, const int iw, const int ih,
+                const int rx, const int ry, const int rw, const int rh)
 {
    int ix, iy, iw2;
+   int sx, sy, ex, ey;
    unsigned char *lptr, *mptr, *rptr, *tptr, *bptr, *sptr;
 
    /* 1. Fill 1-pixel wide holes in horizontal runs first ... */
-   sptr = bdata + 1;
-   /* Foreach row in image ... */
-   for(iy = 0; iy < ih; iy++){
+   /* Middle pixels exclude far left and right pixels of the image. */
+   sx = max(rx, 1);
+   ex = min(rx + rw, iw - 1);
+   sptr = bdata + (ry * iw) + sx;
+   /* Foreach row in region ... */
+   for(iy = ry; iy < ry + rh; iy++){
       /* Initialize pointers to start of next line ... */
       lptr = sptr-1;   /* Left pixel   */
       mptr = sptr;     /* Middle pixel */
       rptr = sptr+1;   /* Right pixel  */
-      /* Foreach column in image (less far left and right pixels) ... */
-      for(ix = 1; ix < iw-1; ix++){
+      /* Foreach column in region (less far left and right pixels) ... */
+      for(ix = sx; ix < ex; ix++){
          /* Do we have a horizontal hole of length 1? */
          if((*lptr != *mptr) && (*lptr == *rptr)){
             /* If so, then fill it. */
@@ -267,16 +278,19 @@ void fill_holes(unsigned char *bdata, const int iw, const int ih)
 
    /* 2. Now, fill 1-pixel wide holes in vertical runs ... */
    iw2 = iw<<1;
-   /* Start processing column one row down from the top of the image. */
-   sptr = bdata + iw;
-   /* Foreach column in image ... */
-   for(ix = 0; ix < iw; ix++){
+   /* Middle pixels exclude top and bottom rows of the image. */
+   sy = max(ry, 1);
+   ey = min(ry + rh, ih - 1);
+   /* Start processing columns at the first middle row of the region. */
+   sptr = bdata + (sy * iw) + rx;
+   /* Foreach column in region ... */
+   for(ix = rx; ix < rx + rw; ix++){
       /* Initialize pointers to start of next column ... */
       tptr = sptr-iw;   /* Top pixel     */
       mptr = sptr;      /* Middle pixel  */
       bptr = sptr+iw;   /* Bottom pixel  */
-      /* Foreach row in image (less top and bottom row) ... */
-      for(iy = 1; iy < ih-1; iy++){
+      /* Foreach row in region (less top and bottom row) ... */
+      for(iy = sy; iy < ey; iy++){
          /* Do we have a vertical hole of length 1? */
          if((*tptr != *mptr) && (*tptr == *bptr)){
             /* If so, then fill it. */
@@ -351,8 +365,8 @@ int free_path(const int x1, const int y1, const int x2, const int y2,
          /* If number of transitions seen > than threshold (ex. 2) ... */
          if(trans > lfsparms->maxtrans){
             /* Deallocate the line segment's coordinate lists. */
-            g_free(x_list);
-            g_free(y_list);
+            lfs_free(x_list);
+            lfs_free(y_list);
             /* Return free path to be FALSE. */
             return(FALSE);
          }
@@ -366,8 +380,8 @@ int free_path(const int x1, const int y1, const int x2, const int y2,
 
    /* If we get here we did not exceed the maximum allowable number        */
    /* of transitions.  So, deallocate the line segment's coordinate lists. */
-   g_free(x_list);
-   g_free(y_list);
+   lfs_free(x_list);
+   lfs_free(y_list);
 
    /* Return free path to be TRUE. */
    return(TRUE);
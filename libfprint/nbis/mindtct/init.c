@@ -61,6 +61,9 @@ of the software.
                         get_max_padding()
                         get_max_padding_V2()
                         init_rotgrids()
+                        get_cached_dir2rad()
+                        get_cached_dftwaves()
+                        get_cached_rotgrids()
                         alloc_dir_powers()
                         alloc_power_stats()
 ***********************************************************************/
@@ -530,6 +533,195 @@ int init_rotgrids(ROTGRIDS **optr, const int iw, const int ih, const int ipad,
    return(0);
 }
 
+/*************************************************************************
+**************************************************************************
+   The lookup tables only depend on LFS parameters and on the image width,
+   so they are created on first use and then kept for the lifetime of the
+   process.  The cached tables are shared read-only between all threads.
+**************************************************************************/
+typedef struct lfs_cached_table {
+   int kind;
+   const double *dft_coefs;
+   int iw, ipad, ndirs, nwaves, grid_w, grid_h, relative2;
+   double start_dir_angle;
+   void *table;
+   struct lfs_cached_table *next;
+} LFS_CACHED_TABLE;
+
+#define LFS_CACHED_DIR2RAD    0
+#define LFS_CACHED_DFTWAVES   1
+#define LFS_CACHED_ROTGRIDS   2
+
+static GMutex lfs_table_cache_lock;
+static LFS_CACHED_TABLE *lfs_table_cache;
+
+/* Returns the table of the entry with the same key, or NULL. */
+/* Must be called with lfs_table_cache_lock held.             */
+static void *lookup_cached_table(const LFS_CACHED_TABLE *key)
+{
+   LFS_CACHED_TABLE *entry;
+
+   for(entry = lfs_table_cache; entry != NULL; entry = entry->next){
+      if(entry->kind == key->kind &&
+         entry->dft_coefs == key->dft_coefs &&
+         entry->iw == key->iw && entry->ipad == key->ipad &&
+         entry->ndirs == key->ndirs && entry->nwaves == key->nwaves &&
+         entry->grid_w == key->grid_w && entry->grid_h == key->grid_h &&
+         entry->relative2 == key->relative2 &&
+         entry->start_dir_angle == key->start_dir_angle)
+         return(entry->table);
+   }
+
+   return(NULL);
+}
+
+/* Adds a new table to the cache.                 */
+/* Must be called with lfs_table_cache_lock held. */
+static void add_cached_table(const LFS_CACHED_TABLE *key, void *table)
+{
+   LFS_CACHED_TABLE *entry;
+
+   entry = (LFS_CACHED_TABLE *)g_malloc(sizeof(LFS_CACHED_TABLE));
+   *entry = *key;
+   entry->table = table;
+   entry->next = lfs_table_cache;
+   lfs_table_cache = entry;
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: get_cached_dir2rad - Returns a shared DIR2RAD lookup table, which is
+#cat:                initialized by init_dir2rad() on first use.  The
+#cat:                table must not be modified or freed.
+
+   Input:
+      ndirs - the number of integer directions to be defined in a
+              semicircle
+   Output:
+      optr  - points to the shared DIR2RAD structure
+   Return Code:
+      Zero     - successful completion
+      Negative - system error
+**************************************************************************/
+int get_cached_dir2rad(DIR2RAD **optr, const int ndirs)
+{
+   LFS_CACHED_TABLE key = { 0 };
+   DIR2RAD *dir2rad;
+   int ret = 0;
+
+   key.kind = LFS_CACHED_DIR2RAD;
+   key.ndirs = ndirs;
+
+   g_mutex_lock(&lfs_table_cache_lock);
+   dir2rad = (DIR2RAD *)lookup_cached_table(&key);
+   if(dir2rad == NULL){
+      if((ret = init_dir2rad(&dir2rad, ndirs)) == 0)
+         add_cached_table(&key, dir2rad);
+   }
+   g_mutex_unlock(&lfs_table_cache_lock);
+
+   if(ret)
+      return(ret);
+
+   *optr = dir2rad;
+   return(0);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: get_cached_dftwaves - Returns a shared DFTWAVES lookup table, which is
+#cat:                initialized by init_dftwaves() on first use.  The
+#cat:                table must not be modified or freed.
+
+   Input:
+      dft_coefs - array of multipliers used to define the frequency for
+                  each wave form to be computed, must remain valid and
+                  unchanged for the lifetime of the process
+      nwaves    - number of wave forms to be computed
+      blocksize - the width and height of each block of image data to
+                  be DFT analyzed
+   Output:
+      optr     - points to the shared DFTWAVES structure
+   Return Code:
+      Zero     - successful completion
+      Negative - system error
+**************************************************************************/
+int get_cached_dftwaves(DFTWAVES **optr, const double *dft_coefs,
+                  const int nwaves, const int blocksize)
+{
+   LFS_CACHED_TABLE key = { 0 };
+   DFTWAVES *dftwaves;
+   int ret = 0;
+
+   key.kind = LFS_CACHED_DFTWAVES;
+   key.dft_coefs = dft_coefs;
+   key.nwaves = nwaves;
+   key.grid_w = blocksize;
+
+   g_mutex_lock(&lfs_table_cache_lock);
+   dftwaves = (DFTWAVES *)lookup_cached_table(&key);
+   if(dftwaves == NULL){
+      if((ret = init_dftwaves(&dftwaves, dft_coefs, nwaves, blocksize)) == 0)
+         add_cached_table(&key, dftwaves);
+   }
+   g_mutex_unlock(&lfs_table_cache_lock);
+
+   if(ret)
+      return(ret);
+
+   *optr = dftwaves;
+   return(0);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: get_cached_rotgrids - Returns a shared ROTGRIDS lookup table, which is
+#cat:                initialized by init_rotgrids() on first use.  The
+#cat:                table must not be modified or freed.
+
+   Input:
+      See init_rotgrids().  The offsets do not depend on the height of
+      the image, so tables are shared between images of the same width.
+   Output:
+      optr      - points to the shared ROTGRIDS structure
+   Return Code:
+      Zero     - successful completion
+      Negative - system error
+**************************************************************************/
+int get_cached_rotgrids(ROTGRIDS **optr, const int iw, const int ih,
+                  const int ipad, const double start_dir_angle,
+                  const int ndirs, const int grid_w, const int grid_h,
+                  const int relative2)
+{
+   LFS_CACHED_TABLE key = { 0 };
+   ROTGRIDS *rotgrids;
+   int ret = 0;
+
+   key.kind = LFS_CACHED_ROTGRIDS;
+   key.iw = iw;
+   key.ipad = ipad;
+   key.start_dir_angle = start_dir_angle;
+   key.ndirs = ndirs;
+   key.grid_w = grid_w;
+   key.grid_h = grid_h;
+   key.relative2 = relative2;
+
+   g_mutex_lock(&lfs_table_cache_lock);
+   rotgrids = (ROTGRIDS *)lookup_cached_table(&key);
+   if(rotgrids == NULL){
+      if((ret = init_rotgrids(&rotgrids, iw, ih, ipad, start_dir_angle,
+                              ndirs, grid_w, grid_h, relative2)) == 0)
+         add_cached_table(&key, rotgrids);
+   }
+   g_mutex_unlock(&lfs_table_cache_lock);
+
+   if(ret)
+      return(ret);
+
+   *optr = rotgrids;
+   return(0);
+}
+
 /*************************************************************************
 **************************************************************************
 #cat: alloc_dir_powers - Allocates the memory associated with DFT power
@@ -552,11 +744,11 @@ int alloc_dir_powers(double ***opowers, const int nwaves, const int ndirs)
    double **powers;
 
    /* Allocate list of double pointers to hold power vectors */
-   powers = (double **)g_malloc(nwaves * sizeof(double *));
+   powers = (double **)lfs_alloc(nwaves * sizeof(double *));
    /* Foreach DFT wave ... */
    for(w = 0; w < nwaves; w++){
       /* Allocate power vector for all directions */
-      powers[w] = (double *)g_malloc(ndirs * sizeof(double));
+      powers[w] = (double *)lfs_alloc(ndirs * sizeof(double));
    }
 
    *opowers = powers;
@@ -601,16 +793,16 @@ int alloc_power_stats(int **owis, double **opowmaxs, int **opowmax_dirs,
    ASSERT_SIZE_MUL(nstats, sizeof(double));
 
    /* Allocate DFT wave index vector */
-   wis = (int *)g_malloc(nstats * sizeof(int));
+   wis = (int *)lfs_alloc(nstats * sizeof(int));
 
    /* Allocate max power vector */
-   powmaxs = (double *)g_malloc(nstats * sizeof(double));
+   powmaxs = (double *)lfs_alloc(nstats * sizeof(double));
 
    /* Allocate max power direction vector */
-   powmax_dirs = (int *)g_malloc(nstats * sizeof(int));
+   powmax_dirs = (int *)lfs_alloc(nstats * sizeof(int));
 
    /* Allocate normalized power vector */
-   pownorms = (double *)g_malloc(nstats * sizeof(double));
+   pownorms = (double *)lfs_alloc(nstats * sizeof(double));
 
    *owis = wis;
    *opowmaxs = powmaxs;
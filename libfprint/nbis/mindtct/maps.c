@@ -61,7 +61,11 @@ of the software.
 ***********************************************************************
                ROUTINES:
                         gen_image_maps()
+                        gen_foreground_map()
                         gen_initial_maps()
+                        initial_maps_block()
+                        initial_maps_worker()
+                        select_map_threads()
                         interpolate_direction_map()
                         morph_TF_map()
                         pixelize_map()
@@ -88,6 +92,7 @@ of the software.
 ***********************************************************************/
 
 #include <stdio.h>
+#include <limits.h>
 #include <lfs.h>
 #include <morph.h>
 #include <log.h>
@@ -154,14 +159,14 @@ int gen_image_maps(int **odmap, int **olcmap, int **olfmap, int **ohcmap,
                               &low_flow_map, blkoffs, mw, mh,
                               pdata, pw, ph, dftwaves, dftgrids, lfsparms))){
       /* Free memory allocated to this point. */
-      g_free(blkoffs);
+      lfs_free(blkoffs);
       return(ret);
    }
 
    if((ret = morph_TF_map(low_flow_map, mw, mh, lfsparms))){
-      g_free(direction_map);
-      g_free(low_contrast_map);
-      g_free(low_flow_map);
+      lfs_free(direction_map);
+      lfs_free(low_contrast_map);
+      lfs_free(low_flow_map);
       return(ret);
    }
 
@@ -176,9 +181,9 @@ int gen_image_maps(int **odmap, int **olcmap, int **olfmap, int **ohcmap,
    /* 5. Interpolate INVALID direction blocks with their valid neighbors. */
    if((ret = interpolate_direction_map(direction_map, low_contrast_map,
                                        mw, mh, lfsparms))){
-      g_free(direction_map);
-      g_free(low_contrast_map);
-      g_free(low_flow_map);
+      lfs_free(direction_map);
+      lfs_free(low_contrast_map);
+      lfs_free(low_flow_map);
       return(ret);
    }
 
@@ -198,14 +203,14 @@ int gen_image_maps(int **odmap, int **olcmap, int **olfmap, int **ohcmap,
    /* 9. Generate High Curvature Map from interpolated Direction Map. */
    if((ret = gen_high_curve_map(&high_curve_map, direction_map, mw, mh,
                                 lfsparms))){
-      g_free(direction_map);
-      g_free(low_contrast_map);
-      g_free(low_flow_map);
+      lfs_free(direction_map);
+      lfs_free(low_contrast_map);
+      lfs_free(low_flow_map);
       return(ret);
    }
 
    /* Deallocate working memory. */
-   g_free(blkoffs);
+   lfs_free(blkoffs);
 
    *odmap = direction_map;
    *olcmap = low_contrast_map;
@@ -216,6 +221,383 @@ int gen_image_maps(int **odmap, int **olcmap, int **olfmap, int **ohcmap,
    return(0);
 }
 
+/*************************************************************************
+**************************************************************************
+   Returns the offset of the window surrounding the block at BLKOFFSET
+   in the padded image, which is analyzed for low contrast.  The window
+   is moved so that it does not access padded image pixels.
+**************************************************************************/
+static int contrast_window_offset(const int blkoffset,
+                const int pw, const int ph, const int pad,
+                const LFSPARMS *lfsparms)
+{
+   int xminlimit, xmaxlimit, yminlimit, ymaxlimit;
+   int dft_offset, win_x, win_y;
+
+   /* Compute special window origin limits for determining low contrast.  */
+   /* These pixel limits avoid analyzing the padded borders of the image. */
+   xminlimit = pad;
+   yminlimit = pad;
+   xmaxlimit = pw - pad - lfsparms->windowsize - 1;
+   ymaxlimit = ph - pad - lfsparms->windowsize - 1;
+
+   /* Adjust block offset from pointing to block origin to pointing */
+   /* to surrounding window origin.                                 */
+   dft_offset = blkoffset - (lfsparms->windowoffset * pw) -
+                   lfsparms->windowoffset;
+
+   /* Compute pixel coords of window origin. */
+   win_x = dft_offset % pw;
+   win_y = (int)(dft_offset / pw);
+
+   /* Make sure the current window does not access padded image pixels */
+   /* for analyzing low contrast.                                      */
+   win_x = max(xminlimit, win_x);
+   win_x = min(xmaxlimit, win_x);
+   win_y = max(yminlimit, win_y);
+   win_y = min(ymaxlimit, win_y);
+
+   return((win_y * pw) + win_x);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: gen_foreground_map - Creates a map flagging the blocks of the image
+#cat:             that may belong to the foreground.  The range of pixel
+#cat:             intensities is computed for cells the size of a block,
+#cat:             in a single pass over the image.  A block is background
+#cat:             if the cells covering the window analyzed for its contrast
+#cat:             span less than the minimum contrast delta.  The spread of
+#cat:             the percentiles computed by low_contrast_block() can not
+#cat:             be larger, so these blocks are known to be low contrast
+#cat:             without building their histogram.
+
+   Input:
+      blkoffs   - offsets to the pixel origin of each block in the padded image
+      mw        - number of blocks horizontally in the padded input image
+      mh        - number of blocks vertically in the padded input image
+      pdata     - padded input image data (6 bits [0..64) grayscale)
+      pw        - width (in pixels) of the padded input image
+      ph        - height (in pixels) of the padded input image
+      pad       - width (in pixels) of the padding around the image
+      lfsparms  - parameters and thresholds for controlling LFS
+   Output:
+      ofmap     - points to the newly created Foreground Map
+   Return Code:
+      Zero     - successful completion
+      Negative - system error
+**************************************************************************/
+int gen_foreground_map(int **ofmap, int *blkoffs, const int mw, const int mh,
+                unsigned char *pdata, const int pw, const int ph,
+                const int pad, const LFSPARMS *lfsparms)
+{
+   int *foreground_map;
+   unsigned char *cell_min, *cell_max, *pptr;
+   int iw, ih, cs, cw, ch, csize;
+   int x, y, n, i, ci, bi, cx, cy;
+   int win_offset, win_x, win_y, ex, ey;
+   int vmin, vmax, numpix, prctthresh;
+   double tdbl;
+
+   /* Compute total number of blocks in map */
+   ASSERT_INT_MUL(mw, mh);
+
+   /* Allocate Foreground Map memory */
+   foreground_map = (int *)lfs_alloc(mw * mh * sizeof(int));
+
+   /* Compute the percentile threshold of low_contrast_block().  If */
+   /* it is zero, every percentile spread is the full range of      */
+   /* intensities, so no block can be ruled out.                    */
+   numpix = lfsparms->windowsize * lfsparms->windowsize;
+   tdbl = (lfsparms->percentile_min_max/100.0) * (double)(numpix-1);
+   tdbl = trunc_dbl_precision(tdbl, TRUNC_SCALE);
+   prctthresh = sround(tdbl);
+   if(prctthresh < 1){
+      for(bi = 0; bi < mw * mh; bi++)
+         foreground_map[bi] = TRUE;
+      *ofmap = foreground_map;
+      return(0);
+   }
+
+   /* Compute unpadded image dimensions and cells of the image. */
+   iw = pw - (pad<<1);
+   ih = ph - (pad<<1);
+   cs = lfsparms->blocksize;
+   cw = (iw + cs - 1) / cs;
+   ch = (ih + cs - 1) / cs;
+   csize = cw * ch;
+
+   cell_min = (unsigned char *)lfs_alloc(csize * sizeof(unsigned char));
+   cell_max = (unsigned char *)lfs_alloc(csize * sizeof(unsigned char));
+   memset(cell_min, UCHAR_MAX, csize * sizeof(unsigned char));
+   memset(cell_max, 0, csize * sizeof(unsigned char));
+
+   /* Foreach row of the unpadded image ... */
+   for(y = 0; y < ih; y++){
+      pptr = pdata + ((y + pad) * pw) + pad;
+      ci = (y / cs) * cw;
+      /* Foreach cell along the row ... */
+      for(x = 0; x < iw; x += cs, ci++){
+         n = min(cs, iw - x);
+         for(i = 0; i < n; i++){
+            cell_min[ci] = min(cell_min[ci], pptr[i]);
+            cell_max[ci] = max(cell_max[ci], pptr[i]);
+         }
+         pptr += n;
+      }
+   }
+
+   /* Foreach block in the map ... */
+   for(bi = 0; bi < mw * mh; bi++){
+      win_offset = contrast_window_offset(blkoffs[bi], pw, ph, pad, lfsparms);
+      win_x = (win_offset % pw) - pad;
+      win_y = (win_offset / pw) - pad;
+      ex = win_x + lfsparms->windowsize;
+      ey = win_y + lfsparms->windowsize;
+
+      /* Windows of images smaller than a window are not */
+      /* covered by cells, so leave them to the full test. */
+      if((win_x < 0) || (win_y < 0) || (ex > iw) || (ey > ih)){
+         foreground_map[bi] = TRUE;
+         continue;
+      }
+
+      vmin = UCHAR_MAX;
+      vmax = 0;
+      for(cy = win_y / cs; cy <= (ey - 1) / cs; cy++){
+         for(cx = win_x / cs; cx <= (ex - 1) / cs; cx++){
+            vmin = min(vmin, cell_min[(cy * cw) + cx]);
+            vmax = max(vmax, cell_max[(cy * cw) + cx]);
+         }
+      }
+
+      foreground_map[bi] = ((vmax - vmin) >= lfsparms->min_contrast_delta);
+   }
+
+   lfs_free(cell_min);
+   lfs_free(cell_max);
+
+   *ofmap = foreground_map;
+   return(0);
+}
+
+/*************************************************************************
+**************************************************************************
+   State of gen_initial_maps() shared between all threads analyzing
+   blocks of the image.
+**************************************************************************/
+typedef struct initial_maps_job {
+   int *direction_map, *low_contrast_map, *low_flow_map;
+   int *foreground_map;
+   int *blkoffs;
+   int mw, mh;
+   unsigned char *pdata;
+   int pw, ph;
+   const DFTWAVES *dftwaves;
+   const ROTGRIDS *dftgrids;
+   const LFSPARMS *lfsparms;
+
+   /* Next row of blocks to analyze */
+   int next_row;
+   /* First error encountered, stops all threads */
+   int ret;
+
+   GMutex lock;
+   GCond cond;
+   int pending;
+} INITIAL_MAPS_JOB;
+
+/*************************************************************************
+**************************************************************************
+   Analyzes block BI of the image for gen_initial_maps(), using the
+   given DFT power and statistics working memory.
+**************************************************************************/
+static int initial_maps_block(INITIAL_MAPS_JOB *job, const int bi,
+                double **powers, int *wis, double *powmaxs,
+                int *powmax_dirs, double *pownorms, const int nstats)
+{
+   const LFSPARMS *lfsparms = job->lfsparms;
+   const int pw = job->pw;
+   int ret, blkdir;
+   int low_contrast_offset;
+
+   low_contrast_offset = contrast_window_offset(job->blkoffs[bi], pw,
+                                   job->ph, job->dftgrids->pad, lfsparms);
+
+   print2log("   BLOCK %2d (%2d, %2d) ", bi, bi%job->mw, bi/job->mw);
+
+   /* Blocks of the background are known to be low contrast. */
+   ret = TRUE;
+
+   /* If block is low contrast ... */
+   if(!job->foreground_map[bi] ||
+      (ret = low_contrast_block(low_contrast_offset, lfsparms->windowsize,
+                               job->pdata, pw, job->ph, lfsparms))){
+      /* If system error ... */
+      if(ret < 0)
+         return(ret);
+
+      /* Otherwise, block is low contrast ... */
+      print2log("LOW CONTRAST\n");
+      job->low_contrast_map[bi] = TRUE;
+      /* Direction Map's block is already set to INVALID. */
+      return(0);
+   }
+
+   /* Otherwise, sufficient contrast for DFT processing ... */
+   print2log("\n");
+
+   /* Compute DFT powers */
+   if((ret = dft_dir_powers(powers, job->pdata, low_contrast_offset, pw,
+                            job->ph, job->dftwaves, job->dftgrids)))
+      return(ret);
+
+   /* Compute DFT power statistics, skipping first applied DFT  */
+   /* wave.  This is dependent on how the primary and secondary */
+   /* direction tests work below.                               */
+   if((ret = dft_power_stats(wis, powmaxs, powmax_dirs, pownorms, powers,
+                          1, job->dftwaves->nwaves, job->dftgrids->ngrids)))
+      return(ret);
+
+#ifdef LOG_REPORT /*vvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvv*/
+   {  int _w;
+      fprintf(logfp, "      Power\n");
+      for(_w = 0; _w < nstats; _w++){
+         /* Add 1 to wis[w] to create index to original g_dft_coefs[] */
+         fprintf(logfp, "         wis[%d] %d %12.3f %2d %9.3f %12.3f\n",
+              _w, wis[_w]+1,
+              powmaxs[wis[_w]], powmax_dirs[wis[_w]], pownorms[wis[_w]],
+              powers[0][powmax_dirs[wis[_w]]]);
+      }
+   }
+#endif /*^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^*/
+
+   /* Conduct primary direction test */
+   blkdir = primary_dir_test(powers, wis, powmaxs, powmax_dirs,
+                            pownorms, nstats, lfsparms);
+
+   if(blkdir != INVALID_DIR)
+      job->direction_map[bi] = blkdir;
+   else{
+      /* Conduct secondary (fork) direction test */
+      blkdir = secondary_fork_test(powers, wis, powmaxs, powmax_dirs,
+                            pownorms, nstats, lfsparms);
+      if(blkdir != INVALID_DIR)
+         job->direction_map[bi] = blkdir;
+      /* Otherwise current direction in Direction Map remains INVALID */
+      else
+         /* Flag the block as having LOW RIDGE FLOW. */
+         job->low_flow_map[bi] = TRUE;
+   }
+
+   return(0);
+}
+
+/*************************************************************************
+**************************************************************************
+   Analyzes rows of blocks for gen_initial_maps() until all rows are
+   done or an error occurred.  Runs on the calling thread and on the
+   threads of the pool, each with its own working memory.
+**************************************************************************/
+static void initial_maps_worker(gpointer data, gpointer user_data)
+{
+   INITIAL_MAPS_JOB *job = (INITIAL_MAPS_JOB *)data;
+   double **powers, *powmaxs, *pownorms;
+   int *wis, *powmax_dirs;
+   int nstats, row, bi;
+   int ret;
+
+   /* Draw the working memory from the arena of this thread. */
+   lfs_arena_begin();
+
+   /* Allocate DFT directional power vectors */
+   if((ret = alloc_dir_powers(&powers, job->dftwaves->nwaves,
+                              job->dftgrids->ngrids)))
+      goto done;
+
+   /* Allocate DFT power statistic arrays */
+   /* Compute length of statistics arrays.  Statistics not needed   */
+   /* for the first DFT wave, so the length is number of waves - 1. */
+   nstats = job->dftwaves->nwaves - 1;
+   if((ret = alloc_power_stats(&wis, &powmaxs, &powmax_dirs,
+                            &pownorms, nstats))){
+      free_dir_powers(powers, job->dftwaves->nwaves);
+      goto done;
+   }
+
+   /* Foreach row of blocks not taken by another thread ... */
+   while(ret == 0){
+      row = g_atomic_int_add(&job->next_row, 1);
+      if(row >= job->mh || g_atomic_int_get(&job->ret))
+         break;
+
+      for(bi = row * job->mw; bi < (row + 1) * job->mw && ret == 0; bi++)
+         ret = initial_maps_block(job, bi, powers, wis, powmaxs,
+                                  powmax_dirs, pownorms, nstats);
+   }
+
+   /* Deallocate working memory */
+   free_dir_powers(powers, job->dftwaves->nwaves);
+   lfs_free(wis);
+   lfs_free(powmaxs);
+   lfs_free(powmax_dirs);
+   lfs_free(pownorms);
+
+done:
+   lfs_arena_end();
+
+   /* Keep the first error, which stops all other threads */
+   if(ret)
+      g_atomic_int_compare_and_exchange(&job->ret, 0, ret);
+
+   g_mutex_lock(&job->lock);
+   job->pending--;
+   if(job->pending == 0)
+      g_cond_signal(&job->cond);
+   g_mutex_unlock(&job->lock);
+}
+
+/* Number of threads analyzing the initial maps, zero for one per */
+/* processor.                                                      */
+static int map_threads = 0;
+
+/*************************************************************************
+**************************************************************************
+#cat: select_map_threads - Selects the number of threads analyzing the
+#cat:         blocks of the initial maps, up to MAX_MAP_THREADS.  By
+#cat:         default, or when passing zero, one thread per processor is
+#cat:         used.  Passing one analyzes all blocks on the calling thread,
+#cat:         mainly to validate the maps of several threads against it.
+
+   Input:
+      nthreads - number of threads, or zero for one per processor
+**************************************************************************/
+void select_map_threads(const int nthreads)
+{
+   g_atomic_int_set(&map_threads, max(min(nthreads, MAX_MAP_THREADS), 0));
+}
+
+/*************************************************************************
+**************************************************************************
+   Returns the pool of threads helping gen_initial_maps(), which is
+   created on first use.
+**************************************************************************/
+static GThreadPool *get_initial_maps_pool(void)
+{
+   static gsize pool = 0;
+
+   if(g_once_init_enter(&pool)){
+      GThreadPool *new_pool;
+
+      /* The calling thread always takes part in the analysis */
+      new_pool = g_thread_pool_new(initial_maps_worker, NULL,
+                                   MAX_MAP_THREADS - 1, FALSE, NULL);
+      g_once_init_leave(&pool, (gsize)new_pool);
+   }
+
+   return((GThreadPool *)pool);
+}
+
 /*************************************************************************
 **************************************************************************
 #cat: gen_initial_maps - Creates an initial Direction Map from the given
@@ -259,15 +641,8 @@ int gen_initial_maps(int **odmap, int **olcmap, int **olfmap,
                 const DFTWAVES *dftwaves, const  ROTGRIDS *dftgrids,
                 const LFSPARMS *lfsparms)
 {
-   int *direction_map, *low_contrast_map, *low_flow_map;
-   int bi, bsize, blkdir;
-   int *wis, *powmax_dirs;
-   double **powers, *powmaxs, *pownorms;
-   int nstats;
-   int ret; /* return code */
-   int dft_offset;
-   int xminlimit, xmaxlimit, yminlimit, ymaxlimit;
-   int win_x, win_y, low_contrast_offset;
+   INITIAL_MAPS_JOB job;
+   int bsize, nworkers, i, ret;
 
    print2log("INITIAL MAP\n");
 
@@ -275,173 +650,87 @@ int gen_initial_maps(int **odmap, int **olcmap, int **olfmap,
    ASSERT_INT_MUL(mw, mh);
    bsize = mw * mh;
 
+   memset(&job, 0, sizeof(job));
+
    /* Allocate Direction Map memory */
-   direction_map = (int *)g_malloc(bsize * sizeof(int));
+   job.direction_map = (int *)lfs_alloc(bsize * sizeof(int));
    /* Initialize the Direction Map to INVALID (-1). */
-   memset(direction_map, INVALID_DIR, bsize * sizeof(int));
+   memset(job.direction_map, INVALID_DIR, bsize * sizeof(int));
 
    /* Allocate Low Contrast Map memory */
-   low_contrast_map = (int *)g_malloc(bsize * sizeof(int));
+   job.low_contrast_map = (int *)lfs_alloc(bsize * sizeof(int));
    /* Initialize the Low Contrast Map to FALSE (0). */
-   memset(low_contrast_map, 0, bsize * sizeof(int));
+   memset(job.low_contrast_map, 0, bsize * sizeof(int));
 
    /* Allocate Low Ridge Flow Map memory */
-   low_flow_map = (int *)g_malloc(bsize * sizeof(int));
+   job.low_flow_map = (int *)lfs_alloc(bsize * sizeof(int));
    /* Initialize the Low Flow Map to FALSE (0). */
-   memset(low_flow_map, 0, bsize * sizeof(int));
-
-   /* Allocate DFT directional power vectors */
-   if((ret = alloc_dir_powers(&powers, dftwaves->nwaves, dftgrids->ngrids))){
-      /* Free memory allocated to this point. */
-      g_free(direction_map);
-      g_free(low_contrast_map);
-      g_free(low_flow_map);
+   memset(job.low_flow_map, 0, bsize * sizeof(int));
+
+   /* Find the blocks that may belong to the foreground, so that */
+   /* the background is not analyzed any further.                */
+   if((ret = gen_foreground_map(&job.foreground_map, blkoffs, mw, mh,
+                                pdata, pw, ph, dftgrids->pad, lfsparms))){
+      lfs_free(job.direction_map);
+      lfs_free(job.low_contrast_map);
+      lfs_free(job.low_flow_map);
       return(ret);
    }
 
-   /* Allocate DFT power statistic arrays */
-   /* Compute length of statistics arrays.  Statistics not needed   */
-   /* for the first DFT wave, so the length is number of waves - 1. */
-   nstats = dftwaves->nwaves - 1;
-   if((ret = alloc_power_stats(&wis, &powmaxs, &powmax_dirs,
-                            &pownorms, nstats))){
-      /* Free memory allocated to this point. */
-      g_free(direction_map);
-      g_free(low_contrast_map);
-      g_free(low_flow_map);
-      free_dir_powers(powers, dftwaves->nwaves);
-      return(ret);
-   }
-
-   /* Compute special window origin limits for determining low contrast.  */
-   /* These pixel limits avoid analyzing the padded borders of the image. */
-   xminlimit = dftgrids->pad;
-   yminlimit = dftgrids->pad;
-   xmaxlimit = pw - dftgrids->pad - lfsparms->windowsize - 1;
-   ymaxlimit = ph - dftgrids->pad - lfsparms->windowsize - 1;
-
-   /* Foreach block in image ... */
-   for(bi = 0; bi < bsize; bi++){
-      /* Adjust block offset from pointing to block origin to pointing */
-      /* to surrounding window origin.                                 */
-      dft_offset = blkoffs[bi] - (lfsparms->windowoffset * pw) -
-                      lfsparms->windowoffset;
-
-      /* Compute pixel coords of window origin. */
-      win_x = dft_offset % pw;
-      win_y = (int)(dft_offset / pw);
-
-      /* Make sure the current window does not access padded image pixels */
-      /* for analyzing low contrast.                                      */
-      win_x = max(xminlimit, win_x);
-      win_x = min(xmaxlimit, win_x);
-      win_y = max(yminlimit, win_y);
-      win_y = min(ymaxlimit, win_y);
-      low_contrast_offset = (win_y * pw) + win_x;
-
-      print2log("   BLOCK %2d (%2d, %2d) ", bi, bi%mw, bi/mw);
-
-      /* If block is low contrast ... */
-      if((ret = low_contrast_block(low_contrast_offset, lfsparms->windowsize,
-                                  pdata, pw, ph, lfsparms))){
-         /* If system error ... */
-         if(ret < 0){
-            g_free(direction_map);
-            g_free(low_contrast_map);
-            g_free(low_flow_map);
-            free_dir_powers(powers, dftwaves->nwaves);
-            g_free(wis);
-            g_free(powmaxs);
-            g_free(powmax_dirs);
-            g_free(pownorms);
-            return(ret);
-         }
+   job.blkoffs = blkoffs;
+   job.mw = mw;
+   job.mh = mh;
+   job.pdata = pdata;
+   job.pw = pw;
+   job.ph = ph;
+   job.dftwaves = dftwaves;
+   job.dftgrids = dftgrids;
+   job.lfsparms = lfsparms;
+
+   /* Every block only depends on the image, so rows of blocks are     */
+   /* analyzed by several threads at once, giving the same maps as     */
+   /* analyzing them in order.  The log report needs the serial order. */
+#ifdef LOG_REPORT
+   nworkers = 1;
+#else
+   nworkers = g_atomic_int_get(&map_threads);
+   if(nworkers == 0)
+      nworkers = (int)g_get_num_processors();
+   nworkers = min(min(nworkers, MAX_MAP_THREADS), mh);
+   nworkers = max(nworkers, 1);
+#endif
 
-         /* Otherwise, block is low contrast ... */
-         print2log("LOW CONTRAST\n");
-         low_contrast_map[bi] = TRUE;
-         /* Direction Map's block is already set to INVALID. */
-      }
-      /* Otherwise, sufficient contrast for DFT processing ... */
-      else {
-         print2log("\n");
-
-         /* Compute DFT powers */
-         if((ret = dft_dir_powers(powers, pdata, low_contrast_offset, pw, ph,
-                               dftwaves, dftgrids))){
-            /* Free memory allocated to this point. */
-            g_free(direction_map);
-            g_free(low_contrast_map);
-            g_free(low_flow_map);
-            free_dir_powers(powers, dftwaves->nwaves);
-            g_free(wis);
-            g_free(powmaxs);
-            g_free(powmax_dirs);
-            g_free(pownorms);
-            return(ret);
-         }
+   job.pending = nworkers;
+   g_mutex_init(&job.lock);
+   g_cond_init(&job.cond);
 
-         /* Compute DFT power statistics, skipping first applied DFT  */
-         /* wave.  This is dependent on how the primary and secondary */
-         /* direction tests work below.                               */
-         if((ret = dft_power_stats(wis, powmaxs, powmax_dirs, pownorms, powers,
-                                1, dftwaves->nwaves, dftgrids->ngrids))){
-            /* Free memory allocated to this point. */
-            g_free(direction_map);
-            g_free(low_contrast_map);
-            g_free(low_flow_map);
-            free_dir_powers(powers, dftwaves->nwaves);
-            g_free(wis);
-            g_free(powmaxs);
-            g_free(powmax_dirs);
-            g_free(pownorms);
-            return(ret);
-         }
+   for(i = 1; i < nworkers; i++)
+      g_thread_pool_push(get_initial_maps_pool(), &job, NULL);
 
-#ifdef LOG_REPORT /*vvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvv*/
-         {  int _w;
-            fprintf(logfp, "      Power\n");
-            for(_w = 0; _w < nstats; _w++){
-               /* Add 1 to wis[w] to create index to original g_dft_coefs[] */
-               fprintf(logfp, "         wis[%d] %d %12.3f %2d %9.3f %12.3f\n",
-                    _w, wis[_w]+1,
-                    powmaxs[wis[_w]], powmax_dirs[wis[_w]], pownorms[wis[_w]],
-                    powers[0][powmax_dirs[wis[_w]]]);
-            }
-         }
-#endif /*^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^*/
+   /* The calling thread always takes part. */
+   initial_maps_worker(&job, NULL);
 
-         /* Conduct primary direction test */
-         blkdir = primary_dir_test(powers, wis, powmaxs, powmax_dirs,
-                                  pownorms, nstats, lfsparms);
+   g_mutex_lock(&job.lock);
+   while(job.pending > 0)
+      g_cond_wait(&job.cond, &job.lock);
+   g_mutex_unlock(&job.lock);
 
-         if(blkdir != INVALID_DIR)
-            direction_map[bi] = blkdir;
-         else{
-            /* Conduct secondary (fork) direction test */
-            blkdir = secondary_fork_test(powers, wis, powmaxs, powmax_dirs,
-                                  pownorms, nstats, lfsparms);
-            if(blkdir != INVALID_DIR)
-               direction_map[bi] = blkdir;
-            /* Otherwise current direction in Direction Map remains INVALID */
-            else
-               /* Flag the block as having LOW RIDGE FLOW. */
-               low_flow_map[bi] = TRUE;
-         }
+   g_cond_clear(&job.cond);
+   g_mutex_clear(&job.lock);
 
-      } /* End DFT */
-   } /* bi */
+   lfs_free(job.foreground_map);
 
-   /* Deallocate working memory */
-   free_dir_powers(powers, dftwaves->nwaves);
-   g_free(wis);
-   g_free(powmaxs);
-   g_free(powmax_dirs);
-   g_free(pownorms);
+   if(job.ret){
+      /* Free memory allocated to this point. */
+      lfs_free(job.direction_map);
+      lfs_free(job.low_contrast_map);
+      lfs_free(job.low_flow_map);
+      return(job.ret);
+   }
 
-   *odmap = direction_map;
-   *olcmap = low_contrast_map;
-   *olfmap = low_flow_map;
+   *odmap = job.direction_map;
+   *olcmap = job.low_contrast_map;
+   *olfmap = job.low_flow_map;
    return(0);
 }
 
@@ -487,7 +776,7 @@ int interpolate_direction_map(int *direction_map, int *low_contrast_map,
    /* Allocate output (interpolated) Direction Map. */
    ASSERT_SIZE_MUL(mw, mh);
    ASSERT_SIZE_MUL(mw * mh, sizeof(int));
-   omap = (int *)g_malloc(mw * mh * sizeof(int));
+   omap = (int *)lfs_alloc(mw * mh * sizeof(int));
 
    /* Set pointers to the first block in the maps. */
    dptr = direction_map;
@@ -627,7 +916,7 @@ int interpolate_direction_map(int *direction_map, int *low_contrast_map,
    /* Copy the interpolated directions into the input map. */
    memcpy(direction_map, omap, mw*mh*sizeof(int));
    /* Deallocate the working memory. */
-   g_free(omap);
+   lfs_free(omap);
 
    /* Return normally. */
    return(0);
@@ -657,9 +946,9 @@ int morph_TF_map(int *tfmap, const int mw, const int mh,
    ASSERT_INT_MUL(mw, mh);
 
    /* Convert TRUE/FALSE map into a binary byte image. */
-   cimage = (unsigned char *)g_malloc(mw * mh);
+   cimage = (unsigned char *)lfs_alloc(mw * mh);
 
-   mimage = (unsigned char *)g_malloc(mw * mh);
+   mimage = (unsigned char *)lfs_alloc(mw * mh);
 
    cptr = cimage;
    mptr = tfmap;
@@ -678,8 +967,8 @@ int morph_TF_map(int *tfmap, const int mw, const int mh,
       *mptr++ = *cptr++;
    }
 
-   g_free(cimage);
-   g_free(mimage);
+   lfs_free(cimage);
+   lfs_free(mimage);
 
    return(0);
 }
@@ -714,16 +1003,16 @@ int pixelize_map(int **omap, const int iw, const int ih,
    ASSERT_SIZE_MUL(iw, ih);
    ASSERT_SIZE_MUL(iw * ih, sizeof(int));
 
-   pmap = (int *)g_malloc(iw * ih * sizeof(int));
+   pmap = (int *)lfs_alloc(iw * ih * sizeof(int));
 
    if((ret = block_offsets(&blkoffs, &bw, &bh, iw, ih, 0, blocksize))){
-      g_free(pmap);
+      lfs_free(pmap);
       return(ret);
    }
 
    if((bw != mw) || (bh != mh)){
-      g_free(blkoffs);
-      g_free(pmap);
+      lfs_free(blkoffs);
+      lfs_free(pmap);
       fprintf(stderr,
          "ERROR : pixelize_map : block dimensions do not match\n");
       return(-591);
@@ -741,7 +1030,7 @@ int pixelize_map(int **omap, const int iw, const int ih,
    }
 
    /* Deallocate working memory. */
-   g_free(blkoffs);
+   lfs_free(blkoffs);
    /* Assign pixelized map to output pointer. */
    *omap = pmap;
 
@@ -874,7 +1163,7 @@ int gen_high_curve_map(int **ohcmap, int *direction_map,
 
    /* Allocate High Curvature Map. */
    ASSERT_SIZE_MUL(mapsize, sizeof(int));
-   high_curve_map = (int *)g_malloc(mapsize * sizeof(int));
+   high_curve_map = (int *)lfs_alloc(mapsize * sizeof(int));
    /* Initialize High Curvature Map to FALSE (0). */
    memset(high_curve_map, 0, mapsize*sizeof(int));
 
@@ -62,6 +62,11 @@ of the software.
                         detect_minutiae_V2()
                         update_minutiae()
                         update_minutiae_V2()
+                        alloc_minutiae_grid()
+                        free_minutiae_grid()
+                        add_grid_minutia()
+                        find_grid_minutiae()
+                        remove_grid_minutia()
                         sort_minutiae_y_x()
                         sort_minutiae_x_y()
                         rm_dup_minutiae()
@@ -118,8 +123,8 @@ int alloc_minutiae(MINUTIAE **ominutiae, const int DEFAULT_BOZORTH_MINUTIAE)
 {
    MINUTIAE *minutiae;
 
-   minutiae = (MINUTIAE *)g_malloc(sizeof(MINUTIAE));
-   minutiae->list = (MINUTIA **)g_malloc(DEFAULT_BOZORTH_MINUTIAE * sizeof(MINUTIA *));
+   minutiae = (MINUTIAE *)lfs_alloc(sizeof(MINUTIAE));
+   minutiae->list = (MINUTIA **)lfs_alloc(DEFAULT_BOZORTH_MINUTIAE * sizeof(MINUTIA *));
 
    minutiae->alloc = DEFAULT_BOZORTH_MINUTIAE;
    minutiae->num = 0;
@@ -146,7 +151,7 @@ int alloc_minutiae(MINUTIAE **ominutiae, const int DEFAULT_BOZORTH_MINUTIAE)
 int realloc_minutiae(MINUTIAE *minutiae, const int incr_minutiae)
 {
    minutiae->alloc += incr_minutiae;
-   minutiae->list = (MINUTIA **)g_realloc(minutiae->list,
+   minutiae->list = (MINUTIA **)lfs_realloc(minutiae->list,
                                           minutiae->alloc * sizeof(MINUTIA *));
 
    return(0);
@@ -206,6 +211,8 @@ int detect_minutiae_V2(MINUTIAE *minutiae,
 {
    int ret;
    int *pdirection_map, *plow_flow_map, *phigh_curve_map;
+   int sx, sy, sw, sh;
+   MINUTIAE_GRID *grid;
 
    /* Pixelize the maps by assigning block values to individual pixels. */
    if((ret = pixelize_map(&pdirection_map, iw, ih, direction_map, mw, mh,
@@ -215,37 +222,57 @@ int detect_minutiae_V2(MINUTIAE *minutiae,
 
    if((ret = pixelize_map(&plow_flow_map, iw, ih, low_flow_map, mw, mh,
                          lfsparms->blocksize))){
-      g_free(pdirection_map);
+      lfs_free(pdirection_map);
       return(ret);
    }
 
    if((ret = pixelize_map(&phigh_curve_map, iw, ih, high_curve_map, mw, mh,
                          lfsparms->blocksize))){
-      g_free(pdirection_map);
-      g_free(plow_flow_map);
+      lfs_free(pdirection_map);
+      lfs_free(plow_flow_map);
       return(ret);
    }
 
-   if((ret = scan4minutiae_horizontally_V2(minutiae, bdata, iw, ih,
-                 pdirection_map, plow_flow_map, phigh_curve_map, lfsparms))){
-      g_free(pdirection_map);
-      g_free(plow_flow_map);
-      g_free(phigh_curve_map);
+   /* Index the detected minutiae by location, so that each new one is */
+   /* only compared to those that are close enough to be the same.     */
+   if((ret = alloc_minutiae_grid(&grid, minutiae, iw, ih,
+                                 lfsparms->max_minutia_delta))){
+      lfs_free(pdirection_map);
+      lfs_free(plow_flow_map);
+      lfs_free(phigh_curve_map);
       return(ret);
    }
 
-   if((ret = scan4minutiae_vertically_V2(minutiae, bdata, iw, ih,
-                 pdirection_map, plow_flow_map, phigh_curve_map, lfsparms))){
-      g_free(pdirection_map);
-      g_free(plow_flow_map);
-      g_free(phigh_curve_map);
+   /* The binary image is white outside of the blocks with valid */
+   /* direction, so only the region holding them is scanned.     */
+   foreground_region(&sx, &sy, &sw, &sh, direction_map, mw, mh,
+                     iw, ih, lfsparms->blocksize);
+
+   if((ret = scan4minutiae_horizontally_V2(minutiae, grid, bdata, iw, ih,
+                 pdirection_map, plow_flow_map, phigh_curve_map,
+                 sx, sy, sw, sh, lfsparms))){
+      free_minutiae_grid(grid);
+      lfs_free(pdirection_map);
+      lfs_free(plow_flow_map);
+      lfs_free(phigh_curve_map);
+      return(ret);
+   }
+
+   if((ret = scan4minutiae_vertically_V2(minutiae, grid, bdata, iw, ih,
+                 pdirection_map, plow_flow_map, phigh_curve_map,
+                 sx, sy, sw, sh, lfsparms))){
+      free_minutiae_grid(grid);
+      lfs_free(pdirection_map);
+      lfs_free(plow_flow_map);
+      lfs_free(phigh_curve_map);
       return(ret);
    }
 
    /* Deallocate working memories. */
-   g_free(pdirection_map);
-   g_free(plow_flow_map);
-   g_free(phigh_curve_map);
+   free_minutiae_grid(grid);
+   lfs_free(pdirection_map);
+   lfs_free(plow_flow_map);
+   lfs_free(phigh_curve_map);
 
    /* Return normally. */
    return(0);
@@ -379,6 +406,7 @@ int update_minutiae(MINUTIAE *minutiae, MINUTIA *minutia,
 #cat:                it to the list.
 
    Input:
+      grid      - location index of the minutiae in the list
       minutia   - minutia structure for detected point
       scan_dir  - orientation of scan when minutia was detected
       dmapval   - directional ridge flow of block minutia is in
@@ -388,19 +416,22 @@ int update_minutiae(MINUTIAE *minutiae, MINUTIA *minutia,
       lfsparms  - parameters and thresholds for controlling LFS
    Output:
       minutiae   - points to a list of detected minutia structures
+      grid       - updated location index
    Return Code:
       Zero      - minutia added to successfully added to minutiae list
       IGNORE    - minutia is to be ignored (already in the minutiae list)
       Negative  - system error
 **************************************************************************/
-int update_minutiae_V2(MINUTIAE *minutiae, MINUTIA *minutia,
+int update_minutiae_V2(MINUTIAE *minutiae, MINUTIAE_GRID *grid,
+                   MINUTIA *minutia,
                    const int scan_dir, const int dmapval,
                    unsigned char *bdata, const int iw, const int ih,
                    const LFSPARMS *lfsparms)
 {
-   int i, ret, dy, dx, delta_dir;
+   int i, c, ret, dy, dx, delta_dir;
    int qtr_ndirs, full_ndirs;
    int map_scan_dir;
+   int ncands;
 
    /* Check to see if minutiae list is full ... if so, then extend */
    /* the length of the allocated list of minutia points.          */
@@ -420,8 +451,13 @@ int update_minutiae_V2(MINUTIAE *minutiae, MINUTIA *minutia,
 
    /* Is the minutiae list empty? */
    if(minutiae->num > 0){
-      /* Foreach minutia stored in the list (in reverse order) ... */
-      for(i = minutiae->num-1; i >= 0; i--){
+      /* Only minutiae in the neighboring cells of the grid can be */
+      /* close enough to the new minutia to be compared with it.   */
+      ncands = find_grid_minutiae(grid, minutiae, minutia->x, minutia->y);
+
+      /* Foreach of these minutia stored in the list (in reverse order) ... */
+      for(c = 0; c < ncands; c++){
+         i = grid->cands[c];
          /* If x distance between new minutia and current list minutia */
          /* are sufficiently close...                                 */
          dx = abs(minutiae->list[i]->x - minutia->x);
@@ -472,7 +508,8 @@ int update_minutiae_V2(MINUTIAE *minutiae, MINUTIA *minutia,
                            if(map_scan_dir == scan_dir){
                               /* Then choose the new minutia over the one */
                               /* currently in the list.                   */
-                              if((ret = remove_minutia(i, minutiae))){
+                              if((ret = remove_grid_minutia(i, minutiae,
+                                                            grid))){
                                  return(ret);
                               }
                               /* Continue on ... */
@@ -507,6 +544,7 @@ int update_minutiae_V2(MINUTIAE *minutiae, MINUTIA *minutia,
 
    /* Otherwise, assume new minutia is not in the list, or those that */
    /* were close neighbors were selectively removed, so add it.       */
+   add_grid_minutia(grid, minutia, minutiae->num);
    minutiae->list[minutiae->num] = minutia;
    (minutiae->num)++;
 
@@ -515,6 +553,212 @@ int update_minutiae_V2(MINUTIAE *minutiae, MINUTIA *minutia,
    return(0);
 }
 
+/*************************************************************************
+**************************************************************************
+#cat: alloc_minutiae_grid - Allocates an index of the minutiae in a list by
+#cat:                their location, which is a grid of square cells with
+#cat:                the minutiae in each cell kept in list order.  The
+#cat:                minutiae already in the list are added to the grid.
+
+   Input:
+      minutiae  - list of minutiae
+      iw        - width (in pixels) of image
+      ih        - height (in pixels) of image
+      cell_size - pixel dimension of a grid cell
+   Output:
+      ogrid     - points to the new grid
+   Return Code:
+      Zero      - successful completion
+      Negative  - system error
+**************************************************************************/
+int alloc_minutiae_grid(MINUTIAE_GRID **ogrid, MINUTIAE *minutiae,
+                        const int iw, const int ih, const int cell_size)
+{
+   MINUTIAE_GRID *grid;
+   int i, ncells;
+
+   if(cell_size <= 0){
+      fprintf(stderr, "ERROR : alloc_minutiae_grid : invalid cell size\n");
+      return(-390);
+   }
+
+   grid = (MINUTIAE_GRID *)lfs_alloc(sizeof(MINUTIAE_GRID));
+   grid->cell_size = cell_size;
+   grid->grid_w = (iw + cell_size - 1) / cell_size;
+   grid->grid_h = (ih + cell_size - 1) / cell_size;
+   ncells = grid->grid_w * grid->grid_h;
+
+   grid->heads = (int *)lfs_alloc(ncells * sizeof(int));
+   for(i = 0; i < ncells; i++)
+      grid->heads[i] = -1;
+
+   grid->alloc = max(minutiae->alloc, MAX_MINUTIAE);
+   grid->entries = (MINUTIA **)lfs_alloc(grid->alloc * sizeof(MINUTIA *));
+   grid->next = (int *)lfs_alloc(grid->alloc * sizeof(int));
+   grid->seqs = (int *)lfs_alloc(grid->alloc * sizeof(int));
+   grid->cands = (int *)lfs_alloc(grid->alloc * sizeof(int));
+   grid->nentries = 0;
+
+   for(i = 0; i < minutiae->num; i++)
+      add_grid_minutia(grid, minutiae->list[i], i);
+
+   *ogrid = grid;
+   return(0);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: free_minutiae_grid - Deallocates a grid allocated by
+#cat:                alloc_minutiae_grid().
+
+   Input:
+      grid      - grid to be deallocated
+**************************************************************************/
+void free_minutiae_grid(MINUTIAE_GRID *grid)
+{
+   lfs_free(grid->cands);
+   lfs_free(grid->seqs);
+   lfs_free(grid->next);
+   lfs_free(grid->entries);
+   lfs_free(grid->heads);
+   lfs_free(grid);
+}
+
+/* Returns the cell of the grid containing the given pixel. */
+static int grid_cell(const MINUTIAE_GRID *grid, const int cx, const int cy)
+{
+   return(cy * grid->grid_w + cx);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: add_grid_minutia - Adds a minutia, which is appended to the list of
+#cat:                minutiae at the given position, to the grid.
+
+   Input:
+      grid      - grid of the list of minutiae
+      minutia   - minutia being added to the list
+      index     - position of the minutia in the list
+   Output:
+      grid      - updated grid
+**************************************************************************/
+void add_grid_minutia(MINUTIAE_GRID *grid, MINUTIA *minutia, const int index)
+{
+   int entry, cell, cx, cy;
+
+   /* Entries are never reused, so extend the lists when full. */
+   if(grid->nentries >= grid->alloc){
+      grid->alloc += MAX_MINUTIAE;
+      grid->entries = (MINUTIA **)lfs_realloc(grid->entries,
+                                       grid->alloc * sizeof(MINUTIA *));
+      grid->next = (int *)lfs_realloc(grid->next, grid->alloc * sizeof(int));
+      grid->seqs = (int *)lfs_realloc(grid->seqs, grid->alloc * sizeof(int));
+      grid->cands = (int *)lfs_realloc(grid->cands,
+                                       grid->alloc * sizeof(int));
+   }
+
+   cx = min(max(minutia->x / grid->cell_size, 0), grid->grid_w - 1);
+   cy = min(max(minutia->y / grid->cell_size, 0), grid->grid_h - 1);
+   cell = grid_cell(grid, cx, cy);
+
+   entry = grid->nentries++;
+   grid->entries[entry] = minutia;
+   grid->next[entry] = grid->heads[cell];
+   grid->heads[cell] = entry;
+   grid->seqs[index] = entry;
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: find_grid_minutiae - Finds the minutiae of the list in the grid cells
+#cat:                surrounding a pixel, which include all minutiae that
+#cat:                are closer than the cell size along both axes.
+
+   Input:
+      grid      - grid of the list of minutiae
+      minutiae  - list of minutiae
+      x         - x-pixel coord of the search location
+      y         - y-pixel coord of the search location
+   Output:
+      grid      - cands holds the positions of the minutiae found in the
+                  list, in decreasing order
+   Return Code:
+      Number of minutiae found
+**************************************************************************/
+int find_grid_minutiae(MINUTIAE_GRID *grid, MINUTIAE *minutiae,
+                       const int x, const int y)
+{
+   int cx, cy, sx, ex, sy, ey;
+   int entry, index, lo, hi, mid;
+   int i, ncands;
+
+   sx = max(x / grid->cell_size - 1, 0);
+   ex = min(x / grid->cell_size + 1, grid->grid_w - 1);
+   sy = max(y / grid->cell_size - 1, 0);
+   ey = min(y / grid->cell_size + 1, grid->grid_h - 1);
+
+   ncands = 0;
+   for(cy = sy; cy <= ey; cy++){
+      for(cx = sx; cx <= ex; cx++){
+         for(entry = grid->heads[grid_cell(grid, cx, cy)]; entry >= 0;
+             entry = grid->next[entry]){
+            /* Skip minutiae removed from the list. */
+            if(grid->entries[entry] == NULL)
+               continue;
+
+            /* Entries are in list order, so look up the list position */
+            /* with a binary search.                                   */
+            lo = 0;
+            hi = minutiae->num - 1;
+            while(lo < hi){
+               mid = (lo + hi) >> 1;
+               if(grid->seqs[mid] < entry)
+                  lo = mid + 1;
+               else
+                  hi = mid;
+            }
+            index = lo;
+
+            /* Insert into the list of positions in decreasing order. */
+            for(i = ncands; i > 0 && grid->cands[i-1] < index; i--)
+               grid->cands[i] = grid->cands[i-1];
+            grid->cands[i] = index;
+            ncands++;
+         }
+      }
+   }
+
+   return(ncands);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: remove_grid_minutia - Removes the specified minutia point from the
+#cat:                input list of minutiae and from its grid.
+
+   Input:
+      index      - position of minutia to be removed from list
+      minutiae   - input list of minutiae
+      grid       - grid of the list of minutiae
+   Output:
+      minutiae   - list with minutia removed
+      grid       - updated grid
+   Return Code:
+      Zero      - successful completion
+      Negative  - system error
+**************************************************************************/
+int remove_grid_minutia(const int index, MINUTIAE *minutiae,
+                        MINUTIAE_GRID *grid)
+{
+   int i;
+
+   grid->entries[grid->seqs[index]] = NULL;
+   for(i = index + 1; i < minutiae->num; i++)
+      grid->seqs[i-1] = grid->seqs[i];
+
+   return(remove_minutia(index, minutiae));
+}
+
 /*************************************************************************
 **************************************************************************
 #cat: sort_minutiae_y_x - Takes a list of minutia points and sorts them
@@ -538,7 +782,7 @@ int sort_minutiae_y_x(MINUTIAE *minutiae, const int iw, const int ih)
 
    /* Allocate a list of integers to hold 1-D image pixel offsets */
    /* for each of the 2-D minutia coordinate points.               */
-   ranks = (int *)g_malloc(minutiae->num * sizeof(int));
+   ranks = (int *)lfs_alloc(minutiae->num * sizeof(int));
 
    /* Compute 1-D image pixel offsets form 2-D minutia coordinate points. */
    for(i = 0; i < minutiae->num; i++)
@@ -546,25 +790,25 @@ int sort_minutiae_y_x(MINUTIAE *minutiae, const int iw, const int ih)
 
    /* Get sorted order of minutiae. */
    if((ret = sort_indices_int_inc(&order, ranks, minutiae->num))){
-      g_free(ranks);
+      lfs_free(ranks);
       return(ret);
    }
 
    /* Allocate new MINUTIA list to hold sorted minutiae. */
-   newlist = (MINUTIA **)g_malloc(minutiae->num * sizeof(MINUTIA *));
+   newlist = (MINUTIA **)lfs_alloc(minutiae->num * sizeof(MINUTIA *));
 
    /* Put minutia into sorted order in new list. */
    for(i = 0; i < minutiae->num; i++)
       newlist[i] = minutiae->list[order[i]];
 
    /* Deallocate non-sorted list of minutia pointers. */
-   g_free(minutiae->list);
+   lfs_free(minutiae->list);
    /* Assign new sorted list of minutia to minutiae list. */
    minutiae->list = newlist;
 
    /* Free the working memories supporting the sort. */
-   g_free(order);
-   g_free(ranks);
+   lfs_free(order);
+   lfs_free(ranks);
 
    /* Return normally. */
    return(0);
@@ -593,7 +837,7 @@ int sort_minutiae_x_y(MINUTIAE *minutiae, const int iw, const int ih)
 
    /* Allocate a list of integers to hold 1-D image pixel offsets */
    /* for each of the 2-D minutia coordinate points.               */
-   ranks = (int *)g_malloc(minutiae->num * sizeof(int));
+   ranks = (int *)lfs_alloc(minutiae->num * sizeof(int));
 
    /* Compute 1-D image pixel offsets form 2-D minutia coordinate points. */
    for(i = 0; i < minutiae->num; i++)
@@ -601,25 +845,25 @@ int sort_minutiae_x_y(MINUTIAE *minutiae, const int iw, const int ih)
 
    /* Get sorted order of minutiae. */
    if((ret = sort_indices_int_inc(&order, ranks, minutiae->num))){
-      g_free(ranks);
+      lfs_free(ranks);
       return(ret);
    }
 
    /* Allocate new MINUTIA list to hold sorted minutiae. */
-   newlist = (MINUTIA **)g_malloc(minutiae->num * sizeof(MINUTIA *));
+   newlist = (MINUTIA **)lfs_alloc(minutiae->num * sizeof(MINUTIA *));
 
    /* Put minutia into sorted order in new list. */
    for(i = 0; i < minutiae->num; i++)
       newlist[i] = minutiae->list[order[i]];
 
    /* Deallocate non-sorted list of minutia pointers. */
-   g_free(minutiae->list);
+   lfs_free(minutiae->list);
    /* Assign new sorted list of minutia to minutiae list. */
    minutiae->list = newlist;
 
    /* Free the working memories supporting the sort. */
-   g_free(order);
-   g_free(ranks);
+   lfs_free(order);
+   lfs_free(ranks);
 
    /* Return normally. */
    return(0);
@@ -732,7 +976,7 @@ int create_minutia(MINUTIA **ominutia, const int x_loc, const int y_loc,
    MINUTIA *minutia;
 
    /* Allocate a minutia structure. */
-   minutia = (MINUTIA *)g_malloc(sizeof(MINUTIA));
+   minutia = (MINUTIA *)lfs_alloc(sizeof(MINUTIA));
 
    /* Assign minutia structure attributes. */
    minutia->x = x_loc;
@@ -770,10 +1014,10 @@ void free_minutiae(MINUTIAE *minutiae)
    for(i = 0; i < minutiae->num; i++)
       free_minutia(minutiae->list[i]);
    /* Deallocate list of minutia pointers. */
-   g_free(minutiae->list);
+   lfs_free(minutiae->list);
 
    /* Deallocate the list structure. */
-   g_free(minutiae);
+   lfs_free(minutiae);
 }
 
 /*************************************************************************
@@ -788,12 +1032,12 @@ void free_minutia(MINUTIA *minutia)
 {
    /* Deallocate sublists. */
    if(minutia->nbrs != (int *)NULL)
-      g_free(minutia->nbrs);
+      lfs_free(minutia->nbrs);
    if(minutia->ridge_counts != (int *)NULL)
-      g_free(minutia->ridge_counts);
+      lfs_free(minutia->ridge_counts);
 
    /* Deallocate the minutia structure. */
-   g_free(minutia);
+   lfs_free(minutia);
 }
 
 /*************************************************************************
@@ -1027,28 +1271,36 @@ int choose_scan_direction(const int imapval, const int ndirs)
 
 /*************************************************************************
 **************************************************************************
-#cat: scan4minutiae_horizontally_V2 - Scans an entire binary image
+#cat: scan4minutiae_horizontally_V2 - Scans a region of a binary image
 #cat:                horizontally, detecting potential minutiae points.
 #cat:                Minutia detected via the horizontal scan process are
 #cat:                by nature vertically oriented (orthogonal to the scan).
 
    Input:
+      grid      - location index of the minutiae in the list
       bdata     - binary image data (0==while & 1==black)
       iw        - width (in pixels) of image
       ih        - height (in pixels) of image
       pdirection_map  - pixelized Direction Map
       plow_flow_map   - pixelized Low Ridge Flow Map
       phigh_curve_map - pixelized High Curvature Map
+      scan_x    - x-pixel coord of origin of region to be scanned
+      scan_y    - y-pixel coord of origin of region to be scanned
+      scan_w    - width (in pixels) of region to be scanned
+      scan_h    - height (in pixels) of region to be scanned
       lfsparms  - parameters and thresholds for controlling LFS
    Output:
       minutiae   - points to a list of detected minutia structures
+      grid       - updated location index
    Return Code:
       Zero      - successful completion
       Negative  - system error
 **************************************************************************/
-int scan4minutiae_horizontally_V2(MINUTIAE *minutiae,
+int scan4minutiae_horizontally_V2(MINUTIAE *minutiae, MINUTIAE_GRID *grid,
                 unsigned char *bdata, const int iw, const int ih,
                 int *pdirection_map, int *plow_flow_map, int *phigh_curve_map,
+                const int scan_x, const int scan_y,
+                const int scan_w, const int scan_h,
                 const LFSPARMS *lfsparms)
 {
    int sx, sy, ex, ey, cx, cy, x2;
@@ -1056,11 +1308,11 @@ int scan4minutiae_horizontally_V2(MINUTIAE *minutiae,
    int possible[NFEATURES], nposs;
    int ret;
 
-   /* Set scan region to entire image. */
-   sx = 0;
-   ex = iw;
-   sy = 0;
-   ey = ih;
+   /* Set scan region. */
+   sx = scan_x;
+   ex = scan_x + scan_w;
+   sy = scan_y;
+   ey = scan_y + scan_h;
 
    /* Start at first row in region. */
    cy = sy;
@@ -1097,7 +1349,7 @@ int scan4minutiae_horizontally_V2(MINUTIAE *minutiae,
                      /* a single feature... */
                      if(match_3rd_pair(*p1ptr, *p2ptr, possible, &nposs)){
                         /* Process detected minutia point. */
-                        if((ret = process_horizontal_scan_minutia_V2(minutiae,
+                        if((ret = process_horizontal_scan_minutia_V2(minutiae, grid,
                                          cx, cy, x2, possible[0],
                                          bdata, iw, ih, pdirection_map,
                                          plow_flow_map, phigh_curve_map,
@@ -1178,28 +1430,36 @@ int scan4minutiae_horizontally_V2(MINUTIAE *minutiae,
 
 /*************************************************************************
 **************************************************************************
-#cat: scan4minutiae_vertically_V2 - Scans an entire binary image
+#cat: scan4minutiae_vertically_V2 - Scans a region of a binary image
 #cat:                vertically, detecting potential minutiae points.
 #cat:                Minutia detected via the vetical scan process are
 #cat:                by nature horizontally oriented (orthogonal to  the scan).
 
    Input:
+      grid      - location index of the minutiae in the list
       bdata     - binary image data (0==while & 1==black)
       iw        - width (in pixels) of image
       ih        - height (in pixels) of image
       pdirection_map  - pixelized Direction Map
       plow_flow_map   - pixelized Low Ridge Flow Map
       phigh_curve_map - pixelized High Curvature Map
+      scan_x    - x-pixel coord of origin of region to be scanned
+      scan_y    - y-pixel coord of origin of region to be scanned
+      scan_w    - width (in pixels) of region to be scanned
+      scan_h    - height (in pixels) of region to be scanned
       lfsparms  - parameters and thresholds for controlling LFS
    Output:
       minutiae   - points to a list of detected minutia structures
+      grid       - updated location index
    Return Code:
       Zero      - successful completion
       Negative  - system error
 **************************************************************************/
-int scan4minutiae_vertically_V2(MINUTIAE *minutiae,
+int scan4minutiae_vertically_V2(MINUTIAE *minutiae, MINUTIAE_GRID *grid,
                 unsigned char *bdata, const int iw, const int ih,
                 int *pdirection_map, int *plow_flow_map, int *phigh_curve_map,
+                const int scan_x, const int scan_y,
+                const int scan_w, const int scan_h,
                 const LFSPARMS *lfsparms)
 {
    int sx, sy, ex, ey, cx, cy, y2;
@@ -1207,11 +1467,11 @@ int scan4minutiae_vertically_V2(MINUTIAE *minutiae,
    int possible[NFEATURES], nposs;
    int ret;
 
-   /* Set scan region to entire image. */
-   sx = 0;
-   ex = iw;
-   sy = 0;
-   ey = ih;
+   /* Set scan region. */
+   sx = scan_x;
+   ex = scan_x + scan_w;
+   sy = scan_y;
+   ey = scan_y + scan_h;
 
    /* Start at first column in region. */
    cx = sx;
@@ -1248,7 +1508,7 @@ int scan4minutiae_vertically_V2(MINUTIAE *minutiae,
                      /* a single feature... */
                      if(match_3rd_pair(*p1ptr, *p2ptr, possible, &nposs)){
                         /* Process detected minutia point. */
-                        if((ret = process_vertical_scan_minutia_V2(minutiae,
+                        if((ret = process_vertical_scan_minutia_V2(minutiae, grid,
                                          cx, cy, y2, possible[0],
                                          bdata, iw, ih, pdirection_map,
                                          plow_flow_map, phigh_curve_map,
@@ -1519,6 +1779,7 @@ int scan4minutiae_vertically_V2(MINUTIAE *minutiae,
 #cat:                vertical in orientation (orthogonal to the scan).
 
    Input:
+      grid      - location index of the minutiae in the list
       cx        - x-pixel coord where 3rd pattern pair of mintuia was detected
       cy        - y-pixel coord where 3rd pattern pair of mintuia was detected
       y2        - y-pixel coord where 2nd pattern pair of mintuia was detected
@@ -1532,12 +1793,13 @@ int scan4minutiae_vertically_V2(MINUTIAE *minutiae,
       lfsparms  - parameters and thresholds for controlling LFS
    Output:
       minutiae   - points to a list of detected minutia structures
+      grid       - updated location index
    Return Code:
       Zero      - successful completion
       IGNORE    - minutia is to be ignored
       Negative  - system error
 **************************************************************************/
-int process_horizontal_scan_minutia_V2(MINUTIAE *minutiae,
+int process_horizontal_scan_minutia_V2(MINUTIAE *minutiae, MINUTIAE_GRID *grid,
                  const int cx, const int cy,
                  const int x2, const int feature_id,
                  unsigned char *bdata, const int iw, const int ih,
@@ -1621,7 +1883,7 @@ int process_horizontal_scan_minutia_V2(MINUTIAE *minutiae,
       return(ret);
 
    /* Update the minutiae list with potential new minutia. */
-   ret = update_minutiae_V2(minutiae, minutia, SCAN_HORIZONTAL,
+   ret = update_minutiae_V2(minutiae, grid, minutia, SCAN_HORIZONTAL,
                             dmapval, bdata, iw, ih, lfsparms);
 
    /* If minuitia IGNORED and not added to the minutia list ... */
@@ -1671,6 +1933,7 @@ int process_horizontal_scan_minutia_V2(MINUTIAE *minutiae,
 #cat:                horizontal in orientation (orthogonal to the scan).
 
    Input:
+      grid      - location index of the minutiae in the list
       cx        - x-pixel coord where 3rd pattern pair of mintuia was detected
       cy        - y-pixel coord where 3rd pattern pair of mintuia was detected
       x2        - x-pixel coord where 2nd pattern pair of mintuia was detected
@@ -1684,12 +1947,13 @@ int process_horizontal_scan_minutia_V2(MINUTIAE *minutiae,
       lfsparms  - parameters and thresholds for controlling LFS
    Output:
       minutiae   - points to a list of detected minutia structures
+      grid       - updated location index
    Return Code:
       Zero      - successful completion
       IGNORE    - minutia is to be ignored
       Negative  - system error
 **************************************************************************/
-int process_vertical_scan_minutia_V2(MINUTIAE *minutiae,
+int process_vertical_scan_minutia_V2(MINUTIAE *minutiae, MINUTIAE_GRID *grid,
                  const int cx, const int cy,
                  const int y2, const int feature_id,
                  unsigned char *bdata, const int iw, const int ih,
@@ -1772,7 +2036,7 @@ int process_vertical_scan_minutia_V2(MINUTIAE *minutiae,
       return(ret);
 
    /* Update the minutiae list with potential new minutia. */
-   ret = update_minutiae_V2(minutiae, minutia, SCAN_VERTICAL,
+   ret = update_minutiae_V2(minutiae, grid, minutia, SCAN_VERTICAL,
                             dmapval, bdata, iw, ih, lfsparms);
 
    /* If minuitia IGNORED and not added to the minutia list ... */
@@ -385,7 +385,7 @@ int remove_hooks(MINUTIAE *minutiae,
                      if((deltadir = closest_dir_dist(minutia1->direction,
                                     minutia2->direction, full_ndirs)) ==
                                     INVALID_DIR){
-                        g_free(to_remove);
+                        lfs_free(to_remove);
                         fprintf(stderr,
                                 "ERROR : remove_hooks : INVALID direction\n");
                         return(-641);
@@ -429,7 +429,7 @@ int remove_hooks(MINUTIAE *minutiae,
                            }
                            /* If system error occurred during hook test ... */
                            else if (ret < 0){
-                              g_free(to_remove);
+                              lfs_free(to_remove);
                               return(ret);
                            }
                            /* Otherwise, no hook found, so skip to next */
@@ -479,14 +479,14 @@ int remove_hooks(MINUTIAE *minutiae,
       if(to_remove[i]){
          /* Remove the minutia from the minutiae list. */
          if((ret = remove_minutia(i, minutiae))){
-            g_free(to_remove);
+            lfs_free(to_remove);
             return(ret);
          }
       }
    }
 
    /* Deallocate flag list. */
-   g_free(to_remove);
+   lfs_free(to_remove);
 
    /* Return normally. */
    return(0);
@@ -646,7 +646,7 @@ int remove_islands_and_lakes(MINUTIAE *minutiae,
                         if((deltadir = closest_dir_dist(minutia1->direction,
                                        minutia2->direction, full_ndirs)) ==
                                        INVALID_DIR){
-                           g_free(to_remove);
+                           lfs_free(to_remove);
                            fprintf(stderr,
                      "ERROR : remove_islands_and_lakes : INVALID direction\n");
                            return(-611);
@@ -678,7 +678,7 @@ int remove_islands_and_lakes(MINUTIAE *minutiae,
                                                  bdata, iw, ih))){
                                  free_contour(loop_x, loop_y,
                                               loop_ex, loop_ey);
-                                 g_free(to_remove);
+                                 lfs_free(to_remove);
                                  return(ret);
                               }
                               /* Set to remove first minutia. */
@@ -701,7 +701,7 @@ int remove_islands_and_lakes(MINUTIAE *minutiae,
                            }
                            /* If ERROR while looking for island/lake ... */
                            else if (ret < 0){
-                              g_free(to_remove);
+                              lfs_free(to_remove);
                               return(ret);
                            }
                            else
@@ -746,14 +746,14 @@ int remove_islands_and_lakes(MINUTIAE *minutiae,
       if(to_remove[i]){
          /* Remove the minutia from the minutiae list. */
          if((ret = remove_minutia(i, minutiae))){
-            g_free(to_remove);
+            lfs_free(to_remove);
             return(ret);
          }
       }
    }
 
    /* Deallocate flag list. */
-   g_free(to_remove);
+   lfs_free(to_remove);
 
    /* Return normally. */
    return(0);
@@ -955,8 +955,8 @@ int remove_malformations(MINUTIAE *minutiae,
                         print2log("%d,%d RMMAL3 (%f)\n",
                                   minutia->x, minutia->y, ratio);
                         if((ret = remove_minutia(i, minutiae))){
-                           g_free(x_list);
-                           g_free(y_list);
+                           lfs_free(x_list);
+                           lfs_free(y_list);
                            /* If system error, return error code. */
                            return(ret);
                         }
@@ -966,8 +966,8 @@ int remove_malformations(MINUTIAE *minutiae,
                   }
                }
 
-               g_free(x_list);
-               g_free(y_list);
+               lfs_free(x_list);
+               lfs_free(y_list);
 
             }
          }
@@ -1605,7 +1605,7 @@ int remove_overlaps(MINUTIAE *minutiae,
                      if((deltadir = closest_dir_dist(minutia1->direction,
                                     minutia2->direction, full_ndirs)) ==
                                     INVALID_DIR){
-                        g_free(to_remove);
+                        lfs_free(to_remove);
                         fprintf(stderr,
                            "ERROR : remove_overlaps : INVALID direction\n");
                         return(-651);
@@ -1704,14 +1704,14 @@ int remove_overlaps(MINUTIAE *minutiae,
       if(to_remove[i]){
          /* Remove the minutia from the minutiae list. */
          if((ret = remove_minutia(i, minutiae))){
-            g_free(to_remove);
+            lfs_free(to_remove);
             return(ret);
          }
       }
    }
 
    /* Deallocate flag list. */
-   g_free(to_remove);
+   lfs_free(to_remove);
 
    /* Return normally. */
    return(0);
@@ -2192,7 +2192,7 @@ int remove_or_adjust_side_minutiae_V2(MINUTIAE *minutiae,
 
    /* Allocate working memory for holding rotated y-coord of a */
    /* minutia's contour.                                       */
-   rot_y = (int *)g_malloc(((lfsparms->side_half_contour << 1) + 1) * sizeof(int));
+   rot_y = (int *)lfs_alloc(((lfsparms->side_half_contour << 1) + 1) * sizeof(int));
 
    /* Compute factor for converting integer directions to radians. */
    pi_factor = M_PI / (double)lfsparms->num_directions;
@@ -2214,7 +2214,7 @@ int remove_or_adjust_side_minutiae_V2(MINUTIAE *minutiae,
       /* If system error occurred ... */
       if(ret < 0){
          /* Deallocate working memory. */
-         g_free(rot_y);
+         lfs_free(rot_y);
          /* Return error code. */
          return(ret);
       }
@@ -2230,7 +2230,7 @@ int remove_or_adjust_side_minutiae_V2(MINUTIAE *minutiae,
          /* Remove minutia from list. */
          if((ret = remove_minutia(i, minutiae))){
             /* Deallocate working memory. */
-            g_free(rot_y);
+            lfs_free(rot_y);
             /* Return error code. */
             return(ret);
          }
@@ -2283,7 +2283,7 @@ int remove_or_adjust_side_minutiae_V2(MINUTIAE *minutiae,
                           &minmax_alloc, &minmax_num,
                           rot_y, ncontour))){
             /* If system error, then deallocate working memories. */
-            g_free(rot_y);
+            lfs_free(rot_y);
             free_contour(contour_x, contour_y, contour_ex, contour_ey);
             /* Return error code. */
             return(ret);
@@ -2309,12 +2309,12 @@ int remove_or_adjust_side_minutiae_V2(MINUTIAE *minutiae,
                /* Remove minutia from list. */
                if((ret = remove_minutia(i, minutiae))){
                   /* Deallocate working memory. */
-                  g_free(rot_y);
+                  lfs_free(rot_y);
                   free_contour(contour_x, contour_y, contour_ex, contour_ey);
                   if(minmax_alloc > 0){
-                     g_free(minmax_val);
-                     g_free(minmax_type);
-                     g_free(minmax_i);
+                     lfs_free(minmax_val);
+                     lfs_free(minmax_type);
+                     lfs_free(minmax_i);
                   }
                   /* Return error code. */
                   return(ret);
@@ -2355,12 +2355,12 @@ int remove_or_adjust_side_minutiae_V2(MINUTIAE *minutiae,
                /* Remove minutia from list. */
                if((ret = remove_minutia(i, minutiae))){
                   /* Deallocate working memory. */
-                  g_free(rot_y);
+                  lfs_free(rot_y);
                   free_contour(contour_x, contour_y, contour_ex, contour_ey);
                   if(minmax_alloc > 0){
-                     g_free(minmax_val);
-                     g_free(minmax_type);
-                     g_free(minmax_i);
+                     lfs_free(minmax_val);
+                     lfs_free(minmax_type);
+                     lfs_free(minmax_i);
                   }
                   /* Return error code. */
                   return(ret);
@@ -2384,12 +2384,12 @@ int remove_or_adjust_side_minutiae_V2(MINUTIAE *minutiae,
             /* Remove minutia from list. */
             if((ret = remove_minutia(i, minutiae))){
                /* If system error, then deallocate working memories. */
-               g_free(rot_y);
+               lfs_free(rot_y);
                free_contour(contour_x, contour_y, contour_ex, contour_ey);
                if(minmax_alloc > 0){
-                  g_free(minmax_val);
-                  g_free(minmax_type);
-                  g_free(minmax_i);
+                  lfs_free(minmax_val);
+                  lfs_free(minmax_type);
+                  lfs_free(minmax_i);
                }
                /* Return error code. */
                return(ret);
@@ -2401,15 +2401,15 @@ int remove_or_adjust_side_minutiae_V2(MINUTIAE *minutiae,
          /* Deallocate contour and min/max buffers. */
          free_contour(contour_x, contour_y, contour_ex, contour_ey);
          if(minmax_alloc > 0){
-            g_free(minmax_val);
-            g_free(minmax_type);
-            g_free(minmax_i);
+            lfs_free(minmax_val);
+            lfs_free(minmax_type);
+            lfs_free(minmax_i);
          }
       } /* End else contour extracted. */
    } /* End while not end of minutiae list. */
 
    /* Deallocate working memory. */
-   g_free(rot_y);
+   lfs_free(rot_y);
 
    /* Return normally. */
    return(0);
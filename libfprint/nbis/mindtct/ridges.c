@@ -154,7 +154,7 @@ int count_minutia_ridges(const int first, MINUTIAE *minutiae,
    if((ret = find_neighbors(&nbr_list, &nnbrs, lfsparms->max_nbrs,
                            first, minutiae))){
       if (nbr_list != NULL)
-         g_free(nbr_list);
+         lfs_free(nbr_list);
       return(ret);
    }
 
@@ -169,13 +169,13 @@ int count_minutia_ridges(const int first, MINUTIAE *minutiae,
 
    /* Sort neighbors on delta dirs. */
    if((ret = sort_neighbors(nbr_list, nnbrs, first, minutiae))){
-      g_free(nbr_list);
+      lfs_free(nbr_list);
       return(ret);
    }
 
    /* Count ridges between first and neighbors. */
    /* List of ridge counts, one for each neighbor stored. */
-   nbr_nridges = (int *)g_malloc(nnbrs * sizeof(int));
+   nbr_nridges = (int *)lfs_alloc(nnbrs * sizeof(int));
 
    /* Foreach neighbor found and sorted in list ... */
    for(i = 0; i < nnbrs; i++){
@@ -184,8 +184,8 @@ int count_minutia_ridges(const int first, MINUTIAE *minutiae,
       /* If system error ... */
       if(ret < 0){
          /* Deallocate working memories. */
-         g_free(nbr_list);
-         g_free(nbr_nridges);
+         lfs_free(nbr_list);
+         lfs_free(nbr_nridges);
          /* Return error code. */
          return(ret);
       }
@@ -232,11 +232,11 @@ int find_neighbors(int **onbr_list, int *onnbrs, const int max_nbrs,
    double *nbr_sqr_dists, xdist, xdist2;
 
    /* Allocate list of neighbor minutiae indices. */
-   nbr_list = (int *)g_malloc(max_nbrs * sizeof(int));
+   nbr_list = (int *)lfs_alloc(max_nbrs * sizeof(int));
 
    /* Allocate list of squared euclidean distances between neighbors */
    /* and current primary minutia point.                             */
-   nbr_sqr_dists = (double *)g_malloc(max_nbrs * sizeof(double));
+   nbr_sqr_dists = (double *)lfs_alloc(max_nbrs * sizeof(double));
 
    /* Initialize number of stored neighbors to 0. */
    nnbrs = 0;
@@ -267,8 +267,8 @@ int find_neighbors(int **onbr_list, int *onnbrs, const int max_nbrs,
          /* Append or insert the new neighbor into the neighbor lists. */
          if((ret = update_nbr_dists(nbr_list, nbr_sqr_dists, &nnbrs, max_nbrs,
                           first, second, minutiae))){
-            g_free(nbr_sqr_dists);
-            g_free(nbr_list);
+            lfs_free(nbr_sqr_dists);
+            lfs_free(nbr_list);
             return(ret);
          }
       }
@@ -284,12 +284,12 @@ int find_neighbors(int **onbr_list, int *onnbrs, const int max_nbrs,
    }
 
    /* Deallocate working memory. */
-   g_free(nbr_sqr_dists);
+   lfs_free(nbr_sqr_dists);
 
    /* If no neighbors found ... */
    if(nnbrs == 0){
       /* Deallocate the neighbor list. */
-      g_free(nbr_list);
+      lfs_free(nbr_list);
       *onnbrs = 0;
    }
    /* Otherwise, assign neighbors to output pointer. */
@@ -486,7 +486,7 @@ int sort_neighbors(int *nbr_list, const int nnbrs, const int first,
 
    /* List of angles of lines joining the current primary to each */
    /* of the secondary neighbors.                                 */
-   join_thetas = (double *)g_malloc(nnbrs * sizeof(double));
+   join_thetas = (double *)lfs_alloc(nnbrs * sizeof(double));
 
    for(i = 0; i < nnbrs; i++){
       /* Compute angle to line connecting the 2 points.             */
@@ -508,7 +508,7 @@ int sort_neighbors(int *nbr_list, const int nnbrs, const int first,
    bubble_sort_double_inc_2(join_thetas, nbr_list, nnbrs);
 
    /* Deallocate the list of angles. */
-   g_free(join_thetas);
+   lfs_free(join_thetas);
 
    /* Return normally. */
    return(0);
@@ -561,8 +561,8 @@ int ridge_count(const int first, const int second, MINUTIAE *minutiae,
    /* It there are no points on the line trajectory, then no ridges */
    /* to count (this should not happen, but just in case) ...       */
    if(num == 0){
-      g_free(xlist);
-      g_free(ylist);
+      lfs_free(xlist);
+      lfs_free(ylist);
       return(0);
    }
 
@@ -582,8 +582,8 @@ int ridge_count(const int first, const int second, MINUTIAE *minutiae,
 
    /* If opposite pixel not found ... then no ridges to count */
    if(!found){
-      g_free(xlist);
-      g_free(ylist);
+      lfs_free(xlist);
+      lfs_free(ylist);
       return(0);
    }
 
@@ -598,8 +598,8 @@ int ridge_count(const int first, const int second, MINUTIAE *minutiae,
       /* If 0-to-1 transition not found ... */
       if(!find_transition(&i, 0, 1, xlist, ylist, num, bdata, iw, ih)){
          /* Then we are done looking for ridges. */
-         g_free(xlist);
-         g_free(ylist);
+         lfs_free(xlist);
+         lfs_free(ylist);
 
          print2log("\n");
 
@@ -615,8 +615,8 @@ int ridge_count(const int first, const int second, MINUTIAE *minutiae,
       /* If 1-to-0 transition not found ... */
       if(!find_transition(&i, 1, 0, xlist, ylist, num, bdata, iw, ih)){
          /* Then we are done looking for ridges. */
-         g_free(xlist);
-         g_free(ylist);
+         lfs_free(xlist);
+         lfs_free(ylist);
 
          print2log("\n");
 
@@ -642,8 +642,8 @@ int ridge_count(const int first, const int second, MINUTIAE *minutiae,
 
       /* If system error ... */
       if(ret < 0){
-         g_free(xlist);
-         g_free(ylist);
+         lfs_free(xlist);
+         lfs_free(ylist);
          /* Return the error code. */
          return(ret);
       }
@@ -662,8 +662,8 @@ int ridge_count(const int first, const int second, MINUTIAE *minutiae,
    }
 
    /* Deallocate working memories. */
-   g_free(xlist);
-   g_free(ylist);
+   lfs_free(xlist);
+   lfs_free(ylist);
 
    print2log("\n");
 
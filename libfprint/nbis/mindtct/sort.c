@@ -57,6 +57,7 @@ of the software.
                ROUTINES:
                         sort_indices_int_inc()
                         sort_indices_double_inc()
+                        merge_sort_int_inc_2()
                         bubble_sort_int_inc_2()
                         bubble_sort_double_inc_2()
                         bubble_sort_double_dec_2()
@@ -64,6 +65,7 @@ of the software.
 ***********************************************************************/
 
 #include <stdio.h>
+#include <string.h>
 #include <lfs.h>
 
 /*************************************************************************
@@ -89,13 +91,13 @@ int sort_indices_int_inc(int **optr, int *ranks, const int num)
    int i;
 
    /* Allocate list of sequential indices. */
-   order = (int *)g_malloc(num * sizeof(int));
+   order = (int *)lfs_alloc(num * sizeof(int));
    /* Initialize list of sequential indices. */
    for(i = 0; i < num; i++)
       order[i] = i;
 
    /* Sort the indecies into rank order. */
-   bubble_sort_int_inc_2(ranks, order, num);
+   merge_sort_int_inc_2(ranks, order, num);
 
    /* Set output pointer to the resulting order of sorted indices. */
    *optr = order;
@@ -121,6 +123,75 @@ int sort_indices_int_inc(int **optr, int *ranks, const int num)
       Negative  - system error
 **************************************************************************/
 
+/*************************************************************************
+**************************************************************************
+#cat: merge_sort_int_inc_2 - Takes a list of integer ranks and a corresponding
+#cat:                         list of integer attributes, and sorts the ranks
+#cat:                         into increasing order moving the attributes
+#cat:                         correspondingly.  Items with equal ranks keep
+#cat:                         their order, so the result is the same as the
+#cat:                         one of bubble_sort_int_inc_2().
+
+   Input:
+      ranks    - list of integers to be sort on
+      items    - list of corresponding integer attributes
+      len      - number of items in list
+   Output:
+      ranks    - list of integers sorted in increasing order
+      items    - list of attributes in corresponding sorted order
+**************************************************************************/
+void merge_sort_int_inc_2(int *ranks, int *items, const int len)
+{
+   int *tranks, *titems;
+   int *sranks, *sitems, *dranks, *ditems, *swap;
+   int width, lo, mid, hi, i, l, r;
+
+   if(len < 2)
+      return;
+
+   tranks = (int *)lfs_alloc(len * sizeof(int));
+   titems = (int *)lfs_alloc(len * sizeof(int));
+
+   sranks = ranks;
+   sitems = items;
+   dranks = tranks;
+   ditems = titems;
+
+   /* Merge runs of doubling width, alternating between both buffers. */
+   for(width = 1; width < len; width <<= 1){
+      for(lo = 0; lo < len; lo += width << 1){
+         mid = min(lo + width, len);
+         hi = min(lo + (width << 1), len);
+         l = lo;
+         r = mid;
+         for(i = lo; i < hi; i++){
+            /* Take from the left run on ties to keep the sort stable. */
+            if(l < mid && (r >= hi || sranks[l] <= sranks[r])){
+               dranks[i] = sranks[l];
+               ditems[i] = sitems[l];
+               l++;
+            }
+            else{
+               dranks[i] = sranks[r];
+               ditems[i] = sitems[r];
+               r++;
+            }
+         }
+      }
+      swap = sranks; sranks = dranks; dranks = swap;
+      swap = sitems; sitems = ditems; ditems = swap;
+   }
+
+   /* Copy the result back if it ended up in the working buffers. */
+   if(sranks != ranks){
+      memcpy(ranks, sranks, len * sizeof(int));
+      memcpy(items, sitems, len * sizeof(int));
+   }
+
+   lfs_free(titems);
+   lfs_free(tranks);
+}
+
 /*************************************************************************
 **************************************************************************
 #cat: bubble_sort_int_inc_2 - Takes a list of integer ranks and a corresponding
@@ -65,9 +65,19 @@ of the software.
                         angle2line()
                         line2direction()
                         closest_dir_dist()
+                        lfs_arena_enabled()
+                        lfs_arena_begin()
+                        lfs_arena_end()
+                        lfs_alloc()
+                        lfs_realloc()
+                        lfs_free()
+                        lfs_arena_export()
+                        lfs_timings()
+                        lfs_lap_time()
 ***********************************************************************/
 
 #include <stdio.h>
+#include <string.h>
 #include <lfs.h>
 
 /*************************************************************************
@@ -178,9 +188,9 @@ int minmaxs(int **ominmax_val, int **ominmax_type, int **ominmax_i,
    /* min or max.                                                */
    minmax_alloc = num - 2;
    /* Allocate the buffers. */
-   minmax_val = (int *)g_malloc(minmax_alloc * sizeof(int));
-   minmax_type = (int *)g_malloc(minmax_alloc * sizeof(int));
-   minmax_i = (int *)g_malloc(minmax_alloc * sizeof(int));
+   minmax_val = (int *)lfs_alloc(minmax_alloc * sizeof(int));
+   minmax_type = (int *)lfs_alloc(minmax_alloc * sizeof(int));
+   minmax_i = (int *)lfs_alloc(minmax_alloc * sizeof(int));
 
    /* Initialize number of min/max to 0. */
    minmax_num = 0;
@@ -587,3 +597,442 @@ int closest_dir_dist(const int dir1, const int dir2, const int ndirs)
    return(dist);
 }
 
+
+/*************************************************************************
+**************************************************************************
+   A single extraction makes many thousands of small allocations, which
+   are all released again by the time it completes.  While an extraction
+   is running, the allocations of the thread draw from a per-thread arena
+   instead of the heap.  Memory is handed out from large chunks, and
+   blocks that are released in (roughly) reverse order of allocation are
+   reclaimed right away.  All remaining blocks are released at once when
+   the extraction ends, keeping the chunk for the next extraction on the
+   same thread.
+
+   Under AddressSanitizer or valgrind, the arena is disabled and all
+   memory comes from the heap, so that overruns and accesses to released
+   blocks are still reported.
+**************************************************************************/
+#if defined(__SANITIZE_ADDRESS__)
+#define LFS_ARENA_SANITIZED
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(memory_sanitizer)
+#define LFS_ARENA_SANITIZED
+#endif
+#endif
+
+typedef struct lfs_arena_block {
+   size_t size;      /* Usable bytes, LFS_ARENA_FREED set once released */
+   size_t prev;      /* Chunk offset of the previous block header */
+} LFS_ARENA_BLOCK;
+
+typedef struct lfs_arena_chunk {
+   struct lfs_arena_chunk *next;
+   size_t size;      /* Usable bytes of the chunk */
+   size_t used;      /* Bytes handed out from the start of the chunk */
+   size_t top;       /* Chunk offset of the last block header */
+} LFS_ARENA_CHUNK;
+
+typedef struct lfs_arena {
+   LFS_ARENA_CHUNK *chunks;
+   LFS_ARENA_CHUNK *current;
+   int depth;
+} LFS_ARENA;
+
+#define LFS_ARENA_ALIGN           16
+#define LFS_ARENA_ROUND(_n_)      (((_n_) + LFS_ARENA_ALIGN - 1) & \
+                                   ~((size_t)LFS_ARENA_ALIGN - 1))
+#define LFS_ARENA_HDR_SIZE        LFS_ARENA_ROUND(sizeof(LFS_ARENA_BLOCK))
+#define LFS_ARENA_CHUNK_HDR_SIZE  LFS_ARENA_ROUND(sizeof(LFS_ARENA_CHUNK))
+#define LFS_ARENA_FREED           ((size_t)1)
+#define LFS_ARENA_NO_BLOCK        ((size_t)-1)
+/* Size of the first chunk of an arena, later chunks double in size. */
+#define LFS_ARENA_CHUNK_SIZE      (256 * 1024)
+/* Memory kept by an idle arena for the next extraction. */
+#define LFS_ARENA_KEEP_SIZE       (4 * 1024 * 1024)
+
+#define LFS_ARENA_CHUNK_DATA(_c_) ((unsigned char *)(_c_) + \
+                                   LFS_ARENA_CHUNK_HDR_SIZE)
+
+static void free_arena(gpointer data)
+{
+   LFS_ARENA *arena = (LFS_ARENA *)data;
+   LFS_ARENA_CHUNK *chunk, *next;
+
+   for(chunk = arena->chunks; chunk != NULL; chunk = next){
+      next = chunk->next;
+      g_free(chunk);
+   }
+   g_free(arena);
+}
+
+static GPrivate lfs_arena_key = G_PRIVATE_INIT(free_arena);
+
+/* Returns the arena of the calling thread if it is active, or NULL. */
+static LFS_ARENA *get_active_arena(void)
+{
+   LFS_ARENA *arena = (LFS_ARENA *)g_private_get(&lfs_arena_key);
+
+   if(arena == NULL || arena->depth == 0)
+      return(NULL);
+
+   return(arena);
+}
+
+static LFS_ARENA_CHUNK *new_arena_chunk(const size_t size)
+{
+   LFS_ARENA_CHUNK *chunk;
+
+   chunk = (LFS_ARENA_CHUNK *)g_malloc(LFS_ARENA_CHUNK_HDR_SIZE + size);
+   chunk->next = NULL;
+   chunk->size = size;
+   chunk->used = 0;
+   chunk->top = LFS_ARENA_NO_BLOCK;
+
+   return(chunk);
+}
+
+/* Returns the chunk of the arena containing PTR, or NULL for heap memory. */
+static LFS_ARENA_CHUNK *find_arena_chunk(const LFS_ARENA *arena,
+                                         const void *ptr)
+{
+   const unsigned char *p = (const unsigned char *)ptr;
+   LFS_ARENA_CHUNK *chunk;
+
+   /* Chunks after the current one are still unused. */
+   for(chunk = arena->chunks; chunk != NULL; chunk = chunk->next){
+      if(p >= LFS_ARENA_CHUNK_DATA(chunk) &&
+         p < LFS_ARENA_CHUNK_DATA(chunk) + chunk->used)
+         return(chunk);
+      if(chunk == arena->current)
+         break;
+   }
+
+   return(NULL);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: lfs_arena_enabled - Returns whether lfs_arena_begin() makes the
+#cat:             following allocations draw from an arena.  This is not
+#cat:             the case when built with a sanitizer, or when running
+#cat:             under valgrind as indicated by UNDER_VALGRIND being set.
+
+   Return Code:
+      TRUE  - allocations draw from the arena
+      FALSE - allocations always come from the heap
+**************************************************************************/
+int lfs_arena_enabled(void)
+{
+#ifdef LFS_ARENA_SANITIZED
+   return(FALSE);
+#else
+   static gsize enabled = 0;
+
+   /* One if disabled, two if enabled, zero means not checked yet. */
+   if(g_once_init_enter(&enabled))
+      g_once_init_leave(&enabled, g_getenv("UNDER_VALGRIND") == NULL ? 2 : 1);
+
+   return(enabled == 2);
+#endif
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: lfs_arena_begin - Makes the following allocations by lfs_alloc() and
+#cat:             lfs_realloc() on the calling thread draw from the arena
+#cat:             of the thread, until the matching lfs_arena_end().
+#cat:             Calls can be nested.
+**************************************************************************/
+void lfs_arena_begin(void)
+{
+   LFS_ARENA *arena;
+
+   if(!lfs_arena_enabled())
+      return;
+
+   arena = (LFS_ARENA *)g_private_get(&lfs_arena_key);
+   if(arena == NULL){
+      arena = (LFS_ARENA *)g_malloc(sizeof(LFS_ARENA));
+      arena->chunks = NULL;
+      arena->current = NULL;
+      arena->depth = 0;
+      g_private_set(&lfs_arena_key, arena);
+   }
+
+   arena->depth++;
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: lfs_arena_end - Ends the use of the arena started by lfs_arena_begin().
+#cat:             When the outermost use ends, all memory allocated from
+#cat:             the arena is released at once and must not be accessed
+#cat:             anymore.
+**************************************************************************/
+void lfs_arena_end(void)
+{
+   LFS_ARENA *arena;
+   LFS_ARENA_CHUNK *chunk, *next;
+   size_t total;
+
+   if(!lfs_arena_enabled())
+      return;
+
+   arena = (LFS_ARENA *)g_private_get(&lfs_arena_key);
+   g_assert(arena != NULL && arena->depth > 0);
+
+   arena->depth--;
+   if(arena->depth > 0)
+      return;
+
+   /* Replace several chunks by a single one large enough for all */
+   /* of them, so the next extraction needs only one chunk.       */
+   if(arena->chunks != NULL &&
+      (arena->chunks->next != NULL ||
+       arena->chunks->size > LFS_ARENA_KEEP_SIZE)){
+      total = 0;
+      for(chunk = arena->chunks; chunk != NULL; chunk = next){
+         next = chunk->next;
+         total += chunk->size;
+         g_free(chunk);
+      }
+      arena->chunks = new_arena_chunk(min(total, LFS_ARENA_KEEP_SIZE));
+   }
+
+   if(arena->chunks != NULL){
+      arena->chunks->used = 0;
+      arena->chunks->top = LFS_ARENA_NO_BLOCK;
+   }
+   arena->current = arena->chunks;
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: lfs_alloc - Allocates memory from the arena of the calling thread if
+#cat:             it is active, and otherwise from the heap.  The memory
+#cat:             must be released by lfs_free().
+
+   Input:
+      size  - number of bytes to allocate
+   Return Code:
+      Pointer to the allocated memory, or NULL if SIZE is zero
+**************************************************************************/
+void *lfs_alloc(const size_t size)
+{
+   LFS_ARENA *arena;
+   LFS_ARENA_CHUNK *chunk;
+   LFS_ARENA_BLOCK *block;
+   size_t need, chunk_size;
+
+   arena = get_active_arena();
+   if(arena == NULL || size == 0)
+      return(g_malloc(size));
+
+   need = LFS_ARENA_HDR_SIZE + LFS_ARENA_ROUND(size);
+
+   chunk = arena->current;
+   if(chunk == NULL || chunk->used + need > chunk->size){
+      /* Move on to the next chunk, adding one if needed. */
+      if(chunk != NULL && chunk->next != NULL && chunk->next->size >= need){
+         chunk = chunk->next;
+      }
+      else{
+         chunk_size = chunk != NULL ? chunk->size * 2 : LFS_ARENA_CHUNK_SIZE;
+         chunk_size = max(chunk_size, need);
+         if(chunk == NULL){
+            chunk = new_arena_chunk(chunk_size);
+            chunk->next = arena->chunks;
+            arena->chunks = chunk;
+         }
+         else{
+            LFS_ARENA_CHUNK *prev = chunk;
+
+            chunk = new_arena_chunk(chunk_size);
+            chunk->next = prev->next;
+            prev->next = chunk;
+         }
+      }
+      chunk->used = 0;
+      chunk->top = LFS_ARENA_NO_BLOCK;
+      arena->current = chunk;
+   }
+
+   block = (LFS_ARENA_BLOCK *)(LFS_ARENA_CHUNK_DATA(chunk) + chunk->used);
+   block->size = LFS_ARENA_ROUND(size);
+   block->prev = chunk->top;
+   chunk->top = chunk->used;
+   chunk->used += need;
+
+   return((unsigned char *)block + LFS_ARENA_HDR_SIZE);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: lfs_realloc - Resizes memory allocated by lfs_alloc(), keeping its
+#cat:             contents up to the smaller of the old and new size.
+
+   Input:
+      ptr   - memory to resize, or NULL
+      size  - new size in bytes
+   Return Code:
+      Pointer to the resized memory
+**************************************************************************/
+void *lfs_realloc(void *ptr, const size_t size)
+{
+   LFS_ARENA *arena;
+   LFS_ARENA_CHUNK *chunk;
+   LFS_ARENA_BLOCK *block;
+   void *new_ptr;
+   size_t offset;
+
+   if(ptr == NULL)
+      return(lfs_alloc(size));
+
+   arena = get_active_arena();
+   if(arena == NULL || (chunk = find_arena_chunk(arena, ptr)) == NULL)
+      return(g_realloc(ptr, size));
+
+   block = (LFS_ARENA_BLOCK *)((unsigned char *)ptr - LFS_ARENA_HDR_SIZE);
+   if(size <= block->size)
+      return(ptr);
+
+   /* Grow the last block of the current chunk in place. */
+   offset = (unsigned char *)block - LFS_ARENA_CHUNK_DATA(chunk);
+   if(chunk == arena->current && offset == chunk->top &&
+      offset + LFS_ARENA_HDR_SIZE + LFS_ARENA_ROUND(size) <= chunk->size){
+      block->size = LFS_ARENA_ROUND(size);
+      chunk->used = offset + LFS_ARENA_HDR_SIZE + block->size;
+      return(ptr);
+   }
+
+   new_ptr = lfs_alloc(size);
+   memcpy(new_ptr, ptr, block->size);
+   lfs_free(ptr);
+
+   return(new_ptr);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: lfs_free - Releases memory allocated by lfs_alloc() or lfs_realloc(),
+#cat:             or allocated from the heap.
+
+   Input:
+      ptr   - memory to release, or NULL
+**************************************************************************/
+void lfs_free(void *ptr)
+{
+   LFS_ARENA *arena;
+   LFS_ARENA_CHUNK *chunk;
+   LFS_ARENA_BLOCK *block;
+
+   if(ptr == NULL)
+      return;
+
+   arena = get_active_arena();
+   if(arena == NULL || (chunk = find_arena_chunk(arena, ptr)) == NULL){
+      g_free(ptr);
+      return;
+   }
+
+   block = (LFS_ARENA_BLOCK *)((unsigned char *)ptr - LFS_ARENA_HDR_SIZE);
+   block->size |= LFS_ARENA_FREED;
+
+   /* Reclaim all released blocks at the end of the current chunk. */
+   if(chunk != arena->current)
+      return;
+   while(chunk->top != LFS_ARENA_NO_BLOCK){
+      block = (LFS_ARENA_BLOCK *)(LFS_ARENA_CHUNK_DATA(chunk) + chunk->top);
+      if(!(block->size & LFS_ARENA_FREED))
+         break;
+      chunk->used = chunk->top;
+      chunk->top = block->prev;
+   }
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: lfs_arena_export - Moves memory allocated by lfs_alloc() out of the
+#cat:             arena of the calling thread, so that it stays valid
+#cat:             after lfs_arena_end() and can be released by g_free().
+
+   Input:
+      ptr   - memory to move, or NULL
+   Return Code:
+      Pointer to the memory on the heap, which is PTR itself if it was
+      not allocated from the arena
+**************************************************************************/
+void *lfs_arena_export(void *ptr)
+{
+   LFS_ARENA *arena;
+   LFS_ARENA_BLOCK *block;
+   void *new_ptr;
+
+   if(ptr == NULL)
+      return(NULL);
+
+   arena = get_active_arena();
+   if(arena == NULL || find_arena_chunk(arena, ptr) == NULL)
+      return(ptr);
+
+   block = (LFS_ARENA_BLOCK *)((unsigned char *)ptr - LFS_ARENA_HDR_SIZE);
+   new_ptr = g_malloc(block->size);
+   memcpy(new_ptr, ptr, block->size);
+   lfs_free(ptr);
+
+   return(new_ptr);
+}
+
+/*************************************************************************
+**************************************************************************
+   Stage timings of the last extraction of each thread, allocated on
+   first use and released when the thread exits.
+**************************************************************************/
+static GPrivate lfs_timings_key = G_PRIVATE_INIT(g_free);
+
+/*************************************************************************
+**************************************************************************
+#cat: lfs_timings - Returns the stage timings of the calling thread, to be
+#cat:             filled in by the current extraction.
+
+   Return Code:
+      Pointer to the timings of the calling thread
+**************************************************************************/
+LFS_TIMINGS *lfs_timings(void)
+{
+   LFS_TIMINGS *timings;
+
+   timings = (LFS_TIMINGS *)g_private_get(&lfs_timings_key);
+   if(timings == NULL){
+      timings = g_new0(LFS_TIMINGS, 1);
+      g_private_set(&lfs_timings_key, timings);
+   }
+
+   return(timings);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: lfs_lap_time - Returns the time elapsed since the given start time,
+#cat:             and resets the start time to now, so that consecutive
+#cat:             stages can be timed with a single variable.
+
+   Input:
+      start - monotonic time (in microseconds) the stage started at
+   Output:
+      start - current monotonic time
+   Return Code:
+      Elapsed time in seconds
+**************************************************************************/
+double lfs_lap_time(gint64 *start)
+{
+   gint64 now;
+   double elapsed;
+
+   now = g_get_monotonic_time();
+   elapsed = (now - *start) / (double)G_USEC_PER_SEC;
+   *start = now;
+
+   return(elapsed);
+}
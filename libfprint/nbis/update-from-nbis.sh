@@ -201,3 +201,59 @@ patch -p0 < remove-perimeter-pts.patch
 
 # Fix build on musl by dropping unnecessary redeclaration of stderr
 patch -p0 < fix-musl-build.patch
+
+# Keep the bozorth3 working tables in a caller allocated context instead
+# of globals, so that several matches can run concurrently. The globals
+# in bz_gbls.c are not needed anymore.
+patch -p0 < bozorth-context.patch
+
+# Allow saving the comparison table of a gallery print and matching against
+# it again later, so enrolled prints do not need to recompute it every time.
+patch -p0 < bozorth-gallery-save.patch
+
+# Allow stopping the score computation as soon as it is known whether the
+# score reaches a given threshold.
+patch -p0 < bozorth-bounded-score.patch
+
+# Build the bozorth3 edge table using a vector pair loop, a table of edge
+# angles and a single sort instead of sorted insertion.
+patch -p0 < bozorth-comp-vector.patch
+
+# Keep the MINDTCT lookup tables around instead of creating them for every
+# image.
+patch -p0 < mindtct-table-cache.patch
+
+# Analyze the blocks of the initial maps on several threads.
+patch -p0 < mindtct-parallel-maps.patch
+
+# Compute the DFT powers of several wave forms at once and sum rotated
+# rows using AVX2 gathers where supported.
+patch -p0 < mindtct-dft-vector.patch
+
+# Allocate the working memory of an extraction from a per-thread arena
+# instead of the heap.
+patch -p0 < mindtct-arena.patch
+
+# Index the detected minutiae by location, and sort minutiae with a merge
+# sort instead of a bubble sort.
+patch -p0 < mindtct-minutiae-grid.patch
+
+# Skip the contrast analysis of background blocks, and restrict binarization
+# and minutiae scanning to the region of blocks with a valid direction.
+patch -p0 < mindtct-foreground.patch
+
+# Record the time spent in each stage of get_minutiae().
+patch -p0 < mindtct-timings.patch
+
+# Optional fixed-point DFT analysis for CPUs without fast double precision.
+patch -p0 < mindtct-fixed-point.patch
+
+# Binarize the pixels of a row within the same block together.
+patch -p0 < mindtct-binarize-runs.patch
+
+# Allow selecting the number of threads analyzing the initial maps.
+patch -p0 < mindtct-map-threads.patch
+
+# Take the working memory from the heap under sanitizers and valgrind, so
+# that they still detect invalid accesses.
+patch -p0 < mindtct-arena-sanitizers.patch
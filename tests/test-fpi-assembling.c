@@ -53,10 +53,57 @@ cairo_get_pixel (struct fpi_frame_asmbl_ctx *ctx,
   return c_frame->data[x * 4 + y * c_frame->stride + 1];
 }
 
+static cairo_surface_t *
+load_capture (const char *driver)
+{
+  g_autofree char *path = NULL;
+  cairo_surface_t *img;
+
+  g_assert_false (SOURCE_ROOT == NULL);
+  path = g_build_path (G_DIR_SEPARATOR_S, SOURCE_ROOT, "tests", driver, "capture.png", NULL);
+
+  img = cairo_image_surface_create_from_png (path);
+  g_assert_cmpint (cairo_image_surface_get_format (img), ==, CAIRO_FORMAT_RGB24);
+
+  return img;
+}
+
+/* Cuts frames of @frame_height lines out of @img, from the top to the
+ * bottom. Frame i starts at column @x_start + i % @x_period, and is
+ * @y_step + i % @y_period lines below the previous one.
+ *
+ * Returns: the list of #cairo_frame in capture order */
+static GSList *
+cut_frames (cairo_surface_t *img,
+            guint            frame_height,
+            guint            x_start,
+            guint            x_period,
+            guint            y_step,
+            guint            y_period)
+{
+  GSList *frames = NULL;
+  guint height = cairo_image_surface_get_height (img);
+
+  for (guint y = 0, i = 0; y + frame_height < height; y += y_step + i % y_period, i++)
+    {
+      cairo_frame *frame = g_new0 (cairo_frame, 1);
+
+      frame->surf = img;
+      frame->width = cairo_image_surface_get_width (img);
+      frame->height = height;
+      frame->stride = cairo_image_surface_get_stride (img);
+      frame->data = cairo_image_surface_get_data (img);
+      frame->x = x_start + i % x_period;
+      frame->y = y;
+      frames = g_slist_prepend (frames, frame);
+    }
+
+  return g_slist_reverse (frames);
+}
+
 static void
 test_frame_assembling (void)
 {
-  g_autofree char *path = NULL;
   cairo_surface_t *img = NULL;
   int width, height, stride, offset;
   int test_height;
@@ -67,15 +114,11 @@ test_frame_assembling (void)
   g_autoptr(FpImage) fp_img = NULL;
   GSList *frames = NULL;
 
-  g_assert_false (SOURCE_ROOT == NULL);
-  path = g_build_path (G_DIR_SEPARATOR_S, SOURCE_ROOT, "tests", "vfs5011", "capture.png", NULL);
-
-  img = cairo_image_surface_create_from_png (path);
+  img = load_capture ("vfs5011");
   data = cairo_image_surface_get_data (img);
   width = cairo_image_surface_get_width (img);
   height = cairo_image_surface_get_height (img);
   stride = cairo_image_surface_get_stride (img);
-  g_assert_cmpint (cairo_image_surface_get_format (img), ==, CAIRO_FORMAT_RGB24);
 
   ctx.get_pixel = cairo_get_pixel;
   ctx.frame_width = width;
@@ -88,22 +131,7 @@ test_frame_assembling (void)
   test_height = height - (height - ctx.frame_height) % offset;
 
   /* for now, fixed offset */
-  for (int y = 0; y + ctx.frame_height < height; y += offset)
-    {
-      cairo_frame *frame = g_new0 (cairo_frame, 1);
-
-      frame->surf = img;
-      frame->width = width;
-      frame->height = height;
-      frame->stride = stride;
-      frame->data = data;
-      frame->x = 0;
-      frame->y = y;
-      //frame->y = test_height - ctx.frame_height - y;
-
-      frames = g_slist_append (frames, frame);
-    }
-  //offset = -offset;
+  frames = cut_frames (img, ctx.frame_height, 0, 1, offset, 1);
 
   fpi_do_movement_estimation (&ctx, frames);
   for (GSList *l = frames->next; l != NULL; l = l->next)
@@ -127,12 +155,273 @@ test_frame_assembling (void)
   g_assert (1);
 }
 
+/* Frames stored as plain 8 bit pixels need to give exactly the same
+ * movement estimation and image as frames read using get_pixel. */
+static void
+test_frame_assembling_direct (void)
+{
+  cairo_surface_t *img = NULL;
+  struct fpi_frame_asmbl_ctx ctx = { 0, };
+  struct fpi_frame_asmbl_ctx direct_ctx = { 0, };
+  gint frame_width = 100;
+
+  g_autoptr(FpImage) fp_img = NULL;
+  g_autoptr(FpImage) direct_img = NULL;
+  GSList *frames = NULL;
+  GSList *direct_frames = NULL;
+
+  img = load_capture ("vfs5011");
+
+  ctx.get_pixel = cairo_get_pixel;
+  ctx.frame_width = frame_width;
+  ctx.frame_height = 20;
+  ctx.image_width = frame_width * 5 / 4;
+
+  direct_ctx = ctx;
+  direct_ctx.get_pixel = NULL;
+  direct_ctx.frame_stride = frame_width + 3;
+
+  g_assert (cairo_image_surface_get_width (img) > frame_width + 10);
+
+  /* Frames move by a varying offset, also sideways */
+  frames = cut_frames (img, ctx.frame_height, 5, 5, 3, 7);
+  for (GSList *l = frames; l != NULL; l = l->next)
+    {
+      cairo_frame *frame = l->data;
+      struct fpi_frame *direct_frame;
+
+      direct_frame = g_malloc0 (sizeof (struct fpi_frame) +
+                                direct_ctx.frame_stride * ctx.frame_height);
+      for (int fy = 0; fy < ctx.frame_height; fy++)
+        for (int fx = 0; fx < ctx.frame_width; fx++)
+          direct_frame->data[fx + fy * direct_ctx.frame_stride] =
+            cairo_get_pixel (&ctx, &frame->frame, fx, fy);
+      direct_frames = g_slist_prepend (direct_frames, direct_frame);
+    }
+  direct_frames = g_slist_reverse (direct_frames);
+
+  fpi_do_movement_estimation (&ctx, frames);
+  fpi_do_movement_estimation (&direct_ctx, direct_frames);
+  for (GSList *l = frames, *d = direct_frames; l != NULL; l = l->next, d = d->next)
+    {
+      cairo_frame *frame = l->data;
+      struct fpi_frame *direct_frame = d->data;
+
+      g_assert_cmpint (frame->frame.delta_x, ==, direct_frame->delta_x);
+      g_assert_cmpint (frame->frame.delta_y, ==, direct_frame->delta_y);
+    }
+
+  fp_img = fpi_assemble_frames (&ctx, frames);
+  direct_img = fpi_assemble_frames (&direct_ctx, direct_frames);
+  g_assert_cmpint (fp_img->width, ==, direct_img->width);
+  g_assert_cmpint (fp_img->height, ==, direct_img->height);
+  g_assert_cmpmem (fp_img->data, fp_img->width * fp_img->height,
+                   direct_img->data, direct_img->width * direct_img->height);
+
+  g_slist_free_full (frames, g_free);
+  g_slist_free_full (direct_frames, g_free);
+  cairo_surface_destroy (img);
+}
+
+/* The frame store keeps the newest frames in order once it is full */
+static void
+test_frame_store (void)
+{
+  g_autoptr(FpiFrameStore) store = NULL;
+  struct fpi_frame *frame;
+
+  store = fpi_frame_store_new (5, 3);
+  g_assert_cmpuint (fpi_frame_store_get_n_frames (store), ==, 0);
+
+  for (int i = 0; i < 8; i++)
+    {
+      frame = fpi_frame_store_get_next (store);
+      g_assert_cmpuint (GPOINTER_TO_SIZE (frame) % sizeof (int), ==, 0);
+      memset (frame->data, i, 5);
+      g_assert_true (fpi_frame_store_append (store) == frame);
+      g_assert_cmpuint (fpi_frame_store_get_n_frames (store), ==, MIN (i + 1, 3));
+    }
+
+  for (int i = 0; i < 3; i++)
+    {
+      frame = fpi_frame_store_get_frame (store, i);
+      g_assert_cmpint (frame->data[0], ==, 5 + i);
+      g_assert_cmpint (frame->data[4], ==, 5 + i);
+    }
+
+  /* The next frame reuses the storage of the oldest one */
+  g_assert_true (fpi_frame_store_get_next (store) == fpi_frame_store_get_frame (store, 0));
+
+  fpi_frame_store_clear (store);
+  g_assert_cmpuint (fpi_frame_store_get_n_frames (store), ==, 0);
+}
+
+/* Assembling frames while they are captured needs to give the same image
+ * as assembling all of them at the end, whichever order they arrive in,
+ * whether they are copied or written into the assembler, and also after
+ * reusing the assembler. */
+static void
+test_frame_assembling_streaming (void)
+{
+  cairo_surface_t *img = NULL;
+  struct fpi_frame_asmbl_ctx ctx = { 0, };
+  gint frame_width = 100;
+  GSList *frames = NULL;
+
+  img = load_capture ("vfs5011");
+
+  ctx.get_pixel = cairo_get_pixel;
+  ctx.frame_width = frame_width;
+  ctx.frame_height = 20;
+  ctx.image_width = frame_width * 5 / 4;
+
+  g_assert (cairo_image_surface_get_width (img) > frame_width + 10);
+
+  frames = cut_frames (img, ctx.frame_height, 5, 5, 3, 7);
+
+  for (int search = 0; search < 2; search++)
+    {
+      g_autoptr(FpiFrameAssembler) assembler = NULL;
+
+      ctx.search = search ? FPI_FRAME_ASMBL_SEARCH_PYRAMID : FPI_FRAME_ASMBL_SEARCH_EXHAUSTIVE;
+
+      /* The frames are in assembling order, so they arrive in the opposite
+       * order if the assembler reverses them. */
+      for (int reverse = 0; reverse < 2; reverse++)
+        {
+          g_clear_pointer (&assembler, fpi_frame_assembler_free);
+          assembler = fpi_frame_assembler_new (&ctx, reverse, g_slist_length (frames));
+
+          for (int zero_copy = 0; zero_copy < 2; zero_copy++)
+            {
+              g_autoptr(FpImage) fp_img = NULL;
+              g_autoptr(FpImage) streamed_img = NULL;
+              g_autoptr(GSList) order = NULL;
+
+              /* Left over frames of a previous capture */
+              fpi_frame_assembler_add_frame (assembler, frames->data);
+              fpi_frame_assembler_add_frame (assembler, frames->next->data);
+              fpi_frame_assembler_reset (assembler);
+
+              order = g_slist_copy (frames);
+              if (reverse)
+                order = g_slist_reverse (order);
+              for (GSList *l = order; l != NULL; l = l->next)
+                {
+                  cairo_frame *frame = l->data;
+                  struct fpi_frame *next;
+
+                  if (!zero_copy)
+                    {
+                      fpi_frame_assembler_add_frame (assembler, &frame->frame);
+                      continue;
+                    }
+
+                  /* Written in place, like a driver reading from the device */
+                  next = fpi_frame_assembler_get_next_frame (assembler);
+                  for (int fy = 0; fy < ctx.frame_height; fy++)
+                    for (int fx = 0; fx < ctx.frame_width; fx++)
+                      next->data[fx + fy * ctx.frame_width] =
+                        cairo_get_pixel (&ctx, &frame->frame, fx, fy);
+                  fpi_frame_assembler_add_frame (assembler, next);
+                }
+              g_assert_cmpuint (fpi_frame_assembler_get_n_frames (assembler), ==, g_slist_length (frames));
+
+              streamed_img = fpi_frame_assembler_finish (assembler);
+
+              fpi_do_movement_estimation (&ctx, frames);
+              fp_img = fpi_assemble_frames (&ctx, frames);
+
+              g_assert_cmpint (fp_img->width, ==, streamed_img->width);
+              g_assert_cmpint (fp_img->height, ==, streamed_img->height);
+              g_assert_cmpint (fp_img->flags, ==, streamed_img->flags);
+              g_assert_cmpmem (fp_img->data, fp_img->width * fp_img->height,
+                               streamed_img->data, streamed_img->width * streamed_img->height);
+            }
+        }
+    }
+
+  g_slist_free_full (frames, g_free);
+  cairo_surface_destroy (img);
+}
+
+/* Compares the pyramid search to the exhaustive one on swipes with a known
+ * movement, cut out of the captures of swipe sensors. */
+static void
+test_frame_assembling_pyramid (gconstpointer user_data)
+{
+  const char *driver = user_data;
+  cairo_surface_t *img = NULL;
+  int width;
+
+  img = load_capture (driver);
+  width = cairo_image_surface_get_width (img);
+
+  for (guint frame_height = 16; frame_height <= 32; frame_height *= 2)
+    {
+      struct fpi_frame_asmbl_ctx ctx = { 0, };
+      GSList *frames[2] = { NULL, };
+      gint correct[2] = { 0, };
+      gdouble elapsed[2];
+      gint num_frames;
+
+      ctx.get_pixel = cairo_get_pixel;
+      ctx.frame_width = width - 16;
+      ctx.frame_height = frame_height;
+      ctx.image_width = width;
+
+      /* Frames move by a varying offset, also sideways */
+      for (int s = 0; s < 2; s++)
+        frames[s] = cut_frames (img, frame_height, 5, 7, 2, frame_height / 2 - 1);
+      num_frames = g_slist_length (frames[0]);
+
+      for (int s = 0; s < 2; s++)
+        {
+          g_autoptr(GTimer) timer = g_timer_new ();
+
+          ctx.search = s == 0 ? FPI_FRAME_ASMBL_SEARCH_EXHAUSTIVE : FPI_FRAME_ASMBL_SEARCH_PYRAMID;
+          fpi_do_movement_estimation (&ctx, frames[s]);
+          elapsed[s] = g_timer_elapsed (timer, NULL);
+
+          for (GSList *l = frames[s]; l->next != NULL; l = l->next)
+            {
+              cairo_frame *prev = l->data;
+              cairo_frame *frame = l->next->data;
+
+              if (frame->frame.delta_x == (int) (frame->x - prev->x) &&
+                  frame->frame.delta_y == (int) (frame->y - prev->y))
+                correct[s]++;
+            }
+        }
+
+      g_test_message ("%s, %u lines: exhaustive %d/%d correct in %.2f ms, "
+                      "pyramid %d/%d correct in %.2f ms",
+                      driver, frame_height,
+                      correct[0], num_frames - 1, elapsed[0] * 1000,
+                      correct[1], num_frames - 1, elapsed[1] * 1000);
+
+      g_assert_cmpint (correct[1] * 20, >=, correct[0] * 19);
+
+      g_slist_free_full (frames[0], g_free);
+      g_slist_free_full (frames[1], g_free);
+    }
+
+  cairo_surface_destroy (img);
+}
+
 int
 main (int argc, char *argv[])
 {
   g_test_init (&argc, &argv, NULL);
 
   g_test_add_func ("/assembling/frames", test_frame_assembling);
+  g_test_add_func ("/assembling/frames-direct", test_frame_assembling_direct);
+  g_test_add_func ("/assembling/frame-store", test_frame_store);
+  g_test_add_func ("/assembling/streaming", test_frame_assembling_streaming);
+  g_test_add_data_func ("/assembling/pyramid/aes2501", "aes2501", test_frame_assembling_pyramid);
+  g_test_add_data_func ("/assembling/pyramid/elan", "elan", test_frame_assembling_pyramid);
+  g_test_add_data_func ("/assembling/pyramid/elanspi", "elanspi", test_frame_assembling_pyramid);
+  g_test_add_data_func ("/assembling/pyramid/egis0570", "egis0570", test_frame_assembling_pyramid);
 
   return g_test_run ();
 }
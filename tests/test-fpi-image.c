@@ -0,0 +1,107 @@
+/*
+ * Unit tests for the internal image API
+ * Copyright (C) 2026 The libfprint contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <libfprint/fprint.h>
+#include <cairo.h>
+#include <string.h>
+
+#include "fpi-compat.h"
+#include "fpi-image.h"
+#include "test-config.h"
+
+static FpImage *
+load_capture (const char *path)
+{
+  cairo_surface_t *img;
+  FpImage *image;
+  guchar *data;
+  gint stride;
+
+  img = cairo_image_surface_create_from_png (path);
+  g_assert_cmpint (cairo_surface_status (img), ==, CAIRO_STATUS_SUCCESS);
+  g_assert_cmpint (cairo_image_surface_get_format (img), ==, CAIRO_FORMAT_RGB24);
+
+  data = cairo_image_surface_get_data (img);
+  stride = cairo_image_surface_get_stride (img);
+  image = fp_image_new (cairo_image_surface_get_width (img),
+                        cairo_image_surface_get_height (img));
+
+  for (gint y = 0; y < image->height; y++)
+    for (gint x = 0; x < image->width; x++)
+      image->data[x + y * image->width] = data[x * 4 + y * stride + 1];
+
+  cairo_surface_destroy (img);
+
+  return image;
+}
+
+/* The capture of every driver test needs to pass the default quality
+ * thresholds of image devices, while an empty sensor must not. */
+static void
+test_estimate_quality (void)
+{
+  g_autofree char *tests_dir = NULL;
+  g_autoptr(GDir) dir = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(FpImage) empty = NULL;
+  const char *name;
+  gdouble coverage, coherence;
+  guint n_captures = 0;
+
+  tests_dir = g_build_path (G_DIR_SEPARATOR_S, SOURCE_ROOT, "tests", NULL);
+  dir = g_dir_open (tests_dir, 0, &error);
+  g_assert_no_error (error);
+
+  while ((name = g_dir_read_name (dir)))
+    {
+      g_autofree char *path = NULL;
+      g_autoptr(FpImage) image = NULL;
+
+      path = g_build_path (G_DIR_SEPARATOR_S, tests_dir, name, "capture.png", NULL);
+      if (!g_file_test (path, G_FILE_TEST_EXISTS))
+        continue;
+
+      image = load_capture (path);
+      fpi_image_estimate_quality (image, &coverage, &coherence);
+      g_test_message ("%s: coverage %.2f, coherence %.2f", name, coverage, coherence);
+
+      g_assert_cmpfloat (coverage, >=, FPI_IMAGE_DEFAULT_MIN_COVERAGE);
+      g_assert_cmpfloat (coverage, <=, 1);
+      g_assert_cmpfloat (coherence, >=, FPI_IMAGE_DEFAULT_MIN_COHERENCE);
+      g_assert_cmpfloat (coherence, <=, 1);
+      n_captures++;
+    }
+
+  g_assert_cmpuint (n_captures, >, 0);
+
+  empty = fp_image_new (256, 240);
+  memset (empty->data, 0xff, empty->width * empty->height);
+  fpi_image_estimate_quality (empty, &coverage, &coherence);
+  g_assert_cmpfloat (coverage, <, FPI_IMAGE_DEFAULT_MIN_COVERAGE);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/fpi-image/estimate-quality", test_estimate_quality);
+
+  return g_test_run ();
+}
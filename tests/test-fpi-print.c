@@ -0,0 +1,452 @@
+/*
+ * Unit tests for matching NBIS prints
+ * Copyright (C) 2026 The libfprint contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <libfprint/fprint.h>
+#include <cairo.h>
+
+#include "fpi-compat.h"
+#include "fp-print-private.h"
+#include "test-config.h"
+
+/* The gallery holds copies of all captures, the probes are only taken from
+ * those with enough minutiae to be identified reliably. */
+static const char *drivers[] = {
+  "aes2501", "aes3500", "egis0570", "elan", "elan-cobo", "elanspi", "nb1010",
+  "upektc_img", "uru4000-4500", "uru4000-msv2", "vfs0050", "vfs301", "vfs5011",
+  "vfs7552",
+};
+static const char *probe_drivers[] = {
+  "egis0570", "elan-cobo", "elanspi", "uru4000-msv2", "vfs0050", "vfs301",
+};
+
+static const gint thresholds[] = { 5, 20, BOZORTH3_DEFAULT_THRESHOLD, 100, 250, 100000 };
+
+static void
+detect_minutiae_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  g_autoptr(GError) error = NULL;
+  gboolean *done = user_data;
+
+  fp_image_detect_minutiae_finish (FP_IMAGE (source_object), res, &error);
+  g_assert_no_error (error);
+  *done = TRUE;
+}
+
+static FpPrint *
+nbis_print_new (void)
+{
+  FpPrint *print;
+
+  print = g_object_new (FP_TYPE_PRINT,
+                        "driver", "virtual_image",
+                        "device-id", "test",
+                        "device-stored", FALSE,
+                        NULL);
+  g_object_ref_sink (print);
+  fpi_print_set_type (print, FPI_PRINT_NBIS);
+
+  return print;
+}
+
+/* Returns the minutiae of the capture of @driver, they are only detected
+ * once for all tests. */
+static const FpiPrintMinutiae *
+get_capture (const char *driver)
+{
+  static GHashTable *captures = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *path = NULL;
+  g_autoptr(FpImage) image = NULL;
+  FpPrint *print;
+  cairo_surface_t *img;
+  guchar *data;
+  gint stride;
+  gboolean done = FALSE;
+
+  if (!captures)
+    captures = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_object_unref);
+
+  print = g_hash_table_lookup (captures, driver);
+  if (print)
+    return g_ptr_array_index (print->prints, 0);
+
+  path = g_build_path (G_DIR_SEPARATOR_S, SOURCE_ROOT, "tests", driver, "capture.png", NULL);
+
+  img = cairo_image_surface_create_from_png (path);
+  g_assert_cmpint (cairo_surface_status (img), ==, CAIRO_STATUS_SUCCESS);
+  g_assert_cmpint (cairo_image_surface_get_format (img), ==, CAIRO_FORMAT_RGB24);
+
+  data = cairo_image_surface_get_data (img);
+  stride = cairo_image_surface_get_stride (img);
+  image = fp_image_new (cairo_image_surface_get_width (img),
+                        cairo_image_surface_get_height (img));
+  image->ppmm = 19.685;
+
+  for (gint y = 0; y < image->height; y++)
+    for (gint x = 0; x < image->width; x++)
+      image->data[x + y * image->width] = data[x * 4 + y * stride + 1];
+
+  cairo_surface_destroy (img);
+
+  fp_image_detect_minutiae (image, NULL, detect_minutiae_cb, &done);
+  while (!done)
+    g_main_context_iteration (NULL, TRUE);
+
+  print = nbis_print_new ();
+  g_assert_true (fpi_print_add_from_image (print, image, &error));
+  g_assert_no_error (error);
+  g_hash_table_insert (captures, (gpointer) driver, print);
+
+  return g_ptr_array_index (print->prints, 0);
+}
+
+/* Adds a copy of @minutiae to @print, shifted by @dx and @dy and with every
+ * minutia moved by a few pixels and degrees, like another scan of the same
+ * finger. Every fifth minutia is dropped. */
+static void
+add_jittered_copy (FpPrint *print, const FpiPrintMinutiae *minutiae, gint dx, gint dy)
+{
+  FpiPrintMinutiae *copy;
+  guint n = 0;
+
+  copy = fpi_print_minutiae_new (minutiae->n_minutiae - minutiae->n_minutiae / 5);
+  for (guint i = 0; i < minutiae->n_minutiae; i++)
+    {
+      if (i % 5 == 4)
+        continue;
+
+      FPI_PRINT_MINUTIAE_X (copy)[n] = FPI_PRINT_MINUTIAE_X (minutiae)[i] + dx + g_test_rand_int_range (-2, 3);
+      FPI_PRINT_MINUTIAE_Y (copy)[n] = FPI_PRINT_MINUTIAE_Y (minutiae)[i] + dy + g_test_rand_int_range (-2, 3);
+      FPI_PRINT_MINUTIAE_THETA (copy)[n] = IANGLE180 (FPI_PRINT_MINUTIAE_THETA (minutiae)[i] +
+                                                      g_test_rand_int_range (-3, 4));
+      n++;
+    }
+  g_assert_cmpuint (n, ==, copy->n_minutiae);
+
+  g_ptr_array_add (print->prints, copy);
+}
+
+/* Builds a gallery with at least two templates per capture and more
+ * templates than there are workers. Every other template also holds a
+ * print of another finger in front of the genuine one. */
+static GPtrArray *
+gallery_new (void)
+{
+  GPtrArray *gallery = g_ptr_array_new_with_free_func (g_object_unref);
+  guint n_copies = 2 + g_get_num_processors () / G_N_ELEMENTS (drivers);
+
+  for (guint c = 0; c < n_copies; c++)
+    {
+      for (guint d = 0; d < G_N_ELEMENTS (drivers); d++)
+        {
+          FpPrint *template = nbis_print_new ();
+
+          if (c % 2 == 1)
+            add_jittered_copy (template,
+                               get_capture (drivers[(d + 1) % G_N_ELEMENTS (drivers)]),
+                               -3 * c, 2 * c);
+          add_jittered_copy (template, get_capture (drivers[d]), 5 * c, -4 * c);
+
+          g_ptr_array_add (gallery, template);
+        }
+    }
+
+  g_assert_cmpuint (gallery->len, >, g_get_num_processors ());
+
+  return gallery;
+}
+
+static FpPrint *
+probe_new (const char *driver)
+{
+  FpPrint *probe = nbis_print_new ();
+
+  add_jittered_copy (probe, get_capture (driver), 7, -4);
+
+  return probe;
+}
+
+/* Identifying needs to give the same result as matching each template in
+ * turn, in both modes. The thresholds are reached by no template, only by
+ * the genuine ones or by impostors as well. */
+static void
+test_bz3_identify (void)
+{
+  g_autoptr(GPtrArray) gallery = gallery_new ();
+
+  for (guint p = 0; p < G_N_ELEMENTS (probe_drivers); p++)
+    {
+      g_autoptr(FpPrint) probe = probe_new (probe_drivers[p]);
+      g_autofree gint *scores = g_new (gint, gallery->len);
+
+      for (guint i = 0; i < gallery->len; i++)
+        {
+          g_autoptr(GError) error = NULL;
+
+          g_assert_true (fpi_print_bz3_score (g_ptr_array_index (gallery, i), probe,
+                                              &scores[i], &error));
+          g_assert_no_error (error);
+
+          /* The genuine templates match at the default threshold */
+          if (g_str_equal (drivers[i % G_N_ELEMENTS (drivers)], probe_drivers[p]))
+            g_assert_cmpint (scores[i], >=, BOZORTH3_DEFAULT_THRESHOLD);
+        }
+
+      for (guint t = 0; t < G_N_ELEMENTS (thresholds); t++)
+        {
+          g_autoptr(GError) error = NULL;
+          FpPrint *first_match = NULL;
+          FpPrint *best_match = NULL;
+          FpPrint *match;
+          FpiMatchResult result;
+          gint best_score = 0;
+
+          for (guint i = 0; i < gallery->len; i++)
+            {
+              FpPrint *template = g_ptr_array_index (gallery, i);
+
+              result = fpi_print_bz3_match (template, probe, thresholds[t], &error);
+              g_assert_no_error (error);
+              g_assert_cmpint (result == FPI_MATCH_SUCCESS, ==, scores[i] >= thresholds[t]);
+
+              if (result == FPI_MATCH_SUCCESS && !first_match)
+                first_match = template;
+
+              if (scores[i] >= thresholds[t] && scores[i] > best_score)
+                {
+                  best_score = scores[i];
+                  best_match = template;
+                }
+            }
+
+          result = fpi_print_bz3_identify (gallery, probe, thresholds[t],
+                                           FPI_PRINT_IDENTIFY_FIRST_MATCH,
+                                           NULL, &match, &error);
+          g_assert_no_error (error);
+          g_assert_cmpint (result, ==, first_match ? FPI_MATCH_SUCCESS : FPI_MATCH_FAIL);
+          g_assert_true (match == first_match);
+
+          result = fpi_print_bz3_identify (gallery, probe, thresholds[t],
+                                           FPI_PRINT_IDENTIFY_BEST_MATCH,
+                                           NULL, &match, &error);
+          g_assert_no_error (error);
+          g_assert_cmpint (result, ==, best_match ? FPI_MATCH_SUCCESS : FPI_MATCH_FAIL);
+          g_assert_true (match == best_match);
+        }
+    }
+}
+
+/* Scores the probe against every print of @template with a separate
+ * matcher context that does not use the cached comparison tables. */
+static gint
+reference_score (struct bz_context *ctx, FpPrint *template, FpPrint *probe)
+{
+  struct xyt_struct pstruct, gstruct;
+  gint best_score = 0;
+
+  fpi_print_minutiae_to_xyt (g_ptr_array_index (probe->prints, 0), &pstruct);
+
+  for (guint i = 0; i < template->prints->len; i++)
+    {
+      gint probe_len, gallery_len, np;
+
+      fpi_print_minutiae_to_xyt (g_ptr_array_index (template->prints, i), &gstruct);
+      probe_len = bozorth_probe_init (ctx, &pstruct);
+      gallery_len = bozorth_gallery_init (ctx, &gstruct);
+      np = bz_match (ctx, probe_len, gallery_len);
+      best_score = MAX (best_score, bz_match_score (ctx, np, &pstruct, &gstruct));
+    }
+
+  return best_score;
+}
+
+static void
+test_bz3_score (void)
+{
+  g_autoptr(GPtrArray) gallery = gallery_new ();
+  struct bz_context *ctx = bz_alloc_context ();
+
+  for (guint p = 0; p < G_N_ELEMENTS (probe_drivers); p++)
+    {
+      g_autoptr(FpPrint) probe = probe_new (probe_drivers[p]);
+
+      for (guint i = 0; i < gallery->len; i++)
+        {
+          FpPrint *template = g_ptr_array_index (gallery, i);
+          g_autoptr(GError) error = NULL;
+          gint score = -1;
+
+          g_assert_true (fpi_print_bz3_score (template, probe, &score, &error));
+          g_assert_no_error (error);
+          g_assert_cmpint (score, ==, reference_score (ctx, template, probe));
+
+          /* Again, now with the comparison tables of the template cached */
+          g_assert_true (fpi_print_bz3_score (template, probe, &score, &error));
+          g_assert_no_error (error);
+          g_assert_cmpint (score, ==, reference_score (ctx, template, probe));
+        }
+    }
+
+  bz_free_context (ctx);
+}
+
+/* Every template of the gallery is ranked once with its own score, by
+ * decreasing score and in gallery order for the same score. Limiting the
+ * number of candidates returns the start of the full ranking. */
+static void
+test_bz3_rank (void)
+{
+  g_autoptr(GPtrArray) gallery = gallery_new ();
+  struct bz_context *ctx = bz_alloc_context ();
+  const guint max_candidates[] = { 1, 3, G_N_ELEMENTS (drivers), gallery->len, gallery->len + 5 };
+
+  for (guint p = 0; p < G_N_ELEMENTS (probe_drivers); p++)
+    {
+      g_autoptr(FpPrint) probe = probe_new (probe_drivers[p]);
+      g_autoptr(GArray) ranking = NULL;
+      g_autoptr(GError) error = NULL;
+      g_autofree gboolean *ranked = g_new0 (gboolean, gallery->len);
+      FpiPrintCandidate *top;
+
+      ranking = fpi_print_bz3_rank (gallery, probe, 0, &error);
+      g_assert_no_error (error);
+      g_assert_nonnull (ranking);
+      g_assert_cmpuint (ranking->len, ==, gallery->len);
+
+      for (guint i = 0; i < ranking->len; i++)
+        {
+          FpiPrintCandidate *candidate = &g_array_index (ranking, FpiPrintCandidate, i);
+
+          g_assert_cmpuint (candidate->index, <, gallery->len);
+          g_assert_false (ranked[candidate->index]);
+          ranked[candidate->index] = TRUE;
+
+          g_assert_true (candidate->print == g_ptr_array_index (gallery, candidate->index));
+          g_assert_cmpint (candidate->score, ==, reference_score (ctx, candidate->print, probe));
+
+          if (i > 0)
+            {
+              FpiPrintCandidate *prev = &g_array_index (ranking, FpiPrintCandidate, i - 1);
+
+              g_assert_cmpint (prev->score, >=, candidate->score);
+              if (prev->score == candidate->score)
+                g_assert_cmpuint (prev->index, <, candidate->index);
+            }
+        }
+
+      /* A template holding a genuine print is ranked first */
+      top = &g_array_index (ranking, FpiPrintCandidate, 0);
+      g_assert_cmpint (top->score, >=, BOZORTH3_DEFAULT_THRESHOLD);
+
+      for (guint m = 0; m < G_N_ELEMENTS (max_candidates); m++)
+        {
+          g_autoptr(GArray) candidates = NULL;
+
+          candidates = fpi_print_bz3_rank (gallery, probe, max_candidates[m], &error);
+          g_assert_no_error (error);
+          g_assert_nonnull (candidates);
+          g_assert_cmpuint (candidates->len, ==, MIN (max_candidates[m], gallery->len));
+          g_assert_cmpmem (candidates->data, candidates->len * sizeof (FpiPrintCandidate),
+                           ranking->data, candidates->len * sizeof (FpiPrintCandidate));
+        }
+    }
+
+  bz_free_context (ctx);
+}
+
+/* Conservative pre-filter settings need to keep every template that
+ * matches, but skip those of captures with too few minutiae or too
+ * different edges. */
+static void
+test_bz3_prefilter (void)
+{
+  g_autoptr(GPtrArray) gallery = gallery_new ();
+  const FpiPrintPrefilter prefilter = {
+    .max_candidates = 0,
+    .min_similarity = 0.05,
+    .max_count_ratio = 4.0,
+  };
+
+  for (guint p = 0; p < G_N_ELEMENTS (probe_drivers); p++)
+    {
+      g_autoptr(FpPrint) probe = probe_new (probe_drivers[p]);
+      g_autoptr(GArray) order = NULL;
+      g_autoptr(GError) error = NULL;
+      g_autofree gboolean *kept = g_new0 (gboolean, gallery->len);
+      FpPrint *match;
+      FpiMatchResult result;
+      gint best_score = 0;
+      gint score;
+
+      order = fpi_print_bz3_prefilter (gallery, gallery->len, probe, &prefilter);
+      g_assert_cmpuint (order->len, >, 0);
+      g_assert_cmpuint (order->len, <, gallery->len);
+
+      for (guint i = 0; i < order->len; i++)
+        {
+          gint index = g_array_index (order, gint, i);
+
+          g_assert_cmpint (index, >=, 0);
+          g_assert_cmpint (index, <, gallery->len);
+          g_assert_false (kept[index]);
+          kept[index] = TRUE;
+        }
+
+      for (guint i = 0; i < gallery->len; i++)
+        {
+          g_assert_true (fpi_print_bz3_score (g_ptr_array_index (gallery, i), probe,
+                                              &score, &error));
+          g_assert_no_error (error);
+
+          if (score >= BOZORTH3_DEFAULT_THRESHOLD)
+            g_assert_true (kept[i]);
+          best_score = MAX (best_score, score);
+        }
+
+      /* The pre-filter does not change the outcome of identifying */
+      result = fpi_print_bz3_identify (gallery, probe, BOZORTH3_DEFAULT_THRESHOLD,
+                                       FPI_PRINT_IDENTIFY_FIRST_MATCH,
+                                       &prefilter, &match, &error);
+      g_assert_no_error (error);
+      g_assert_cmpint (result, ==, FPI_MATCH_SUCCESS);
+      g_assert_true (fpi_print_bz3_score (match, probe, &score, &error));
+      g_assert_cmpint (score, >=, BOZORTH3_DEFAULT_THRESHOLD);
+
+      result = fpi_print_bz3_identify (gallery, probe, BOZORTH3_DEFAULT_THRESHOLD,
+                                       FPI_PRINT_IDENTIFY_BEST_MATCH,
+                                       &prefilter, &match, &error);
+      g_assert_no_error (error);
+      g_assert_cmpint (result, ==, FPI_MATCH_SUCCESS);
+      g_assert_true (fpi_print_bz3_score (match, probe, &score, &error));
+      g_assert_cmpint (score, ==, best_score);
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/fpi-print/bz3-identify", test_bz3_identify);
+  g_test_add_func ("/fpi-print/bz3-score", test_bz3_score);
+  g_test_add_func ("/fpi-print/bz3-rank", test_bz3_rank);
+  g_test_add_func ("/fpi-print/bz3-prefilter", test_bz3_prefilter);
+
+  return g_test_run ();
+}
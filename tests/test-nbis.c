@@ -0,0 +1,811 @@
+/*
+ * NBIS minutiae detection and matching unit tests
+ * Copyright (C) 2026 The libfprint contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <cairo.h>
+#include <nbis.h>
+#include "fpi-compat.h"
+#include "test-config.h"
+
+typedef struct
+{
+  guchar *data;
+  gint    width;
+  gint    height;
+} TestImage;
+
+static void
+load_test_image (TestImage *image, const char *driver)
+{
+  g_autofree char *path = NULL;
+  cairo_surface_t *img;
+  guchar *data;
+  gint stride;
+
+  path = g_build_path (G_DIR_SEPARATOR_S, SOURCE_ROOT, "tests", driver, "capture.png", NULL);
+
+  img = cairo_image_surface_create_from_png (path);
+  g_assert_cmpint (cairo_surface_status (img), ==, CAIRO_STATUS_SUCCESS);
+  g_assert_cmpint (cairo_image_surface_get_format (img), ==, CAIRO_FORMAT_RGB24);
+
+  data = cairo_image_surface_get_data (img);
+  stride = cairo_image_surface_get_stride (img);
+  image->width = cairo_image_surface_get_width (img);
+  image->height = cairo_image_surface_get_height (img);
+  image->data = g_malloc (image->width * image->height);
+
+  for (gint y = 0; y < image->height; y++)
+    for (gint x = 0; x < image->width; x++)
+      image->data[x + y * image->width] = data[x * 4 + y * stride + 1];
+
+  cairo_surface_destroy (img);
+}
+
+typedef struct
+{
+  MINUTIAE *minutiae;
+  gint     *quality_map;
+  gint     *direction_map;
+  gint     *low_contrast_map;
+  gint     *low_flow_map;
+  gint     *high_curve_map;
+  guchar   *bdata;
+  gint      map_w;
+  gint      map_h;
+  gint      bw;
+  gint      bh;
+  gint      bd;
+} Extraction;
+
+static void
+extract_minutiae (Extraction *result, const TestImage *image)
+{
+  g_autofree guchar *idata = g_memdup2 (image->data, image->width * image->height);
+
+  g_assert_cmpint (get_minutiae (&result->minutiae, &result->quality_map,
+                                 &result->direction_map, &result->low_contrast_map,
+                                 &result->low_flow_map, &result->high_curve_map,
+                                 &result->map_w, &result->map_h,
+                                 &result->bdata, &result->bw, &result->bh, &result->bd,
+                                 idata, image->width, image->height, 8,
+                                 19.685, &g_lfsparms_V2), ==, 0);
+}
+
+static void
+extraction_clear (Extraction *result)
+{
+  free_minutiae (result->minutiae);
+  g_free (result->quality_map);
+  g_free (result->direction_map);
+  g_free (result->low_contrast_map);
+  g_free (result->low_flow_map);
+  g_free (result->high_curve_map);
+  g_free (result->bdata);
+}
+
+static void
+assert_extractions_equal (const Extraction *a, const Extraction *b)
+{
+  gsize map_size = a->map_w * a->map_h * sizeof (gint);
+
+  g_assert_cmpint (a->map_w, ==, b->map_w);
+  g_assert_cmpint (a->map_h, ==, b->map_h);
+  g_assert_cmpmem (a->direction_map, map_size, b->direction_map, map_size);
+  g_assert_cmpmem (a->low_contrast_map, map_size, b->low_contrast_map, map_size);
+  g_assert_cmpmem (a->low_flow_map, map_size, b->low_flow_map, map_size);
+  g_assert_cmpmem (a->high_curve_map, map_size, b->high_curve_map, map_size);
+  g_assert_cmpmem (a->bdata, a->bw * a->bh, b->bdata, b->bw * b->bh);
+
+  g_assert_cmpint (a->minutiae->num, ==, b->minutiae->num);
+  for (gint j = 0; j < a->minutiae->num; j++)
+    {
+      g_assert_cmpint (a->minutiae->list[j]->x, ==, b->minutiae->list[j]->x);
+      g_assert_cmpint (a->minutiae->list[j]->y, ==, b->minutiae->list[j]->y);
+      g_assert_cmpint (a->minutiae->list[j]->direction, ==, b->minutiae->list[j]->direction);
+      g_assert_cmpfloat (a->minutiae->list[j]->reliability, ==, b->minutiae->list[j]->reliability);
+    }
+}
+
+/* Converts the minutiae to the points used by the matcher, the same way
+ * as fpi_print_add_from_image() apart from sorting them. */
+static void
+extraction_to_xyt (const Extraction *result, const TestImage *image,
+                   struct xyt_struct *xyt)
+{
+  gint n = MIN (result->minutiae->num, MAX_BOZORTH_MINUTIAE);
+
+  for (gint i = 0; i < n; i++)
+    {
+      lfs2nist_minutia_XYT (&xyt->xcol[i], &xyt->ycol[i], &xyt->thetacol[i],
+                            result->minutiae->list[i], image->width, image->height);
+      if (xyt->thetacol[i] > 180)
+        xyt->thetacol[i] -= 360;
+    }
+  xyt->nrows = n;
+}
+
+static void
+load_test_xyt (struct xyt_struct *xyt, const char *driver)
+{
+  TestImage image;
+  Extraction result;
+
+  load_test_image (&image, driver);
+  extract_minutiae (&result, &image);
+  extraction_to_xyt (&result, &image, xyt);
+
+  extraction_clear (&result);
+  g_free (image.data);
+}
+
+/* Compares the DFT powers of every block of a random image */
+static void
+test_dft_powers (void)
+{
+  const LFSPARMS *lfsparms = &g_lfsparms_V2;
+  DFTWAVES *dftwaves;
+  ROTGRIDS *dftgrids;
+  g_autofree guchar *pdata = NULL;
+  double **powers;
+  double **ref_powers;
+  gint iw = 160, ih = 200;
+  gint maxpad, pw, ph;
+  gint blkoffset;
+
+  maxpad = get_max_padding_V2 (lfsparms->windowsize, lfsparms->windowoffset,
+                               lfsparms->dirbin_grid_w, lfsparms->dirbin_grid_h);
+  pw = iw + 2 * maxpad;
+  ph = ih + 2 * maxpad;
+
+  /* Pixels are scaled to 6 bits before the DFT analysis */
+  pdata = g_malloc (pw * ph);
+  for (gint i = 0; i < pw * ph; i++)
+    pdata[i] = g_test_rand_int_range (0, 64);
+
+  select_dft_fixed_point (FALSE);
+
+  g_assert_cmpint (get_cached_dftwaves (&dftwaves, g_dft_coefs,
+                                        lfsparms->num_dft_waves,
+                                        lfsparms->windowsize), ==, 0);
+  g_assert_cmpint (get_cached_rotgrids (&dftgrids, iw, ih, maxpad,
+                                        lfsparms->start_dir_angle,
+                                        lfsparms->num_directions,
+                                        lfsparms->windowsize, lfsparms->windowsize,
+                                        RELATIVE2ORIGIN), ==, 0);
+
+  g_assert_cmpint (alloc_dir_powers (&powers, dftwaves->nwaves, dftgrids->ngrids), ==, 0);
+  g_assert_cmpint (alloc_dir_powers (&ref_powers, dftwaves->nwaves, dftgrids->ngrids), ==, 0);
+
+  /* Every window up to the bottom right corner of the image */
+  for (gint y = maxpad; y <= ph - maxpad - lfsparms->windowsize; y += 3)
+    {
+      for (gint x = maxpad; x <= pw - maxpad - lfsparms->windowsize; x += 3)
+        {
+          blkoffset = y * pw + x;
+
+          select_dft_kernel (FALSE);
+          g_assert_cmpint (dft_dir_powers (ref_powers, pdata, blkoffset, pw, ph,
+                                           dftwaves, dftgrids), ==, 0);
+
+          select_dft_kernel (TRUE);
+          g_assert_cmpint (dft_dir_powers (powers, pdata, blkoffset, pw, ph,
+                                           dftwaves, dftgrids), ==, 0);
+
+          for (gint w = 0; w < dftwaves->nwaves; w++)
+            g_assert_cmpmem (powers[w], dftgrids->ngrids * sizeof (double),
+                             ref_powers[w], dftgrids->ngrids * sizeof (double));
+        }
+    }
+
+  free_dir_powers (powers, dftwaves->nwaves);
+  free_dir_powers (ref_powers, dftwaves->nwaves);
+}
+
+/* The edge table of a set of points needs to be identical using every
+ * pair loop, rows and their order included. */
+static void
+assert_comp_rows_equal (struct bz_context *ctx, struct xyt_struct *xyt)
+{
+  const gint levels[] = { BZ_COMP_ROWS_SCALAR, BZ_COMP_ROWS_BASELINE, BZ_COMP_ROWS_BEST };
+  g_autofree gint *ref_rows = NULL;
+  g_autofree gint *ref_order = NULL;
+  gint ref_len = 0;
+
+  for (guint l = 0; l < G_N_ELEMENTS (levels); l++)
+    {
+      g_autofree gint *order = NULL;
+      gint len;
+
+      ctx->comp_rows = bz_comp_rows_select (levels[l]);
+      bz_comp (ctx, xyt->nrows, xyt->xcol, xyt->ycol, xyt->thetacol,
+               &len, ctx->scols, ctx->scolpt);
+
+      order = g_new (gint, len);
+      for (gint i = 0; i < len; i++)
+        order[i] = (ctx->scolpt[i] - ctx->scols[0]) / COLS_SIZE_2;
+
+      if (l == 0)
+        {
+          ref_len = len;
+          ref_rows = g_memdup2 (ctx->scols, len * sizeof (ctx->scols[0]));
+          ref_order = g_steal_pointer (&order);
+          continue;
+        }
+
+      g_assert_cmpint (len, ==, ref_len);
+      for (gint i = 0; i < len; i++)
+        {
+          g_assert_cmpmem (ctx->scols[i], sizeof (ctx->scols[0]),
+                           &ref_rows[i * COLS_SIZE_2], sizeof (ctx->scols[0]));
+          g_assert_cmpint (order[i], ==, ref_order[i]);
+        }
+    }
+
+  ctx->comp_rows = bz_comp_rows_select (BZ_COMP_ROWS_BEST);
+}
+
+static void
+test_comp_rows (void)
+{
+  const char *drivers[] = { "aes2501", "aes3500", "elan", "upektc_img", "vfs5011" };
+  struct bz_context *ctx = bz_alloc_context ();
+  struct xyt_struct xyt;
+
+  for (guint d = 0; d < G_N_ELEMENTS (drivers); d++)
+    {
+      load_test_xyt (&xyt, drivers[d]);
+      assert_comp_rows_equal (ctx, &xyt);
+    }
+
+  /* Random points of any count, so every vector length gets a partial
+   * last vector, with some of the opposite angles that are skipped. */
+  for (gint n = 0; n <= MAX_BOZORTH_MINUTIAE; n += 7)
+    {
+      xyt.nrows = n;
+      for (gint i = 0; i < n; i++)
+        {
+          xyt.xcol[i] = g_test_rand_int_range (0, 200);
+          xyt.ycol[i] = g_test_rand_int_range (0, 200);
+          if (i > 0 && g_test_rand_int_range (0, 4) == 0)
+            xyt.thetacol[i] = IANGLE180 (xyt.thetacol[i - 1] + 180);
+          else
+            xyt.thetacol[i] = g_test_rand_int_range (-179, 181);
+        }
+      assert_comp_rows_equal (ctx, &xyt);
+    }
+
+  bz_free_context (ctx);
+}
+
+/* Stopping the score computation early needs to give the same decision
+ * as the full score for every threshold. The prints are matched against
+ * shifted and jittered copies of themselves, and against each other. */
+static void
+test_match_score_bounded (void)
+{
+  const char *drivers[] = { "egis0570", "elan-cobo", "elanspi", "vfs0050", "vfs7552" };
+  const gint thresholds[] = { 1, 2, 5, 10, 20, 40, 60, 100, 200 };
+  struct bz_context *ctx = bz_alloc_context ();
+  struct xyt_struct prints[2 * G_N_ELEMENTS (drivers)];
+  gint n_prints = G_N_ELEMENTS (prints);
+  gint n_genuine = 0;
+
+  for (guint d = 0; d < G_N_ELEMENTS (drivers); d++)
+    {
+      struct xyt_struct *xyt = &prints[2 * d];
+      struct xyt_struct *copy = &prints[2 * d + 1];
+
+      load_test_xyt (xyt, drivers[d]);
+
+      copy->nrows = 0;
+      for (gint i = 0; i < xyt->nrows; i++)
+        {
+          if (i % 5 == 4)
+            continue;
+
+          copy->xcol[copy->nrows] = xyt->xcol[i] + 7 + g_test_rand_int_range (-2, 3);
+          copy->ycol[copy->nrows] = xyt->ycol[i] - 4 + g_test_rand_int_range (-2, 3);
+          copy->thetacol[copy->nrows] = IANGLE180 (xyt->thetacol[i] + g_test_rand_int_range (-3, 4));
+          copy->nrows++;
+        }
+    }
+
+  for (gint p = 0; p < n_prints; p++)
+    {
+      gint probe_len = bozorth_probe_init (ctx, &prints[p]);
+
+      for (gint g = 0; g < n_prints; g++)
+        {
+          gint gallery_len = bozorth_gallery_init (ctx, &prints[g]);
+          gint np = bz_match (ctx, probe_len, gallery_len);
+          gint score = bz_match_score (ctx, np, &prints[p], &prints[g]);
+          gint bounded;
+
+          if (p / 2 == g / 2)
+            {
+              g_assert_cmpint (score, >=, 40);
+              n_genuine++;
+            }
+
+          for (guint t = 0; t < G_N_ELEMENTS (thresholds); t++)
+            {
+              bounded = bz_match_score_bounded (ctx, np, &prints[p], &prints[g], thresholds[t]);
+              g_assert_cmpint (bounded >= thresholds[t], ==, score >= thresholds[t]);
+            }
+
+          /* Just above and below the score itself */
+          for (gint t = MAX (score - 1, 1); t <= score + 1; t++)
+            {
+              bounded = bz_match_score_bounded (ctx, np, &prints[p], &prints[g], t);
+              g_assert_cmpint (bounded >= t, ==, score >= t);
+            }
+
+          /* Above the number of edge pairs, the score can not be reached
+           * and the first edge pair already stops the traversal. */
+          if (np > 1)
+            {
+              g_assert_cmpint (score, <=, np);
+              g_assert_cmpint (bz_match_score_bounded (ctx, np, &prints[p], &prints[g], np + 1), ==, 0);
+            }
+
+          /* A single cluster reaches the lowest threshold */
+          if (score >= MMSTR)
+            {
+              bounded = bz_match_score_bounded (ctx, np, &prints[p], &prints[g], 1);
+              g_assert_cmpint (bounded, >=, 1);
+              g_assert_cmpint (bounded, <=, score);
+            }
+        }
+    }
+
+  g_assert_cmpint (n_genuine, ==, 4 * G_N_ELEMENTS (drivers));
+
+  bz_free_context (ctx);
+}
+
+/* Runs of pixels within a block are binarized together, which needs to
+ * give the same result as binarizing every pixel on its own. */
+static void
+test_binarize (void)
+{
+  const LFSPARMS *lfsparms = &g_lfsparms_V2;
+  ROTGRIDS *dirbingrids;
+  g_autofree guchar *pdata = NULL;
+  g_autofree gint *direction_map = NULL;
+  guchar *bdata;
+  gint iw = 157, ih = 203;
+  gint maxpad, pw, ph, mw, mh, bw, bh;
+
+  maxpad = get_max_padding_V2 (lfsparms->windowsize, lfsparms->windowoffset,
+                               lfsparms->dirbin_grid_w, lfsparms->dirbin_grid_h);
+  pw = iw + 2 * maxpad;
+  ph = ih + 2 * maxpad;
+
+  /* Pixels are scaled to 6 bits before the binarization */
+  pdata = g_malloc (pw * ph);
+  for (gint i = 0; i < pw * ph; i++)
+    pdata[i] = g_test_rand_int_range (0, 64);
+
+  mw = (iw + lfsparms->blocksize - 1) / lfsparms->blocksize;
+  mh = (ih + lfsparms->blocksize - 1) / lfsparms->blocksize;
+  direction_map = g_new (gint, mw * mh);
+  for (gint i = 0; i < mw * mh; i++)
+    direction_map[i] = g_test_rand_int_range (INVALID_DIR, lfsparms->num_directions);
+
+  g_assert_cmpint (get_cached_rotgrids (&dirbingrids, iw, ih, maxpad,
+                                        lfsparms->start_dir_angle,
+                                        lfsparms->num_directions,
+                                        lfsparms->dirbin_grid_w, lfsparms->dirbin_grid_h,
+                                        RELATIVE2CENTER), ==, 0);
+
+  g_assert_cmpint (binarize_image_V2 (&bdata, &bw, &bh, pdata, pw, ph,
+                                      direction_map, mw, mh,
+                                      lfsparms->blocksize, dirbingrids), ==, 0);
+  g_assert_cmpint (bw, ==, iw);
+  g_assert_cmpint (bh, ==, ih);
+
+  for (gint y = 0; y < ih; y++)
+    {
+      for (gint x = 0; x < iw; x++)
+        {
+          gint dir = direction_map[(y / lfsparms->blocksize) * mw + x / lfsparms->blocksize];
+          gint expected = WHITE_PIXEL;
+
+          if (dir != INVALID_DIR)
+            expected = dirbinarize (pdata + (y + maxpad) * pw + x + maxpad,
+                                    dir, dirbingrids);
+
+          g_assert_cmpint (bdata[y * bw + x], ==, expected);
+        }
+    }
+
+  g_free (bdata);
+}
+
+/* The minutiae are sorted by location using a merge sort, which needs to
+ * keep the order of the bubble sort it replaces for equal locations. */
+static void
+test_sort_stable (void)
+{
+  for (gint len = 1; len < 200; len += 7)
+    {
+      g_autofree gint *ranks = g_new (gint, len);
+      g_autofree gint *items = g_new (gint, len);
+      g_autofree gint *ref_ranks = NULL;
+      g_autofree gint *ref_items = NULL;
+
+      for (gint i = 0; i < len; i++)
+        {
+          ranks[i] = g_test_rand_int_range (0, len / 4 + 1);
+          items[i] = i;
+        }
+      ref_ranks = g_memdup2 (ranks, len * sizeof (gint));
+      ref_items = g_memdup2 (items, len * sizeof (gint));
+
+      bubble_sort_int_inc_2 (ref_ranks, ref_items, len);
+      merge_sort_int_inc_2 (ranks, items, len);
+
+      g_assert_cmpmem (ranks, len * sizeof (gint), ref_ranks, len * sizeof (gint));
+      g_assert_cmpmem (items, len * sizeof (gint), ref_items, len * sizeof (gint));
+    }
+}
+
+static void
+fill_pattern (guchar *data, gsize len)
+{
+  for (gsize i = 0; i < len; i++)
+    data[i] = i * 7 + 1;
+}
+
+static void
+assert_pattern (const guchar *data, gsize len)
+{
+  for (gsize i = 0; i < len; i++)
+    g_assert_cmpint (data[i], ==, (guchar) (i * 7 + 1));
+}
+
+/* The memory of an extraction is drawn from a per-thread arena, which needs
+ * to keep the contents of resized blocks, hand out released blocks again
+ * and keep its memory for the next extraction. */
+static void
+test_arena (void)
+{
+  const gsize big = 200 * 1024;
+  guchar *a, *b, *c, *d, *e;
+  guchar *p[3], *q[3];
+
+  if (!lfs_arena_enabled ())
+    {
+      g_test_skip ("The arena is disabled under sanitizers and valgrind");
+      return;
+    }
+
+  lfs_arena_begin ();
+
+  /* Released blocks are reclaimed once all blocks after them are */
+  a = lfs_alloc (100);
+  b = lfs_alloc (100);
+  lfs_free (b);
+  c = lfs_alloc (100);
+  g_assert_true (c == b);
+  lfs_free (a);
+  d = lfs_alloc (100);
+  g_assert_true (d > c);
+  lfs_free (d);
+  lfs_free (c);
+  e = lfs_alloc (100);
+  g_assert_true (e == a);
+  lfs_free (e);
+
+  /* Resizing moves blocks, also to a new chunk, or grows the last one */
+  a = lfs_alloc (1000);
+  fill_pattern (a, 1000);
+  b = lfs_alloc (100);
+  c = lfs_realloc (a, 2000);
+  g_assert_true (c != a);
+  assert_pattern (c, 1000);
+  fill_pattern (c, 2000);
+  d = lfs_realloc (c, 3000);
+  g_assert_true (d == c);
+  assert_pattern (d, 2000);
+  fill_pattern (d, 3000);
+  e = lfs_realloc (d, 3 * big);
+  assert_pattern (e, 3000);
+  g_assert_true (lfs_realloc (e, 10) == e);
+  lfs_free (e);
+  lfs_free (b);
+
+  /* Memory allocated before a nested use stays valid, and is only kept
+   * after the outermost use if it is exported. */
+  a = lfs_alloc (64);
+  fill_pattern (a, 64);
+  lfs_arena_begin ();
+  b = lfs_alloc (64);
+  lfs_arena_end ();
+  assert_pattern (a, 64);
+  lfs_free (b);
+  a = lfs_arena_export (a);
+
+  lfs_arena_end ();
+
+  assert_pattern (a, 64);
+  g_assert_true (lfs_arena_export (a) == a);
+  lfs_free (a);
+
+  /* The chunks of an extraction are merged when it ends, so that the
+   * next one draws all of its memory from the same chunk. */
+  lfs_arena_begin ();
+  for (gint i = 0; i < 3; i++)
+    p[i] = lfs_alloc (big);
+  lfs_arena_end ();
+
+  lfs_arena_begin ();
+  for (gint i = 0; i < 3; i++)
+    q[i] = lfs_alloc (big);
+  g_assert_true (q[1] > q[0]);
+  g_assert_true (q[1] - q[0] == q[2] - q[1]);
+  g_assert_true (p[2] - p[1] == q[2] - q[1]);
+  for (gint i = 2; i >= 0; i--)
+    lfs_free (q[i]);
+  lfs_arena_end ();
+
+  lfs_arena_begin ();
+  a = lfs_alloc (big);
+  g_assert_true (a == q[0]);
+  lfs_arena_end ();
+}
+
+/* Blocks outside of the foreground map are skipped as low contrast, so
+ * this must never be wrong.  The capture is placed on a flat background
+ * which needs to be detected as such. */
+static void
+test_foreground_map (gconstpointer user_data)
+{
+  const char *driver = user_data;
+  const LFSPARMS *lfsparms = &g_lfsparms_V2;
+  TestImage image;
+  g_autofree guchar *idata = NULL;
+  g_autofree guchar *pdata = NULL;
+  g_autofree gint *blkoffs = NULL;
+  g_autofree gint *foreground_map = NULL;
+  gint iw, ih, pw, ph, mw, mh, maxpad;
+  gint win_x, win_y, win_offset;
+  gint background = 0;
+
+  load_test_image (&image, driver);
+
+  /* Flat background of the same size as the capture on each side */
+  iw = image.width * 3;
+  ih = image.height * 3;
+  idata = g_malloc (iw * ih);
+  memset (idata, 0xff, iw * ih);
+  for (gint y = 0; y < image.height; y++)
+    memcpy (idata + (y + image.height) * iw + image.width,
+            image.data + y * image.width, image.width);
+
+  maxpad = get_max_padding_V2 (lfsparms->windowsize, lfsparms->windowoffset,
+                               lfsparms->dirbin_grid_w, lfsparms->dirbin_grid_h);
+  g_assert_cmpint (pad_uchar_image (&pdata, &pw, &ph, idata, iw, ih,
+                                    maxpad, lfsparms->pad_value), ==, 0);
+  bits_8to6 (pdata, pw, ph);
+
+  g_assert_cmpint (block_offsets (&blkoffs, &mw, &mh, iw, ih,
+                                  maxpad, lfsparms->blocksize), ==, 0);
+  g_assert_cmpint (gen_foreground_map (&foreground_map, blkoffs, mw, mh,
+                                       pdata, pw, ph, maxpad, lfsparms), ==, 0);
+
+  for (gint bi = 0; bi < mw * mh; bi++)
+    {
+      if (foreground_map[bi])
+        continue;
+
+      /* Same window as analyzed by gen_initial_maps() */
+      win_offset = blkoffs[bi] - lfsparms->windowoffset * pw - lfsparms->windowoffset;
+      win_x = CLAMP (win_offset % pw, maxpad, pw - maxpad - lfsparms->windowsize - 1);
+      win_y = CLAMP (win_offset / pw, maxpad, ph - maxpad - lfsparms->windowsize - 1);
+
+      g_assert_cmpint (low_contrast_block (win_y * pw + win_x, lfsparms->windowsize,
+                                           pdata, pw, ph, lfsparms), ==, TRUE);
+      background++;
+    }
+
+  /* At least the blocks which are entirely background */
+  g_assert_cmpint (background, >=, mw * mh * 8 / 9 - (mw + mh) * 4);
+
+  g_free (image.data);
+}
+
+/* The image maps and minutiae need to be exactly the same as the ones of
+ * the reference implementation. */
+static void
+test_direction_maps (gconstpointer user_data)
+{
+  const char *driver = user_data;
+  TestImage image;
+  Extraction result[2];
+
+  load_test_image (&image, driver);
+  select_dft_fixed_point (FALSE);
+
+  for (gint i = 0; i < 2; i++)
+    {
+      select_dft_kernel (i == 1);
+      extract_minutiae (&result[i], &image);
+    }
+
+  assert_extractions_equal (&result[0], &result[1]);
+
+  for (gint i = 0; i < 2; i++)
+    extraction_clear (&result[i]);
+  g_free (image.data);
+}
+
+/* The blocks of the initial maps are analyzed by several threads, which
+ * needs to give exactly the same maps and minutiae as a single thread. */
+static void
+test_map_threads (gconstpointer user_data)
+{
+  const char *driver = user_data;
+  TestImage image;
+  Extraction result[2];
+
+  load_test_image (&image, driver);
+
+  for (gint i = 0; i < 2; i++)
+    {
+      select_map_threads (i == 0 ? 1 : MAX_MAP_THREADS);
+      extract_minutiae (&result[i], &image);
+    }
+  select_map_threads (0);
+
+  assert_extractions_equal (&result[0], &result[1]);
+
+  for (gint i = 0; i < 2; i++)
+    extraction_clear (&result[i]);
+  g_free (image.data);
+}
+
+/* The fixed-point DFT analysis does not give exactly the same powers, so
+ * compare its results to the ones of the double precision reference.
+ * Directions may be off by one, and minutiae by a few pixels. */
+static void
+test_fixed_point (gconstpointer user_data)
+{
+  const char *driver = user_data;
+  const gint ndirs = g_lfsparms_V2.num_directions;
+  TestImage image;
+  Extraction result[2];
+  MINUTIAE *minutiae[2];
+  gint map_size;
+  gint same_dirs = 0, close_dirs = 0, matched = 0;
+
+  load_test_image (&image, driver);
+  select_dft_kernel (FALSE);
+
+  for (gint i = 0; i < 2; i++)
+    {
+      select_dft_fixed_point (i == 1);
+      extract_minutiae (&result[i], &image);
+      minutiae[i] = result[i].minutiae;
+    }
+  select_dft_fixed_point (FALSE);
+  select_dft_kernel (TRUE);
+
+  map_size = result[0].map_w * result[0].map_h;
+  for (gint bi = 0; bi < map_size; bi++)
+    {
+      gint ref = result[0].direction_map[bi];
+      gint dir = result[1].direction_map[bi];
+
+      if (ref == dir)
+        same_dirs++;
+      else if (ref >= 0 && dir >= 0 &&
+               (ABS (ref - dir) == 1 || ABS (ref - dir) == ndirs - 1))
+        close_dirs++;
+    }
+
+  for (gint j = 0; j < minutiae[1]->num; j++)
+    {
+      MINUTIA *m = minutiae[1]->list[j];
+
+      for (gint k = 0; k < minutiae[0]->num; k++)
+        {
+          MINUTIA *ref = minutiae[0]->list[k];
+          gint ddir = ABS (m->direction - ref->direction);
+
+          if (ABS (m->x - ref->x) <= 2 && ABS (m->y - ref->y) <= 2 &&
+              MIN (ddir, 2 * ndirs - ddir) <= 1)
+            {
+              matched++;
+              break;
+            }
+        }
+    }
+
+  g_test_message ("%s: %d of %d directions equal, %d off by one; "
+                  "%d of %d minutiae matched (reference has %d)",
+                  driver, same_dirs, map_size, close_dirs,
+                  matched, minutiae[1]->num, minutiae[0]->num);
+
+  g_assert_cmpint ((same_dirs + close_dirs) * 100, >=, map_size * 99);
+  g_assert_cmpint (same_dirs * 100, >=, map_size * 95);
+  g_assert_cmpint (matched * 100, >=, minutiae[1]->num * 90);
+  g_assert_cmpint (ABS (minutiae[1]->num - minutiae[0]->num) * 100, <=,
+                   minutiae[0]->num * 10);
+
+  for (gint i = 0; i < 2; i++)
+    extraction_clear (&result[i]);
+  g_free (image.data);
+}
+
+/* Every stage of an extraction is timed, and all of them together take no
+ * longer than the whole extraction. */
+static void
+test_timings (void)
+{
+  TestImage image;
+  LFS_TIMINGS timings;
+  Extraction result;
+  gdouble stages;
+
+  load_test_image (&image, "vfs5011");
+
+  extract_minutiae (&result, &image);
+  get_minutiae_timings (&timings);
+
+  g_assert_cmpfloat (timings.maps, >, 0);
+  g_assert_cmpfloat (timings.binarization, >, 0);
+  g_assert_cmpfloat (timings.detection, >, 0);
+  g_assert_cmpfloat (timings.removal, >=, 0);
+  g_assert_cmpfloat (timings.ridge_counts, >=, 0);
+  g_assert_cmpfloat (timings.quality, >=, 0);
+
+  stages = timings.maps + timings.binarization + timings.detection +
+           timings.removal + timings.ridge_counts + timings.quality;
+  g_assert_cmpfloat (stages, <=, timings.total);
+
+  extraction_clear (&result);
+  g_free (image.data);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/nbis/dft-powers", test_dft_powers);
+  g_test_add_func ("/nbis/binarize", test_binarize);
+  g_test_add_func ("/nbis/sort-stable", test_sort_stable);
+  g_test_add_func ("/nbis/arena", test_arena);
+  g_test_add_func ("/nbis/comp-rows", test_comp_rows);
+  g_test_add_func ("/nbis/match-score-bounded", test_match_score_bounded);
+  g_test_add_data_func ("/nbis/foreground-map/vfs5011", "vfs5011", test_foreground_map);
+  g_test_add_data_func ("/nbis/direction-maps/vfs5011", "vfs5011", test_direction_maps);
+  g_test_add_data_func ("/nbis/direction-maps/aes3500", "aes3500", test_direction_maps);
+  g_test_add_data_func ("/nbis/map-threads/vfs5011", "vfs5011", test_map_threads);
+  g_test_add_data_func ("/nbis/map-threads/elanspi", "elanspi", test_map_threads);
+  g_test_add_data_func ("/nbis/fixed-point/aes2501", "aes2501", test_fixed_point);
+  g_test_add_data_func ("/nbis/fixed-point/aes3500", "aes3500", test_fixed_point);
+  g_test_add_data_func ("/nbis/fixed-point/elan", "elan", test_fixed_point);
+  g_test_add_data_func ("/nbis/fixed-point/upektc_img", "upektc_img", test_fixed_point);
+  g_test_add_data_func ("/nbis/fixed-point/vfs5011", "vfs5011", test_fixed_point);
+  g_test_add_func ("/nbis/timings", test_timings);
+
+  return g_test_run ();
+}
@@ -80,6 +80,13 @@ class VirtualImage(unittest.TestCase):
             n = os.path.basename(f)[:-4]
             cls.prints[n] = load_image(f)
 
+        # An image of the empty sensor
+        empty = cairo.ImageSurface(cairo.Format.A8, 256, 240)
+        cr = cairo.Context(empty)
+        cr.set_source_rgba(1, 1, 1, 1)
+        cr.paint()
+        cls.prints['empty'] = empty
+
     @classmethod
     def tearDownClass(cls):
         shutil.rmtree(cls.tmpdir)
@@ -303,6 +310,16 @@ class VirtualImage(unittest.TestCase):
         assert(self._verify_error is not None)
         assert(self._verify_error.matches(FPrint.device_retry_quark(), FPrint.DeviceRetry.TOO_SHORT))
 
+        # Unusable images are rejected before detecting minutiae
+        self._verify_fp = None
+        self._verify_error = None
+        self.dev.verify(fp_whorl, callback=verify_cb)
+        self.send_image('empty')
+        while self._verify_fp is None and self._verify_error is None:
+            ctx.iteration(True)
+        assert(self._verify_error is not None)
+        assert(self._verify_error.matches(FPrint.device_retry_quark(), FPrint.DeviceRetry.CENTER_FINGER))
+
         self._verify_fp = None
         self._verify_error = None
         self.dev.verify(fp_whorl, callback=verify_cb)
@@ -401,6 +418,108 @@ class VirtualImage(unittest.TestCase):
             ctx.iteration(True)
         assert(not self._verify_match)
 
+    def test_verify_serialized_match_data(self):
+        def verify_cb(dev, res):
+            r, fp = dev.verify_finish(res)
+            self._verify_match = r
+            self._verify_fp = fp
+
+        fp_whorl = self.enroll_print('whorl')
+
+        fp_data = fp_whorl.serialize()
+        fp_data_full = fp_whorl.serialize_full(FPrint.PrintSerializeFlags.MATCH_DATA)
+        assert len(fp_data_full) > len(fp_data)
+
+        fp_whorl_new = FPrint.Print.deserialize(fp_data_full)
+        assert fp_whorl.equal(fp_whorl_new)
+
+        # Stored again with the restored tables, nothing may change
+        assert fp_whorl_new.serialize_full(FPrint.PrintSerializeFlags.MATCH_DATA) == fp_data_full
+
+        self._verify_match = None
+        self._verify_fp = None
+        self.dev.verify(fp_whorl_new, callback=verify_cb)
+        self.send_image('whorl')
+        while self._verify_match is None:
+            ctx.iteration(True)
+        assert(self._verify_match)
+
+        self._verify_match = None
+        self._verify_fp = None
+        self.dev.verify(fp_whorl_new, callback=verify_cb)
+        self.send_image('tented_arch')
+        while self._verify_match is None:
+            ctx.iteration(True)
+        assert(not self._verify_match)
+
+    def test_serialized_match_data_of_other_print(self):
+        def verify_cb(dev, res):
+            r, fp = dev.verify_finish(res)
+            self._verify_match = r
+            self._verify_fp = fp
+
+        fp_whorl = self.enroll_print('whorl')
+        fp_tented_arch = self.enroll_print('tented_arch')
+
+        fp_data_full = fp_whorl.serialize_full(FPrint.PrintSerializeFlags.MATCH_DATA)
+        arch_data_full = fp_tented_arch.serialize_full(FPrint.PrintSerializeFlags.MATCH_DATA)
+
+        # Store the tables of the other print with the minutiae of the whorl
+        variant_type = GLib.VariantType.new('(issbymsmsia{sv}v)')
+        whorl = GLib.Variant.new_from_bytes(variant_type, GLib.Bytes.new(fp_data_full[3:]), False)
+        arch = GLib.Variant.new_from_bytes(variant_type, GLib.Bytes.new(arch_data_full[3:]), False)
+        children = [whorl.get_child_value(i) for i in range(whorl.n_children())]
+        children[8] = arch.get_child_value(8)
+        mixed = GLib.Variant.new_tuple(*children)
+        mixed_data = fp_data_full[:3] + mixed.get_data_as_bytes().get_data()
+
+        # The tables are dropped and computed again from the minutiae
+        fp_whorl_new = FPrint.Print.deserialize(mixed_data)
+        assert fp_whorl.equal(fp_whorl_new)
+        assert fp_whorl_new.serialize_full(FPrint.PrintSerializeFlags.MATCH_DATA) == fp_data_full
+
+        self._verify_match = None
+        self._verify_fp = None
+        self.dev.verify(fp_whorl_new, callback=verify_cb)
+        self.send_image('whorl')
+        while self._verify_match is None:
+            ctx.iteration(True)
+        assert(self._verify_match)
+
+    def test_match_without_device(self):
+        def verify_cb(dev, res):
+            r, fp = dev.verify_finish(res)
+            self._verify_match = r
+            self._verify_fp = fp
+
+        def scan_print(template, image):
+            self._verify_match = None
+            self._verify_fp = None
+            self.dev.verify(template, callback=verify_cb)
+            self.send_image(image)
+            while self._verify_match is None:
+                ctx.iteration(True)
+            return FPrint.Print.deserialize(self._verify_fp.serialize())
+
+        fp_whorl = self.enroll_print('whorl')
+        fp_tented_arch = self.enroll_print('tented_arch')
+        probe_whorl = scan_print(fp_whorl, 'whorl')
+        probe_tented_arch = scan_print(fp_whorl, 'tented_arch')
+
+        gallery = [FPrint.Print.deserialize(fp.serialize()) for fp in (fp_whorl, fp_tented_arch)]
+
+        assert gallery[0].match(probe_whorl, 0)
+        assert not gallery[0].match(probe_tented_arch, 0)
+        assert gallery[1].match(probe_tented_arch, 0)
+
+        assert probe_whorl.match_gallery(gallery, 0) is gallery[0]
+        assert probe_tented_arch.match_gallery(gallery, 0) is gallery[1]
+        assert probe_whorl.match_gallery(gallery[1:], 0) is None
+
+        # The probe needs to be a single print
+        with self.assertRaises(GLib.GError):
+            gallery[0].match_gallery(gallery, 0)
+
 if __name__ == '__main__':
     try:
         gi.require_version('FPrint', '2.0')